@@ -16,7 +16,14 @@ config::symexec_print_each_value = opt_se_verbose;
 smt::set_query_timeout(to_string(opt_smt_to));
 smt::set_memory_limit((uint64_t)opt_smt_max_mem * 1024 * 1024);
 smt::set_random_seed(to_string(opt_smt_random_seed));
+smt::solver_set_time_budget(opt_smt_time_budget);
+smt::solver_set_portfolio(opt_smt_portfolio);
+smt::solver_set_parallel_queries(opt_smt_parallel_queries);
+smt::solver_set_incremental(opt_smt_incremental);
+smt::solver_set_query_cache(opt_smt_query_cache,
+                            (uint64_t)opt_smt_query_cache_size * 1024 * 1024);
 config::skip_smt = opt_smt_skip;
+config::skip_cex_minimization = opt_skip_cex_minimization;
 config::smt_benchmark_dir = opt_smt_bench_dir;
 smt::solver_print_queries(opt_smt_verbose);
 smt::solver_tactic_verbose(opt_tactic_verbose);
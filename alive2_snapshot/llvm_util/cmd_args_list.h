@@ -75,6 +75,43 @@ llvm::cl::opt<unsigned> opt_smt_random_seed(LLVM_ARGS_PREFIX "smt-random-seed",
   llvm::cl::desc("Random seed for the SMT solver (default=0)"),
   llvm::cl::init(0), llvm::cl::cat(alive_cmdargs));
 
+llvm::cl::opt<unsigned> opt_smt_time_budget(LLVM_ARGS_PREFIX "smt-time-budget",
+  llvm::cl::desc("Time budget for all the SMT queries in ms, which the "
+                 "queries get slices of, retried with longer ones on "
+                 "timeouts while the budget lasts (default=0, i.e., off)"),
+  llvm::cl::init(0), llvm::cl::value_desc("ms"),
+  llvm::cl::cat(alive_cmdargs));
+
+llvm::cl::opt<unsigned> opt_smt_portfolio(LLVM_ARGS_PREFIX "smt-portfolio",
+  llvm::cl::desc("Race this many solver configurations on each SMT query, "
+                 "taking the first definitive answer (default=1, i.e., off)"),
+  llvm::cl::init(1), llvm::cl::cat(alive_cmdargs));
+
+llvm::cl::opt<unsigned> opt_smt_parallel_queries(
+  LLVM_ARGS_PREFIX "smt-parallel-queries",
+  llvm::cl::desc("Solve up to this many independent refinement queries at "
+                 "once (default=1)"),
+  llvm::cl::init(1), llvm::cl::cat(alive_cmdargs));
+
+llvm::cl::list<string> opt_smt_incremental(LLVM_ARGS_PREFIX "smt-incremental",
+  llvm::cl::desc("Check these queries (e.g., ub_src,pre,value, or all) under "
+                 "push/pop on a solver shared by the refinement checks of a "
+                 "function, instead of on a fresh solver each (default=none)"),
+  llvm::cl::CommaSeparated, llvm::cl::value_desc("query names"),
+  llvm::cl::cat(alive_cmdargs));
+
+llvm::cl::opt<string> opt_smt_query_cache(LLVM_ARGS_PREFIX "smt-query-cache",
+  llvm::cl::desc("Keep the answers of the SMT queries in this directory, and "
+                 "reuse them across runs (default=off)"),
+  llvm::cl::value_desc("directory"), llvm::cl::cat(alive_cmdargs));
+
+llvm::cl::opt<unsigned> opt_smt_query_cache_size(
+  LLVM_ARGS_PREFIX "smt-query-cache-size",
+  llvm::cl::desc("Size limit of the SMT query cache, which is emptied beyond "
+                 "(default=256)"),
+  llvm::cl::init(256), llvm::cl::value_desc("MB"),
+  llvm::cl::cat(alive_cmdargs));
+
 llvm::cl::opt<bool> opt_smt_log(LLVM_ARGS_PREFIX "smt-log",
   llvm::cl::desc("Log interactions with the SMT solver"),
   llvm::cl::init(false), llvm::cl::cat(alive_cmdargs));
@@ -83,6 +120,12 @@ llvm::cl::opt<bool> opt_smt_skip(LLVM_ARGS_PREFIX "skip-smt",
   llvm::cl::desc("Skip all SMT queries"),
   llvm::cl::init(false), llvm::cl::cat(alive_cmdargs));
 
+llvm::cl::opt<bool> opt_skip_cex_minimization(
+  LLVM_ARGS_PREFIX "skip-cex-minimization",
+  llvm::cl::desc("Report counterexamples without minimizing their values, "
+                 "which takes one SMT query per attempt (default=false)"),
+  llvm::cl::init(false), llvm::cl::cat(alive_cmdargs));
+
 llvm::cl::opt<string> opt_smt_bench_dir(LLVM_ARGS_PREFIX "smt-bench",
   llvm::cl::desc("Dump smtlib benchmarks"),
   llvm::cl::value_desc("directory"), llvm::cl::cat(alive_cmdargs));
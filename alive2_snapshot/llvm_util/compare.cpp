@@ -6,9 +6,14 @@
 #include "llvm_util/llvm_optimizer.h"
 #include "smt/smt.h"
 #include "tools/transform.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <sstream>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 using namespace tools;
 using namespace util;
@@ -27,8 +32,10 @@ struct Results {
     SYNTACTIC_EQ,
     CORRECT,
     UNSOUND,
-    FAILED_TO_PROVE
+    FAILED_TO_PROVE,
+    CACHED
   } status;
+  string fingerprint;
 
   static Results Error(string &&err) {
     Results r;
@@ -38,10 +45,58 @@ struct Results {
   }
 };
 
+// Print the LLVM definitions F depends on, i.e., the transitive callees
+// with a body and the referenced global variables (with their initializers),
+// which may change the verdict without changing F itself.
+void printDependencies(const llvm::Function &F, ostream &out) {
+  string str;
+  llvm::raw_string_ostream os(str);
+  unordered_set<const llvm::Value*> visited{&F};
+  vector<const llvm::Function*> worklist{&F};
+  vector<const llvm::Constant*> constants;
+
+  auto visit = [&](const llvm::Value *V) {
+    if (!isa<llvm::Constant>(V) || !visited.insert(V).second)
+      return;
+    if (auto *Fn = dyn_cast<llvm::Function>(V)) {
+      if (!Fn->isDeclaration())
+        worklist.push_back(Fn);
+    } else if (auto *GV = dyn_cast<llvm::GlobalVariable>(V)) {
+      GV->print(os);
+      os << '\n';
+      if (GV->hasInitializer())
+        constants.push_back(GV->getInitializer());
+    } else if (!isa<llvm::GlobalValue>(V)) {
+      constants.push_back(cast<llvm::Constant>(V));
+    }
+  };
+
+  while (!worklist.empty() || !constants.empty()) {
+    if (!constants.empty()) {
+      auto *C = constants.back();
+      constants.pop_back();
+      for (auto &Op : C->operands())
+        visit(Op);
+      continue;
+    }
+    auto *Fn = worklist.back();
+    worklist.pop_back();
+    if (Fn != &F)
+      Fn->print(os);
+    for (auto &I : llvm::instructions(*Fn)) {
+      for (auto &Op : I.operands())
+        visit(Op);
+    }
+  }
+  out << os.str();
+}
+
 Results verify(llvm::Function &F1, llvm::Function &F2,
                llvm::TargetLibraryInfoWrapperPass &TLI,
                smt::smt_initializer &smt_init, ostream &out,
-               bool print_transform, bool always_verify) {
+               bool print_transform, bool always_verify, bool bidirectional,
+               VerdictCache *cache, string *cached,
+               const function<void(const char*)> &on_phase) {
   auto fn1 = llvm2alive(F1, TLI.getTLI(F1), true);
   if (!fn1)
     return Results::Error("Could not translate '" + F1.getName().str() +
@@ -55,12 +110,32 @@ Results verify(llvm::Function &F1, llvm::Function &F2,
   Results r;
   r.t.src = std::move(*fn1);
   r.t.tgt = std::move(*fn2);
+  if (on_phase)
+    on_phase("translated");
 
-  if (!always_verify) {
+  if (!always_verify || cache) {
     stringstream ss1, ss2;
     r.t.src.print(ss1);
     r.t.tgt.print(ss2);
-    if (std::move(ss1).str() == std::move(ss2).str()) {
+    string src_str = std::move(ss1).str(), tgt_str = std::move(ss2).str();
+
+    if (cache) {
+      stringstream fp;
+      fp << src_str << "===\n" << tgt_str << "===\n";
+      printDependencies(F1, fp);
+      fp << "===\n";
+      printDependencies(F2, fp);
+      // the flags that change the verdict or its output; the alive2 settings
+      // are up to the cache, see VerdictCache
+      fp << "===\n" << print_transform << always_verify << bidirectional;
+      r.fingerprint = std::move(fp).str();
+      if (cache->lookup(r.fingerprint, *cached)) {
+        r.status = Results::CACHED;
+        return r;
+      }
+    }
+
+    if (!always_verify && src_str == tgt_str) {
       if (print_transform)
         r.t.print(out, {});
       r.status = Results::SYNTACTIC_EQ;
@@ -71,6 +146,7 @@ Results verify(llvm::Function &F1, llvm::Function &F2,
   smt_init.reset();
   r.t.preprocess();
   TransformVerify verifier(r.t, false);
+  verifier.on_phase = on_phase;
 
   if (print_transform)
     r.t.print(out, {});
@@ -83,6 +159,8 @@ Results verify(llvm::Function &F1, llvm::Function &F2,
     }
     assert(types.hasSingleTyping());
   }
+  if (on_phase)
+    on_phase("typed");
 
   r.errs = verifier.verify();
   if (r.errs) {
@@ -93,17 +171,23 @@ Results verify(llvm::Function &F1, llvm::Function &F2,
   return r;
 }
 
-} // namespace
+bool report(Verifier &v, Results &r, llvm::Function &F1, llvm::Function &F2,
+            ostream &out) {
+  auto &TLI = v.TLI;
+  auto &smt_init = v.smt_init;
+  auto quiet = v.quiet;
+  auto &num_correct = v.num_correct;
+  auto &num_unsound = v.num_unsound;
+  auto &num_failed = v.num_failed;
+  auto &num_errors = v.num_errors;
 
-bool Verifier::compareFunctions(llvm::Function &F1, llvm::Function &F2) {
-  auto r = verify(F1, F2, TLI, smt_init, out, !quiet, always_verify);
   if (r.status == Results::ERROR) {
     out << "ERROR: " << r.error;
     ++num_errors;
     return true;
   }
 
-  if (print_dot) {
+  if (v.print_dot) {
     r.t.src.writeDot("src");
     r.t.tgt.writeDot("tgt");
   }
@@ -113,6 +197,7 @@ bool Verifier::compareFunctions(llvm::Function &F1, llvm::Function &F2) {
 
   switch (r.status) {
   case Results::ERROR:
+  case Results::CACHED:
     UNREACHABLE();
     break;
 
@@ -145,11 +230,13 @@ bool Verifier::compareFunctions(llvm::Function &F1, llvm::Function &F2) {
     return true;
   }
 
-  if (bidirectional) {
-    r = verify(F2, F1, TLI, smt_init, out, false, always_verify);
+  if (v.bidirectional) {
+    r = verify(F2, F1, TLI, smt_init, out, false, v.always_verify, false,
+               nullptr, nullptr, nullptr);
     switch (r.status) {
     case Results::ERROR:
     case Results::TYPE_CHECKER_FAILED:
+    case Results::CACHED:
       UNREACHABLE();
       break;
 
@@ -173,3 +260,62 @@ bool Verifier::compareFunctions(llvm::Function &F1, llvm::Function &F2) {
   }
   return true;
 }
+
+// A cached verdict is the counters it bumped and the result, followed by the
+// output it produced, e.g., "1 0 0 0 1\n<output>".
+bool replay(Verifier &v, const string &verdict, bool &result) {
+  istringstream in(verdict);
+  unsigned correct = 0, unsound = 0, failed = 0, errors = 0;
+  if (!(in >> correct >> unsound >> failed >> errors >> result) ||
+      in.get() != '\n')
+    return false;
+
+  v.num_correct += correct;
+  v.num_unsound += unsound;
+  v.num_failed  += failed;
+  v.num_errors  += errors;
+  ++v.num_cached;
+  v.out << verdict.substr(in.tellg());
+  return true;
+}
+
+} // namespace
+
+bool Verifier::compareFunctions(llvm::Function &F1, llvm::Function &F2) {
+  if (!verdict_cache) {
+    auto r = verify(F1, F2, TLI, smt_init, out, !quiet, always_verify,
+                    bidirectional, nullptr, nullptr, on_phase);
+    return report(*this, r, F1, F2, out);
+  }
+
+  // buffer the output so that it can be stored along with the verdict
+  stringstream ss;
+  string cached;
+  bool result;
+  auto r = verify(F1, F2, TLI, smt_init, ss, !quiet, always_verify,
+                  bidirectional, verdict_cache, &cached, on_phase);
+  if (r.status == Results::CACHED) {
+    if (replay(*this, cached, result))
+      return result;
+    // malformed entry; verify again and overwrite it
+    auto fingerprint = std::move(r.fingerprint);
+    r = verify(F1, F2, TLI, smt_init, ss, !quiet, always_verify,
+               bidirectional, nullptr, nullptr, on_phase);
+    r.fingerprint = std::move(fingerprint);
+  }
+
+  unsigned correct = num_correct, unsound = num_unsound, failed = num_failed,
+           errors = num_errors;
+  result = report(*this, r, F1, F2, ss);
+  string output = std::move(ss).str();
+  out << output;
+
+  if (!r.fingerprint.empty()) {
+    stringstream verdict;
+    verdict << (num_correct - correct) << ' ' << (num_unsound - unsound) << ' '
+            << (num_failed - failed) << ' ' << (num_errors - errors) << ' '
+            << result << '\n' << output;
+    verdict_cache->insert(r.fingerprint, std::move(verdict).str());
+  }
+  return result;
+}
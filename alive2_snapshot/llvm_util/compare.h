@@ -6,10 +6,24 @@
 #include "smt/smt.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/Function.h"
+#include <functional>
 #include <ostream>
+#include <string>
 
 namespace llvm_util {
 
+// A persistent store of verdicts, keyed by a fingerprint of the pair of
+// functions (their Alive IR plus the LLVM definitions they depend on) and of
+// the Verifier flags. The store decides what to keep, e.g., it may skip
+// timeouts, and should key the verdicts by the global settings as well.
+class VerdictCache {
+public:
+  virtual ~VerdictCache() = default;
+  virtual bool lookup(const std::string &fingerprint, std::string &verdict) = 0;
+  virtual void insert(const std::string &fingerprint,
+                      const std::string &verdict) = 0;
+};
+
 struct Verifier {
   llvm::TargetLibraryInfoWrapperPass &TLI;
   smt::smt_initializer &smt_init;
@@ -22,6 +36,13 @@ struct Verifier {
   bool always_verify = false;
   bool print_dot = false;
   bool bidirectional = false;
+  // if set, pairs with a known fingerprint are not verified again
+  VerdictCache *verdict_cache = nullptr;
+  unsigned num_cached = 0;
+  // if set, called as the comparison progresses, i.e., with "translated" once
+  // both functions are in Alive IR, "typed" once they type check and
+  // "executed" once they are symbolically executed
+  std::function<void(const char *phase)> on_phase;
 
   Verifier(llvm::TargetLibraryInfoWrapperPass &TLI,
            smt::smt_initializer &smt_init, std::ostream &out)
@@ -47,6 +47,10 @@ void context::init() {
                      Z3_mk_string_symbol(ctx, "timeout"), 0);
 }
 
+void context::setErrorsFatal(bool fatal) {
+  Z3_set_error_handler(ctx, fatal ? z3_error_handler : nullptr);
+}
+
 void context::destroy() {
   Z3_params_dec_ref(ctx, no_timeout_param);
   Z3_del_context(ctx);
@@ -16,6 +16,10 @@ public:
   Z3_context operator()() const { return ctx; }
   Z3_params getNoTimeoutParam() const { return no_timeout_param; }
 
+  // Errors abort by default; otherwise they are left to the caller to check
+  // with Z3_get_error_code
+  void setErrorsFatal(bool fatal);
+
   void init();
   void destroy();
 };
@@ -391,6 +391,7 @@ public:
 
   friend class Solver;
   friend class FnModel;
+  friend class QueryBatch;
   friend class Model;
 };
 
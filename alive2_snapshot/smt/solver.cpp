@@ -3,15 +3,35 @@
 
 #include "smt/solver.h"
 #include "smt/ctx.h"
+#include "smt/smt.h"
 #include "util/compiler.h"
 #include "util/config.h"
 #include "util/file.h"
+#include "util/sha256.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <climits>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <string_view>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include <z3.h>
@@ -31,6 +51,10 @@ static unsigned num_sats = 0;
 static unsigned num_unsats = 0;
 static unsigned num_timeout = 0;
 static unsigned num_errors = 0;
+static unsigned num_cache_hits = 0;
+static unsigned num_cache_misses = 0;
+static unsigned num_escalations = 0;
+static uint64_t cache_bytes_saved = 0;
 
 namespace {
 
@@ -294,6 +318,1054 @@ public:
 static optional<TopLevelTactic> tactic;
 
 
+namespace {
+// A solver configuration of the portfolio
+struct PortfolioConfig {
+  string name;
+  bool bitblast;      // bit-blast QF_BV queries down to SAT
+  unsigned seed_inc;  // added to the default random seed
+};
+
+// A configuration racing on a query, with its own copy of the query
+struct Racer {
+  Z3_context c = nullptr;
+  Z3_solver s = nullptr;
+  Z3_lbool answer = Z3_L_UNDEF;
+  string reason;
+};
+}
+
+static Z3_context mk_context() {
+  auto c = Z3_mk_context_rc(nullptr);
+  // errors are reported through the results instead, e.g., interruptions
+  Z3_set_error_handler(c, nullptr);
+  return c;
+}
+
+static vector<PortfolioConfig> portfolio;
+static vector<unsigned> portfolio_wins;
+static const char *last_winner = nullptr;
+
+// the incremental solver reports its timeouts as cancellations
+static Result::answer unknown_answer(string_view reason) {
+  return reason == "timeout" || reason == "canceled" ? Result::TIMEOUT
+                                                     : Result::ERROR;
+}
+
+// Sets the timeout of the next checks of a solver, in ms
+static void set_solver_timeout(Z3_context c, Z3_solver s, unsigned timeout) {
+  auto params = Z3_mk_params(c);
+  Z3_params_inc_ref(c, params);
+  Z3_params_set_uint(c, params, Z3_mk_string_symbol(c, "timeout"), timeout);
+  Z3_solver_set_params(c, s, params);
+  Z3_params_dec_ref(c, params);
+}
+
+// The first attempt of a query gets 1/budget_slices of the time left, but no
+// less than min_attempt_ms; every retry gets escalation_factor times more
+static constexpr unsigned budget_slices = 8;
+static constexpr unsigned min_attempt_ms = 100;
+static constexpr unsigned escalation_factor = 4;
+static optional<chrono::steady_clock::time_point> budget_deadline;
+
+// The time left of the budget in ms, if any
+static optional<unsigned> budget_left() {
+  if (!budget_deadline)
+    return nullopt;
+  auto left = chrono::duration_cast<chrono::milliseconds>(
+                *budget_deadline - chrono::steady_clock::now()).count();
+  return max<int64_t>(left, 0);
+}
+
+// Same pipeline as the one of solver_init, plus the QF_BV path if requested,
+// for a context other than ctx()
+static Z3_solver mk_context_solver(Z3_context c, const PortfolioConfig &cfg) {
+  vector<Z3_tactic> tactics;
+  auto keep = [&](Z3_tactic t) {
+    Z3_tactic_inc_ref(c, t);
+    tactics.push_back(t);
+    return t;
+  };
+
+  Z3_tactic t = nullptr;
+  for (auto *name : { "simplify", "propagate-values", "simplify",
+                      "elim-uncnstr", "qe-light", "simplify", "elim-uncnstr",
+                      "reduce-args", "qe-light", "simplify" }) {
+    auto next = keep(Z3_mk_tactic(c, name));
+    t = t ? keep(Z3_tactic_and_then(c, t, next)) : next;
+  }
+
+  Z3_tactic last = keep(Z3_mk_tactic(c, "smt"));
+  if (cfg.bitblast) {
+    Z3_tactic sat = nullptr;
+    for (auto *name : { "bit-blast", "simplify", "solve-eqs", "aig", "sat" }) {
+      auto next = keep(Z3_mk_tactic(c, name));
+      sat = sat ? keep(Z3_tactic_and_then(c, sat, next)) : next;
+    }
+    auto probe = Z3_mk_probe(c, "is-qfbv");
+    Z3_probe_inc_ref(c, probe);
+    last = keep(Z3_tactic_cond(c, probe, sat, last));
+    Z3_probe_dec_ref(c, probe);
+  }
+  t = keep(Z3_tactic_and_then(c, t, last));
+
+  auto s = Z3_mk_solver_from_tactic(c, t);
+  Z3_solver_inc_ref(c, s);
+  for (auto tactic : tactics) {
+    Z3_tactic_dec_ref(c, tactic);
+  }
+
+  if (cfg.seed_inc) {
+    auto params = Z3_mk_params(c);
+    Z3_params_inc_ref(c, params);
+    Z3_params_set_uint(c, params, Z3_mk_string_symbol(c, "random_seed"),
+                       strtoul(get_random_seed(), nullptr, 10) + cfg.seed_inc);
+    Z3_solver_set_params(c, s, params);
+    Z3_params_dec_ref(c, params);
+  }
+  return s;
+}
+
+
+namespace {
+// The SHA-256 digest of the canonical serialization of a query, along with
+// its length. A collision would answer a query with the answer of another, so
+// the digest must be collision-resistant, not just well-distributed.
+struct QueryKey {
+  array<unsigned char, 32> digest = {};
+  uint64_t size = 0;
+
+  bool operator==(const QueryKey &other) const = default;
+};
+
+struct QueryKeyHash {
+  size_t operator()(const QueryKey &key) const {
+    size_t hash;
+    memcpy(&hash, key.digest.data(), sizeof(hash));
+    return hash;
+  }
+};
+
+uint64_t fnv1a(uint64_t hash, string_view str) {
+  for (unsigned char c : str) {
+    hash ^= c;
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// NB: the strings returned by Z3_*_to_string are only valid until the next
+// call, so they are copied right away
+string sort_string(Z3_sort sort) {
+  return Z3_sort_to_string(ctx(), sort);
+}
+
+string symbol_string(Z3_symbol sym) {
+  return Z3_get_symbol_kind(ctx(), sym) == Z3_INT_SYMBOL
+           ? to_string(Z3_get_symbol_int(ctx(), sym))
+           : string(Z3_get_symbol_string(ctx(), sym));
+}
+
+// The name, sorts, and parameters (e.g., those of extract) of a decl
+string decl_string(Z3_func_decl decl) {
+  auto c = ctx();
+  string str = Z3_func_decl_to_string(c, decl);
+  for (unsigned i = 0, e = Z3_get_decl_num_parameters(c, decl); i != e; ++i) {
+    str += ' ';
+    switch (Z3_get_decl_parameter_kind(c, decl, i)) {
+    case Z3_PARAMETER_INT:
+      str += to_string(Z3_get_decl_int_parameter(c, decl, i));
+      break;
+    case Z3_PARAMETER_DOUBLE:
+      str += to_string(Z3_get_decl_double_parameter(c, decl, i));
+      break;
+    case Z3_PARAMETER_RATIONAL:
+      str += Z3_get_decl_rational_parameter(c, decl, i);
+      break;
+    case Z3_PARAMETER_SYMBOL:
+      str += symbol_string(Z3_get_decl_symbol_parameter(c, decl, i));
+      break;
+    case Z3_PARAMETER_SORT:
+      str += sort_string(Z3_get_decl_sort_parameter(c, decl, i));
+      break;
+    case Z3_PARAMETER_AST:
+      str += Z3_ast_to_string(c, Z3_get_decl_ast_parameter(c, decl, i));
+      break;
+    case Z3_PARAMETER_FUNC_DECL:
+      str += Z3_func_decl_to_string(c,
+                                    Z3_get_decl_func_decl_parameter(c, decl, i));
+      break;
+    }
+  }
+  return str;
+}
+
+// The sorts of an uninterpreted symbol, but not its name
+string signature(Z3_func_decl decl) {
+  auto c = ctx();
+  string str = "(";
+  for (unsigned i = 0, e = Z3_get_domain_size(c, decl); i != e; ++i) {
+    if (i != 0)
+      str += ' ';
+    str += sort_string(Z3_get_domain(c, decl, i));
+  }
+  return str + ") " + sort_string(Z3_get_range(c, decl));
+}
+
+void get_children(Z3_ast a, vector<Z3_ast> &children) {
+  auto c = ctx();
+  switch (Z3_get_ast_kind(c, a)) {
+  case Z3_APP_AST: {
+    if (Z3_is_numeral_ast(c, a))
+      break;
+    auto app = Z3_to_app(c, a);
+    for (unsigned i = 0, e = Z3_get_app_num_args(c, app); i != e; ++i) {
+      children.push_back(Z3_get_app_arg(c, app, i));
+    }
+    break;
+  }
+  case Z3_QUANTIFIER_AST:
+    children.push_back(Z3_get_quantifier_body(c, a));
+    for (unsigned i = 0, e = Z3_get_quantifier_num_patterns(c, a); i != e;
+         ++i) {
+      auto pat = Z3_get_quantifier_pattern_ast(c, a, i);
+      for (unsigned j = 0, ee = Z3_get_pattern_num_terms(c, pat); j != ee; ++j) {
+        children.push_back(Z3_get_pattern(c, pat, j));
+      }
+    }
+    for (unsigned i = 0, e = Z3_get_quantifier_num_no_patterns(c, a); i != e;
+         ++i) {
+      children.push_back(Z3_get_quantifier_no_pattern_ast(c, a, i));
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+bool is_commutative(Z3_ast a) {
+  auto c = ctx();
+  if (Z3_get_ast_kind(c, a) != Z3_APP_AST || Z3_is_numeral_ast(c, a))
+    return false;
+  switch (Z3_get_decl_kind(c, Z3_get_app_decl(c, Z3_to_app(c, a)))) {
+  case Z3_OP_EQ:
+  case Z3_OP_DISTINCT:
+  case Z3_OP_AND:
+  case Z3_OP_OR:
+  case Z3_OP_XOR:
+  case Z3_OP_ADD:
+  case Z3_OP_MUL:
+  case Z3_OP_BADD:
+  case Z3_OP_BMUL:
+  case Z3_OP_BAND:
+  case Z3_OP_BOR:
+  case Z3_OP_BXOR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The line of a term in the serialization, except for its children and the
+// number of its uninterpreted symbol (if any)
+string node_label(Z3_ast a) {
+  auto c = ctx();
+  auto kind = Z3_get_ast_kind(c, a);
+  string str;
+  if (Z3_is_numeral_ast(c, a)) {
+    str = "n " + sort_string(Z3_get_sort(c, a)) + ' ';
+    str += Z3_ast_to_string(c, a);
+  } else if (kind == Z3_APP_AST) {
+    auto decl = Z3_get_app_decl(c, Z3_to_app(c, a));
+    str = Z3_get_decl_kind(c, decl) == Z3_OP_UNINTERPRETED
+            ? "u " + signature(decl) : "a " + decl_string(decl);
+  } else if (kind == Z3_VAR_AST) {
+    str = "v " + to_string(Z3_get_index_value(c, a)) + ' ' +
+          sort_string(Z3_get_sort(c, a));
+  } else if (kind == Z3_QUANTIFIER_AST) {
+    // the names of the bound variables don't matter either
+    str = Z3_is_quantifier_forall(c, a) ? "forall " :
+          Z3_is_quantifier_exists(c, a) ? "exists " : "lambda ";
+    str += to_string(Z3_get_quantifier_weight(c, a));
+    for (unsigned i = 0, e = Z3_get_quantifier_num_bound(c, a); i != e; ++i) {
+      str += ' ' + sort_string(Z3_get_quantifier_bound_sort(c, a, i));
+    }
+    str += " (" + to_string(Z3_get_quantifier_num_patterns(c, a)) + ' ' +
+           to_string(Z3_get_quantifier_num_no_patterns(c, a)) + ')';
+  } else {
+    str = "? ";
+    str += Z3_ast_to_string(c, a);
+  }
+  return str;
+}
+
+// Visits the terms reachable from root in post-order, once each, without
+// recursion as they may be deep
+void visit_post_order(Z3_ast root, const auto &visited, const auto &children,
+                      const auto &visit) {
+  vector<pair<Z3_ast, bool>> todo = { { root, false } };
+  vector<Z3_ast> args;
+  while (!todo.empty()) {
+    auto [a, expanded] = todo.back();
+    if (visited(a)) {
+      todo.pop_back();
+      continue;
+    }
+    if (!expanded) {
+      todo.back().second = true;
+      args.clear();
+      children(a, args);
+      // the first child is visited first
+      for (auto I = args.rbegin(), E = args.rend(); I != E; ++I) {
+        if (!visited(*I))
+          todo.emplace_back(*I, false);
+      }
+      continue;
+    }
+    todo.pop_back();
+    visit(a);
+  }
+}
+
+// Hashes of the terms that don't depend on the names of their symbols, nor on
+// the order of the operands of the commutative operators, which alive2 orders
+// by the ids of the terms, i.e., by what the context went through before
+class ShapeHasher {
+  unordered_map<unsigned, uint64_t> hashes;   // ast id -> hash
+  unordered_map<unsigned, string> app_labels;  // decl id -> label
+
+public:
+  // node_label, which only depends on the decl for applications
+  string label(Z3_ast a) {
+    auto c = ctx();
+    if (Z3_get_ast_kind(c, a) != Z3_APP_AST || Z3_is_numeral_ast(c, a))
+      return node_label(a);
+    auto decl = Z3_get_app_decl(c, Z3_to_app(c, a));
+    auto [I, inserted] = app_labels.try_emplace(Z3_get_func_decl_id(c, decl));
+    if (inserted)
+      I->second = node_label(a);
+    return I->second;
+  }
+
+  uint64_t get(Z3_ast root) {
+    auto c = ctx();
+    if (auto I = hashes.find(Z3_get_ast_id(c, root)); I != hashes.end())
+      return I->second;
+
+    auto visited = [&](Z3_ast a) {
+      return hashes.count(Z3_get_ast_id(c, a)) != 0;
+    };
+    visit_post_order(root, visited, get_children, [&](Z3_ast a) {
+      uint64_t h = fnv1a(0xcbf29ce484222325, label(a));
+      vector<uint64_t> args;
+      vector<Z3_ast> children;
+      get_children(a, children);
+      for (auto child : children) {
+        args.push_back(hashes.at(Z3_get_ast_id(c, child)));
+      }
+      if (is_commutative(a))
+        sort(args.begin(), args.end());
+      h = fnv1a(h, { (const char*)args.data(), args.size() * sizeof(uint64_t) });
+      hashes.emplace(Z3_get_ast_id(c, a), h);
+    });
+    return hashes.at(Z3_get_ast_id(c, root));
+  }
+};
+
+// Serializes formulas into a QueryKey up to the names of their uninterpreted
+// symbols, which are numbered in order of first occurrence instead, so that
+// queries that only differ in the names of their variables share the key.
+// Each distinct subterm is serialized once and referred to by its number.
+class QuerySerializer {
+  ShapeHasher shapes;
+  unordered_map<unsigned, unsigned> nodes;       // ast id -> number
+  unordered_map<unsigned, unsigned> symbol_ids;  // decl id -> symbol number
+  SHA256 sha;
+
+  void line(const string &str) {
+    write(str);
+    write("\n");
+  }
+
+  // The operands of commutative operators are ordered by their shape; those
+  // of the same shape keep their order, which may only cost a cache miss
+  void getChildren(Z3_ast a, vector<Z3_ast> &children) {
+    get_children(a, children);
+    if (is_commutative(a))
+      stable_sort(children.begin(), children.end(), [&](auto l, auto r) {
+        return shapes.get(l) < shapes.get(r);
+      });
+  }
+
+  void addNode(Z3_ast a);
+
+public:
+  // set by finish, once the whole query has been written
+  QueryKey key;
+  // the uninterpreted symbols, by their number
+  vector<Z3_func_decl> symbols;
+
+  // Returns the number of the term
+  unsigned add(Z3_ast root);
+
+  void write(string_view str) {
+    sha.update(str);
+    key.size += str.size();
+  }
+
+  void finish() {
+    key.digest = sha.final();
+  }
+
+  // Orders the conjuncts by their shape
+  void sortConjuncts(vector<Z3_ast> &conjuncts) {
+    stable_sort(conjuncts.begin(), conjuncts.end(), [&](auto l, auto r) {
+      return shapes.get(l) < shapes.get(r);
+    });
+  }
+
+  optional<unsigned> getSymbol(Z3_func_decl decl) const {
+    auto I = symbol_ids.find(Z3_get_func_decl_id(ctx(), decl));
+    return I == symbol_ids.end() ? nullopt : optional(I->second);
+  }
+};
+
+unsigned QuerySerializer::add(Z3_ast root) {
+  auto c = ctx();
+  auto visited = [&](Z3_ast a) {
+    return nodes.count(Z3_get_ast_id(c, a)) != 0;
+  };
+  auto children = [&](Z3_ast a, vector<Z3_ast> &args) {
+    getChildren(a, args);
+  };
+  visit_post_order(root, visited, children, [&](Z3_ast a) { addNode(a); });
+  return nodes.at(Z3_get_ast_id(c, root));
+}
+
+void QuerySerializer::addNode(Z3_ast a) {
+  auto c = ctx();
+  string str = shapes.label(a);
+
+  if (Z3_get_ast_kind(c, a) == Z3_APP_AST && !Z3_is_numeral_ast(c, a)) {
+    auto decl = Z3_get_app_decl(c, Z3_to_app(c, a));
+    if (Z3_get_decl_kind(c, decl) == Z3_OP_UNINTERPRETED) {
+      auto [I, inserted] = symbol_ids.emplace(Z3_get_func_decl_id(c, decl),
+                                              symbols.size());
+      if (inserted)
+        symbols.push_back(decl);
+      str += " #" + to_string(I->second);
+    }
+  }
+
+  vector<Z3_ast> children;
+  getChildren(a, children);
+  for (auto child : children) {
+    str += ' ' + to_string(nodes.at(Z3_get_ast_id(c, child)));
+  }
+  line(str);
+  nodes.emplace(Z3_get_ast_id(c, a), nodes.size());
+}
+
+// Serializes the conjunction of the given assertions, along with the solver
+// configuration. The conjuncts are ordered by their shape first, so that the
+// order in which they were asserted doesn't matter either.
+void serialize_query(const vector<Z3_ast> &assertions, QuerySerializer &s) {
+  auto c = ctx();
+  vector<Z3_ast> conjuncts, todo(assertions.rbegin(), assertions.rend());
+  while (!todo.empty()) {
+    auto a = todo.back();
+    todo.pop_back();
+    if (Z3_get_ast_kind(c, a) == Z3_APP_AST) {
+      auto app = Z3_to_app(c, a);
+      if (Z3_get_decl_kind(c, Z3_get_app_decl(c, app)) == Z3_OP_AND) {
+        for (unsigned i = Z3_get_app_num_args(c, app); i != 0; --i) {
+          todo.push_back(Z3_get_app_arg(c, app, i - 1));
+        }
+        continue;
+      }
+    }
+    conjuncts.push_back(a);
+  }
+  s.sortConjuncts(conjuncts);
+
+  // only definitive answers are cached, so the timeouts don't matter
+  s.write("z3 ");
+  s.write(Z3_get_full_version());
+  s.write(" seed ");
+  s.write(get_random_seed());
+  s.write("\n");
+  for (auto a : conjuncts) {
+    s.write("assert " + to_string(s.add(a)) + '\n');
+  }
+  s.finish();
+}
+
+
+// Whether the value is a closed term of interpreted symbols, and so it means
+// the same in any query (unlike, e.g., an as-array of an auxiliary function)
+bool is_closed_value(Z3_ast a) {
+  auto c = ctx();
+  if (Z3_is_numeral_ast(c, a))
+    return true;
+  if (Z3_get_ast_kind(c, a) != Z3_APP_AST)
+    return false;
+
+  auto app = Z3_to_app(c, a);
+  auto kind = Z3_get_decl_kind(c, Z3_get_app_decl(c, app));
+  if (kind == Z3_OP_UNINTERPRETED || kind == Z3_OP_AS_ARRAY)
+    return false;
+  for (unsigned i = 0, e = Z3_get_app_num_args(c, app); i != e; ++i) {
+    if (!is_closed_value(Z3_get_app_arg(c, app, i)))
+      return false;
+  }
+  return true;
+}
+
+void put_token(string &out, string_view token) {
+  out += to_string(token.size());
+  out += ':';
+  out += token;
+}
+
+bool get_token(string_view &in, string_view &token) {
+  size_t size = 0;
+  auto colon = in.find(':');
+  if (colon == string_view::npos || colon == 0)
+    return false;
+  auto [ptr, ec] = from_chars(in.data(), in.data() + colon, size);
+  if (ec != errc() || ptr != in.data() + colon || in.size() - colon - 1 < size)
+    return false;
+  token = in.substr(colon + 1, size);
+  in.remove_prefix(colon + 1 + size);
+  return true;
+}
+
+bool get_number(string_view &in, unsigned &n) {
+  string_view token;
+  if (!get_token(in, token) || token.empty())
+    return false;
+  auto [ptr, ec] = from_chars(token.data(), token.data() + token.size(), n);
+  return ec == errc() && ptr == token.data() + token.size();
+}
+
+// The stores into a constant array (owning a reference) that an as-array of
+// a (single-argument) function of the model stands for, null for other values
+Z3_ast expand_as_array(Z3_model m, Z3_ast value) {
+  auto c = ctx();
+  if (Z3_get_ast_kind(c, value) != Z3_APP_AST ||
+      Z3_get_decl_kind(c, Z3_get_app_decl(c, Z3_to_app(c, value))) !=
+        Z3_OP_AS_ARRAY)
+    return nullptr;
+  auto fn = Z3_get_as_array_func_decl(c, value);
+  if (Z3_get_domain_size(c, fn) != 1 || !Z3_model_has_interp(c, m, fn))
+    return nullptr;
+
+  auto f = Z3_model_get_func_interp(c, m, fn);
+  Z3_func_interp_inc_ref(c, f);
+  Z3_func_entry first = nullptr;
+  auto else_value = Z3_func_interp_get_else(c, f);
+  // the else value of a partial interpretation is unspecified, so any value
+  // will do
+  if (!else_value && Z3_func_interp_get_num_entries(c, f) != 0) {
+    first = Z3_func_interp_get_entry(c, f, 0);
+    Z3_func_entry_inc_ref(c, first);
+    else_value = Z3_func_entry_get_value(c, first);
+  }
+
+  Z3_ast array = nullptr;
+  if (else_value) {
+    array = Z3_mk_const_array(c, Z3_get_domain(c, fn, 0), else_value);
+    Z3_inc_ref(c, array);
+    for (unsigned i = 0, e = Z3_func_interp_get_num_entries(c, f); i != e;
+         ++i) {
+      auto entry = Z3_func_interp_get_entry(c, f, i);
+      Z3_func_entry_inc_ref(c, entry);
+      auto store = Z3_mk_store(c, array, Z3_func_entry_get_arg(c, entry, 0),
+                               Z3_func_entry_get_value(c, entry));
+      Z3_inc_ref(c, store);
+      Z3_dec_ref(c, array);
+      array = store;
+      Z3_func_entry_dec_ref(c, entry);
+    }
+  }
+  if (first)
+    Z3_func_entry_dec_ref(c, first);
+  Z3_func_interp_dec_ref(c, f);
+  return array;
+}
+
+// The model as tokens: the numbers of the symbols of the query, and the
+// SMT-LIB values of their interpretations. Empty if any of those is not a
+// closed value, as it couldn't be read back in another query.
+string serialize_model(Z3_model m, const QuerySerializer &query) {
+  auto c = ctx();
+  string out;
+  bool ok = true;
+  auto put_value = [&](Z3_ast value) {
+    auto array = value ? expand_as_array(m, value) : nullptr;
+    if (array)
+      value = array;
+    if (!value || !is_closed_value(value))
+      ok = false;
+    else
+      put_token(out, Z3_ast_to_string(c, value));
+    if (array)
+      Z3_dec_ref(c, array);
+  };
+
+  put_token(out, "model");
+  for (unsigned i = 0, e = Z3_model_get_num_consts(c, m); ok && i != e; ++i) {
+    auto decl = Z3_model_get_const_decl(c, m, i);
+    auto value = Z3_model_get_const_interp(c, m, decl);
+    auto n = query.getSymbol(decl);
+    // skip the auxiliary constants of the model
+    if (!n || !value)
+      continue;
+    put_token(out, "c");
+    put_token(out, to_string(*n));
+    put_value(value);
+  }
+
+  for (unsigned i = 0, e = Z3_model_get_num_funcs(c, m); ok && i != e; ++i) {
+    auto decl = Z3_model_get_func_decl(c, m, i);
+    auto n = query.getSymbol(decl);
+    if (!n)
+      continue;
+    auto f = Z3_model_get_func_interp(c, m, decl);
+    Z3_func_interp_inc_ref(c, f);
+    unsigned num_entries = Z3_func_interp_get_num_entries(c, f);
+    put_token(out, "f");
+    put_token(out, to_string(*n));
+    put_token(out, to_string(num_entries));
+    for (unsigned j = 0; ok && j != num_entries; ++j) {
+      auto entry = Z3_func_interp_get_entry(c, f, j);
+      Z3_func_entry_inc_ref(c, entry);
+      for (unsigned k = 0, ee = Z3_func_entry_get_num_args(c, entry); k != ee;
+           ++k) {
+        put_value(Z3_func_entry_get_arg(c, entry, k));
+      }
+      put_value(Z3_func_entry_get_value(c, entry));
+      Z3_func_entry_dec_ref(c, entry);
+    }
+    // the else value of a partial interpretation is unspecified
+    auto else_value = Z3_func_interp_get_else(c, f);
+    put_token(out, else_value ? "e" : "-");
+    if (else_value)
+      put_value(else_value);
+    Z3_func_interp_dec_ref(c, f);
+  }
+  return ok ? out : string();
+}
+
+// The model of the query (owning a reference) from its serialization, or null
+// if it doesn't fit the query
+Z3_model deserialize_model(string_view in, const QuerySerializer &query) {
+  auto c = ctx();
+  struct Interp {
+    Z3_func_decl decl;
+    unsigned num_entries;  // UINT_MAX for a constant
+    unsigned first_value;
+    bool has_else;
+  };
+  vector<Interp> interps;
+  vector<pair<string_view, Z3_sort>> values;
+
+  string_view token;
+  if (!get_token(in, token) || token != "model")
+    return nullptr;
+
+  while (!in.empty()) {
+    string_view kind;
+    unsigned n, num_entries = UINT_MAX;
+    if (!get_token(in, kind) || (kind != "c" && kind != "f") ||
+        !get_number(in, n) || n >= query.symbols.size() ||
+        (kind == "f" && !get_number(in, num_entries)))
+      return nullptr;
+
+    auto decl = query.symbols[n];
+    unsigned arity = Z3_get_domain_size(c, decl);
+    if ((kind == "c") != (arity == 0))
+      return nullptr;
+    interps.push_back({ decl, num_entries, (unsigned)values.size(), true });
+
+    auto get_value = [&](Z3_sort sort) {
+      return get_token(in, token) && (values.emplace_back(token, sort), true);
+    };
+    auto range = Z3_get_range(c, decl);
+    for (unsigned i = 0; kind == "f" && i != num_entries; ++i) {
+      for (unsigned j = 0; j != arity; ++j) {
+        if (!get_value(Z3_get_domain(c, decl, j)))
+          return nullptr;
+      }
+      if (!get_value(range))
+        return nullptr;
+    }
+    if (kind == "f") {
+      if (!get_token(in, token) || (token != "e" && token != "-"))
+        return nullptr;
+      interps.back().has_else = token == "e";
+    }
+    if (interps.back().has_else && !get_value(range))
+      return nullptr;
+  }
+
+  string script;
+  for (unsigned i = 0, e = values.size(); i != e; ++i) {
+    auto name = "|r" + to_string(i) + '|';
+    script += "(declare-fun " + name + " () " + sort_string(values[i].second) +
+              ")\n(assert (= " + name + ' ';
+    script += values[i].first;
+    script += "))\n";
+  }
+
+  // a parsing error only means that the model can't be used
+  ctx.setErrorsFatal(false);
+  auto parsed = Z3_parse_smtlib2_string(c, script.c_str(), 0, nullptr,
+                                        nullptr, 0, nullptr, nullptr);
+  bool ok = Z3_get_error_code(c) == Z3_OK && parsed;
+  ctx.setErrorsFatal(true);
+  if (!ok)
+    return nullptr;
+  Z3_ast_vector_inc_ref(c, parsed);
+
+  vector<Z3_ast> asts;
+  if (Z3_ast_vector_size(c, parsed) == values.size()) {
+    for (unsigned i = 0, e = values.size(); i != e; ++i) {
+      auto eq = Z3_ast_vector_get(c, parsed, i);
+      if (Z3_get_ast_kind(c, eq) != Z3_APP_AST ||
+          Z3_get_app_num_args(c, Z3_to_app(c, eq)) != 2)
+        break;
+      auto value = Z3_get_app_arg(c, Z3_to_app(c, eq), 1);
+      Z3_inc_ref(c, value);
+      asts.push_back(value);
+    }
+  }
+  Z3_ast_vector_dec_ref(c, parsed);
+
+  Z3_model m = nullptr;
+  if (asts.size() == values.size()) {
+    m = Z3_mk_model(c);
+    Z3_model_inc_ref(c, m);
+    for (auto &interp : interps) {
+      auto *value = &asts[interp.first_value];
+      if (interp.num_entries == UINT_MAX) {
+        Z3_add_const_interp(c, m, interp.decl, *value);
+        continue;
+      }
+
+      unsigned arity = Z3_get_domain_size(c, interp.decl);
+      auto f = Z3_add_func_interp(c, m, interp.decl,
+                                  interp.has_else
+                                    ? value[interp.num_entries * (arity + 1)]
+                                    : nullptr);
+      Z3_func_interp_inc_ref(c, f);
+      for (unsigned i = 0; i != interp.num_entries; ++i, value += arity + 1) {
+        auto args = Z3_mk_ast_vector(c);
+        Z3_ast_vector_inc_ref(c, args);
+        for (unsigned j = 0; j != arity; ++j) {
+          Z3_ast_vector_push(c, args, value[j]);
+        }
+        Z3_func_interp_add_entry(c, f, args, value[arity]);
+        Z3_ast_vector_dec_ref(c, args);
+      }
+      Z3_func_interp_dec_ref(c, f);
+    }
+  }
+  for (auto a : asts) {
+    Z3_dec_ref(c, a);
+  }
+  return m;
+}
+
+
+// A persistent cache of the definitive answers of queries, shared by the
+// processes using the same directory, which holds two files:
+//  - index: a header, then fixed-size records of the keys of the queries,
+//    their answers, and where their models are in the data file.
+//  - data: the models of the SAT queries, each prefixed with its key.
+// UNSAT answers take an index record only. Both files are only appended to,
+// with the index locked (flock), until they exceed the size limit, in which
+// case they are emptied and the generation in the header is bumped, so that
+// the other processes drop the copy of the index they keep in memory.
+class QueryCache {
+public:
+  struct Entry {
+    Result::answer answer;
+    uint64_t offset;
+    uint32_t length;  // of the model, 0 if none
+  };
+
+private:
+  static constexpr char MAGIC[8] = { 'A', '2', 'Q', 'C', 'A', 'C', 'H', '2' };
+
+  struct Header {
+    char magic[8];
+    uint64_t generation;
+  };
+
+  struct Record {
+    unsigned char digest[32];
+    uint64_t size;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t answer;
+  };
+
+  string dir;
+  uint64_t max_size;
+  // the process that opened the files: a forked child opens its own, as it
+  // would share the flocks of its parent otherwise
+  pid_t pid = 0;
+  int index_fd = -1, data_fd = -1;
+  uint64_t generation = 0;
+  uint64_t index_loaded = sizeof(Header);
+  unordered_map<QueryKey, Entry, QueryKeyHash> entries;
+
+  bool open();
+  void close();
+  void load();
+
+public:
+  QueryCache(string dir, uint64_t max_size)
+    : dir(std::move(dir)), max_size(max_size) {}
+  ~QueryCache() { close(); }
+
+  optional<Entry> find(const QueryKey &key);
+  // Returns the model (owning a reference), or null if it's gone
+  Z3_model readModel(const QueryKey &key, const Entry &entry,
+                     const QuerySerializer &query);
+  // Replaces the entry of the same answer (and with a model) only if asked to,
+  // e.g., if its model couldn't be read
+  void insert(const QueryKey &key, Result::answer answer, string_view model,
+              bool replace = false);
+};
+
+void QueryCache::close() {
+  if (index_fd >= 0)
+    ::close(index_fd);
+  if (data_fd >= 0)
+    ::close(data_fd);
+  index_fd = data_fd = -1;
+}
+
+bool QueryCache::open() {
+  if (pid == getpid())
+    return index_fd >= 0;
+
+  close();
+  pid = getpid();
+  error_code ec;
+  filesystem::create_directories(dir, ec);
+  index_fd = ::open((dir + "/index").c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                    0644);
+  data_fd = ::open((dir + "/data").c_str(), O_RDWR | O_CREAT | O_CLOEXEC,
+                   0644);
+
+  // start a new (or incompatible) cache over
+  Header header;
+  if (index_fd >= 0 && data_fd >= 0 && flock(index_fd, LOCK_EX) == 0) {
+    if (pread(index_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+      memcpy(header.magic, MAGIC, sizeof(MAGIC));
+      header.generation = 0;
+      if (ftruncate(data_fd, 0) != 0 || ftruncate(index_fd, 0) != 0 ||
+          pwrite(index_fd, &header, sizeof(header), 0) != sizeof(header))
+        close();
+    }
+    if (index_fd >= 0)
+      flock(index_fd, LOCK_UN);
+  } else {
+    close();
+  }
+
+  if (index_fd < 0)
+    dbg() << "Alive2: Couldn't open the SMT query cache in " << dir << endl;
+  return index_fd >= 0;
+}
+
+// Reads the records appended by the other processes; the index must be locked
+void QueryCache::load() {
+  Header header;
+  if (pread(index_fd, &header, sizeof(header), 0) != sizeof(header))
+    return;
+  if (header.generation != generation) {
+    entries.clear();
+    generation = header.generation;
+    index_loaded = sizeof(Header);
+  }
+
+  struct stat st;
+  if (fstat(index_fd, &st) != 0 || (uint64_t)st.st_size <= index_loaded)
+    return;
+  vector<Record> records((st.st_size - index_loaded) / sizeof(Record));
+  auto size = records.size() * sizeof(Record);
+  if (pread(index_fd, records.data(), size, index_loaded) != (ssize_t)size)
+    return;
+  index_loaded += size;
+
+  for (auto &r : records) {
+    if (r.answer != Result::UNSAT && r.answer != Result::SAT)
+      continue;
+    QueryKey key;
+    memcpy(key.digest.data(), r.digest, sizeof(r.digest));
+    key.size = r.size;
+    entries[key] = { (Result::answer)r.answer, r.offset, r.length };
+  }
+}
+
+optional<QueryCache::Entry> QueryCache::find(const QueryKey &key) {
+  if (!open())
+    return {};
+
+  auto I = entries.find(key);
+  if (I == entries.end() && flock(index_fd, LOCK_SH) == 0) {
+    load();
+    flock(index_fd, LOCK_UN);
+    I = entries.find(key);
+  }
+  return I == entries.end() ? nullopt : optional(I->second);
+}
+
+Z3_model QueryCache::readModel(const QueryKey &key, const Entry &entry,
+                               const QuerySerializer &query) {
+  if (entry.length == 0)
+    return nullptr;
+
+  // the offset is stale if the cache has been emptied in the meantime
+  string buf(key.digest.size() + entry.length, '\0');
+  if (pread(data_fd, buf.data(), buf.size(), entry.offset) !=
+        (ssize_t)buf.size() ||
+      memcmp(buf.data(), key.digest.data(), key.digest.size()) != 0)
+    return nullptr;
+
+  return deserialize_model(string_view(buf).substr(key.digest.size()), query);
+}
+
+void QueryCache::insert(const QueryKey &key, Result::answer answer,
+                        string_view model, bool replace) {
+  uint64_t data_size = model.empty() ? 0 : key.digest.size() + model.size();
+  if (sizeof(Header) + sizeof(Record) + data_size > max_size ||
+      model.size() > UINT32_MAX || !open() || flock(index_fd, LOCK_EX) != 0)
+    return;
+
+  load();
+  // don't store the same answer twice, unless it comes with a model now
+  auto I = entries.find(key);
+  struct stat index_st, data_st;
+  if ((!replace && I != entries.end() && I->second.answer == answer &&
+       (I->second.length != 0 || model.empty())) ||
+      fstat(index_fd, &index_st) != 0 || fstat(data_fd, &data_st) != 0) {
+    flock(index_fd, LOCK_UN);
+    return;
+  }
+
+  uint64_t index_end = index_st.st_size, data_end = data_st.st_size;
+  if (index_end + sizeof(Record) + data_end + data_size > max_size) {
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.generation = generation + 1;
+    if (ftruncate(data_fd, 0) != 0 ||
+        ftruncate(index_fd, sizeof(Header)) != 0 ||
+        pwrite(index_fd, &header, sizeof(header), 0) != sizeof(header)) {
+      flock(index_fd, LOCK_UN);
+      return;
+    }
+    load();
+    index_end = sizeof(Header);
+    data_end = 0;
+  }
+
+  Record record;
+  memcpy(record.digest, key.digest.data(), sizeof(record.digest));
+  record.size = key.size;
+  record.offset = data_end;
+  record.length = (uint32_t)model.size();
+  record.answer = (uint32_t)answer;
+  bool ok = true;
+  if (!model.empty()) {
+    string buf((const char*)key.digest.data(), key.digest.size());
+    buf += model;
+    ok = pwrite(data_fd, buf.data(), buf.size(), data_end) ==
+           (ssize_t)buf.size();
+  }
+  // the record is read back by the next load, along with those of the others
+  if (ok)
+    pwrite(index_fd, &record, sizeof(record), index_end);
+  flock(index_fd, LOCK_UN);
+}
+}
+
+static bool profile_queries = false;
+static vector<QueryProfile> query_profiles;
+// The record of the query being checked by Solver::check, completed by
+// whatever answers it
+static QueryProfile *current_profile = nullptr;
+
+static const char* result_name(const Result &r) {
+  return r.isSat()     ? "sat"
+       : r.isUnsat()   ? "unsat"
+       : r.isTimeout() ? "timeout"
+       : r.isSkip()    ? "skip"
+       : r.isInvalid() ? "invalid"
+                       : "error";
+}
+
+// Counts the distinct terms of the assertions and finds their widest
+// bit-vector one
+static void measure_query(const vector<Z3_ast> &asts, QueryProfile &profile) {
+  auto c = ctx();
+  unordered_set<unsigned> seen;
+  auto visited = [&](Z3_ast a) { return seen.count(Z3_get_ast_id(c, a)); };
+  for (auto root : asts) {
+    visit_post_order(root, visited, get_children, [&](Z3_ast a) {
+      seen.insert(Z3_get_ast_id(c, a));
+      auto sort = Z3_get_sort(c, a);
+      if (Z3_get_sort_kind(c, sort) == Z3_BV_SORT)
+        profile.max_bits = max(profile.max_bits, Z3_get_bv_sort_size(c, sort));
+    });
+  }
+  profile.num_nodes = seen.size();
+}
+
+static void add_z3_stats(QueryProfile &profile, Z3_context c, Z3_solver s) {
+  auto stats = Z3_solver_get_statistics(c, s);
+  Z3_stats_inc_ref(c, stats);
+  for (unsigned i = 0, e = Z3_stats_size(c, stats); i != e; ++i) {
+    profile.z3_stats.emplace_back(Z3_stats_get_key(c, stats, i),
+                                  Z3_stats_is_uint(c, stats, i)
+                                    ? Z3_stats_get_uint_value(c, stats, i)
+                                    : Z3_stats_get_double_value(c, stats, i));
+  }
+  Z3_stats_dec_ref(c, stats);
+}
+
+// The solver keeps its assertions (and so the symbols) alive
+static vector<Z3_ast> get_assertions(Z3_solver s) {
+  auto assertions = Z3_solver_get_assertions(ctx(), s);
+  Z3_ast_vector_inc_ref(ctx(), assertions);
+  vector<Z3_ast> asts;
+  for (unsigned i = 0, e = Z3_ast_vector_size(ctx(), assertions); i != e; ++i) {
+    asts.push_back(Z3_ast_vector_get(ctx(), assertions, i));
+  }
+  Z3_ast_vector_dec_ref(ctx(), assertions);
+  return asts;
+}
+
+static unique_ptr<QueryCache> query_cache;
+
+// Counts a query answered from the cache
+static void cache_hit(const QuerySerializer &query, Result::answer answer) {
+  ++num_cache_hits;
+  cache_bytes_saved += query.key.size;
+  if (answer == Result::UNSAT)
+    ++num_unsats;
+  else
+    ++num_sats;
+  if (current_profile)
+    current_profile->source = "cache";
+}
+
+
 namespace smt {
 
 Model::Model(Z3_model m) : m(m) {
@@ -400,6 +1472,19 @@ void solver_print_queries(bool yes) {
   print_queries = yes;
 }
 
+static QueryObserver query_observer;
+void solver_set_query_observer(QueryObserver observer) {
+  query_observer = std::move(observer);
+}
+
+void solver_set_profile(bool enable) {
+  profile_queries = enable;
+}
+
+vector<QueryProfile> solver_take_profile() {
+  return std::exchange(query_profiles, {});
+}
+
 void solver_tactic_verbose(bool yes) {
   tactic_verbose = yes;
 }
@@ -427,26 +1512,88 @@ void Solver::add(const expr &e) {
   }
 }
 
+// the checks minimizing an assignment in Solver::block, beyond which the
+// assignments not yet known to be needed are kept
+static constexpr unsigned max_block_checks = 16;
+
 void Solver::block(const Model &m, Solver *sneg) {
-  set<expr> assignments;
+  vector<expr> assignments;
   for (const auto &[var, val] : m) {
-    assignments.insert(var == val);
+    assignments.emplace_back(var == val);
   }
 
-  if (sneg) {
-    // simple left-to-right variable discard algorithm
-    for (auto I = assignments.begin(); I != assignments.end(); ) {
-      SolverPush push(*sneg);
-      expr val = *I;
-      I = assignments.erase(I);
+  if (sneg && sneg->is_unsat) {
+    assignments.clear();
+
+  } else if (sneg && sneg->valid && !assignments.empty()) {
+    // Find a small subset of the assignments that sneg refutes. Each
+    // assignment is guarded by an indicator, so that a subset is checked as
+    // assumptions, and its unsat core drops every assignment not needed at
+    // once. Then try to drop the remaining ones, one at a time.
+    SolverPush push(*sneg);
+    vector<expr> indicators;
+    unordered_map<unsigned, unsigned> indicator_idx; // AST id -> assignment
+    for (unsigned i = 0, e = assignments.size(); i != e; ++i) {
+      auto &ind = indicators.emplace_back(expr::mkFreshVar("#block", false));
+      indicator_idx.emplace(Z3_get_ast_id(ctx(), ind()), i);
+      sneg->add(ind.implies(assignments[i]));
+    }
+
+    // returns the (sorted) unsat core of the given assignments if refuted
+    auto refute = [&](const vector<unsigned> &subset)
+                    -> optional<vector<unsigned>> {
+      vector<Z3_ast> assumptions;
+      for (auto i : subset) {
+        assumptions.emplace_back(indicators[i]());
+      }
+      if (Z3_solver_check_assumptions(ctx(), sneg->s, assumptions.size(),
+                                      assumptions.data()) != Z3_L_FALSE)
+        return {};
+
+      auto vect = Z3_solver_get_unsat_core(ctx(), sneg->s);
+      Z3_ast_vector_inc_ref(ctx(), vect);
+      vector<unsigned> core;
+      for (unsigned i = 0, e = Z3_ast_vector_size(ctx(), vect); i != e; ++i) {
+        auto ast = Z3_ast_vector_get(ctx(), vect, i);
+        core.emplace_back(indicator_idx.at(Z3_get_ast_id(ctx(), ast)));
+      }
+      Z3_ast_vector_dec_ref(ctx(), vect);
+      sort(core.begin(), core.end());
+      return core;
+    };
+
+    vector<unsigned> core(assignments.size());
+    for (unsigned i = 0, e = core.size(); i != e; ++i) {
+      core[i] = i;
+    }
+
+    if (auto c = refute(core)) {
+      core = std::move(*c);
+      // an assignment needed by a core is needed by all its subsets
+      set<unsigned> needed;
+      for (unsigned checks = 1; checks < max_block_checks; ++checks) {
+        auto I = find_if(core.begin(), core.end(),
+                         [&](unsigned i) { return !needed.count(i); });
+        if (I == core.end())
+          break;
+
+        vector<unsigned> subset(core.begin(), I);
+        subset.insert(subset.end(), next(I), core.end());
+        if (auto c = refute(subset))
+          core = std::move(*c);
+        else
+          needed.emplace(*I);
+      }
 
-      sneg->add(expr::mk_and(assignments));
-      if (!sneg->check().isUnsat())
-        assignments.insert(std::move(val));
+      vector<expr> kept;
+      for (auto i : core) {
+        kept.emplace_back(std::move(assignments[i]));
+      }
+      assignments = std::move(kept);
     }
   }
 
-  add(!expr::mk_and(assignments));
+  add(!expr::mk_and(set<expr>(assignments.begin(), assignments.end())));
 }
 
 void Solver::reset() {
@@ -511,7 +1658,105 @@ Result Solver::check(const char *query_name) const {
 
   tactic->check();
 
-  switch (Z3_solver_check(ctx(), s)) {
+  if (!query_observer && !profile_queries)
+    return check_cached();
+
+  QueryProfile profile;
+  if (profile_queries) {
+    profile.name = query_name ? query_name : "";
+    measure_query(get_assertions(s), profile);
+    current_profile = &profile;
+  }
+
+  if (query_observer)
+    query_observer(query_name, nullptr, 0);
+  auto start = chrono::steady_clock::now();
+  auto r = check_cached();
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                              start).count();
+  if (query_observer)
+    query_observer(query_name, &r, ms);
+
+  if (profile_queries) {
+    current_profile = nullptr;
+    profile.result = result_name(r);
+    profile.ms = ms;
+    query_profiles.emplace_back(std::move(profile));
+  }
+  return r;
+}
+
+Result Solver::check_cached() const {
+  if (!query_cache)
+    return check_budgeted();
+
+  QuerySerializer query;
+  serialize_query(get_assertions(s), query);
+
+  auto entry = query_cache->find(query.key);
+  if (entry) {
+    if (entry->answer == Result::UNSAT) {
+      cache_hit(query, Result::UNSAT);
+      return Result::UNSAT;
+    }
+    // a SAT answer is only good with a model
+    if (auto model = query_cache->readModel(query.key, *entry, query)) {
+      cache_hit(query, Result::SAT);
+      Result r(model);
+      Z3_model_dec_ref(ctx(), model);
+      return r;
+    }
+  }
+
+  ++num_cache_misses;
+  auto r = check_budgeted();
+  if (r.isUnsat())
+    query_cache->insert(query.key, Result::UNSAT, {});
+  else if (r.isSat())
+    query_cache->insert(query.key, Result::SAT, serialize_model(r.m.m, query),
+                        entry && entry->length != 0);
+  return r;
+}
+
+Result Solver::check_budgeted() const {
+  auto left = budget_left();
+  if (!left)
+    return portfolio.empty() ? check_z3(0) : check_portfolio(0);
+  if (*left == 0) {
+    ++num_timeout;
+    return Result::TIMEOUT;
+  }
+
+  unsigned timeout = min({ max(*left / budget_slices, min_attempt_ms),
+                           (unsigned)strtoul(get_query_timeout(), nullptr, 10),
+                           *left });
+  while (true) {
+    auto r = portfolio.empty() ? check_z3(timeout) : check_portfolio(timeout);
+    if (!r.isTimeout())
+      return r;
+
+    // the retries may go beyond the query timeout, as long as the budget lasts
+    unsigned next = min(timeout * escalation_factor, *budget_left());
+    if (next <= timeout)
+      return r;
+    --num_timeout;
+    ++num_escalations;
+    dbg() << "\nQuery timed out after " << timeout << " ms, retrying with "
+          << next << " ms\n";
+    timeout = next;
+  }
+}
+
+Result Solver::check_z3(unsigned timeout) const {
+  if (timeout != 0)
+    set_solver_timeout(ctx(), s, timeout);
+  auto answer = Z3_solver_check(ctx(), s);
+  if (current_profile) {
+    current_profile->source = "z3";
+    add_z3_stats(*current_profile, ctx(), s);
+  }
+
+  switch (answer) {
   case Z3_L_FALSE:
     ++num_unsats;
     return Result::UNSAT;
@@ -520,7 +1765,7 @@ Result Solver::check(const char *query_name) const {
     return Z3_solver_get_model(ctx(), s);
   case Z3_L_UNDEF: {
     string_view reason = Z3_solver_get_reason_unknown(ctx(), s);
-    if (reason == "timeout") {
+    if (unknown_answer(reason) == Result::TIMEOUT) {
       ++num_timeout;
       return Result::TIMEOUT;
     }
@@ -532,6 +1777,365 @@ Result Solver::check(const char *query_name) const {
   }
 }
 
+Result Solver::check_portfolio(unsigned timeout) const {
+  // Z3 contexts are not thread-safe, so every configuration gets a copy of
+  // the query in a context of its own; ctx() is only used by this thread
+  vector<Racer> racers(portfolio.size());
+  auto assertions = Z3_solver_get_assertions(ctx(), s);
+  Z3_ast_vector_inc_ref(ctx(), assertions);
+  for (unsigned i = 0, e = racers.size(); i != e; ++i) {
+    auto &r = racers[i];
+    r.c = mk_context();
+    r.s = mk_context_solver(r.c, portfolio[i]);
+    if (timeout != 0)
+      set_solver_timeout(r.c, r.s, timeout);
+    for (unsigned j = 0, ee = Z3_ast_vector_size(ctx(), assertions); j != ee;
+         ++j) {
+      Z3_solver_assert(r.c, r.s,
+                       Z3_translate(ctx(), Z3_ast_vector_get(ctx(), assertions,
+                                                             j), r.c));
+    }
+  }
+  Z3_ast_vector_dec_ref(ctx(), assertions);
+
+  mutex m;
+  condition_variable cv;
+  optional<unsigned> winner;
+  unsigned running = racers.size();
+
+  vector<thread> threads;
+  for (unsigned i = 0, e = racers.size(); i != e; ++i) {
+    threads.emplace_back([&, i]() {
+      auto &r = racers[i];
+      r.answer = Z3_solver_check(r.c, r.s);
+      if (r.answer == Z3_L_UNDEF)
+        r.reason = Z3_solver_get_reason_unknown(r.c, r.s);
+
+      lock_guard lock(m);
+      if (r.answer != Z3_L_UNDEF && !winner)
+        winner = i;
+      --running;
+      cv.notify_all();
+    });
+  }
+
+  {
+    unique_lock lock(m);
+    while (running > 0) {
+      // keep interrupting the losers, as they may not have started yet
+      if (winner) {
+        for (unsigned i = 0, e = racers.size(); i != e; ++i) {
+          if (i != *winner)
+            Z3_interrupt(racers[i].c);
+        }
+      }
+      cv.wait_for(lock, chrono::milliseconds(10));
+    }
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  Result result;
+  if (winner) {
+    auto &r = racers[*winner];
+    last_winner = portfolio[*winner].name.c_str();
+    ++portfolio_wins[*winner];
+    if (config::debug)
+      dbg() << "\nPortfolio: " << last_winner << " won\n";
+    if (current_profile) {
+      current_profile->source = last_winner;
+      add_z3_stats(*current_profile, r.c, r.s);
+    }
+
+    if (r.answer == Z3_L_FALSE) {
+      ++num_unsats;
+      result = Result::UNSAT;
+    } else {
+      ++num_sats;
+      auto model = Z3_solver_get_model(r.c, r.s);
+      Z3_model_inc_ref(r.c, model);
+      result = Z3_model_translate(r.c, model, ctx());
+      Z3_model_dec_ref(r.c, model);
+    }
+  } else {
+    // report a timeout if any configuration timed out, the first error
+    // otherwise
+    last_winner = nullptr;
+    if (current_profile)
+      current_profile->source = "portfolio";
+    auto timeout = find_if(racers.begin(), racers.end(), [](auto &r) {
+      return unknown_answer(r.reason) == Result::TIMEOUT;
+    });
+    if (timeout != racers.end()) {
+      ++num_timeout;
+      result = Result::TIMEOUT;
+    } else {
+      ++num_errors;
+      result = { Result::ERROR, std::move(racers[0].reason) };
+    }
+  }
+
+  for (auto &r : racers) {
+    Z3_solver_dec_ref(r.c, r.s);
+    Z3_del_context(r.c);
+  }
+  return result;
+}
+
+
+void solver_set_time_budget(unsigned budget_ms) {
+  if (budget_ms == 0)
+    budget_deadline.reset();
+  else
+    budget_deadline = chrono::steady_clock::now() +
+                      chrono::milliseconds(budget_ms);
+}
+
+
+static unsigned parallel_queries = 1;
+
+void solver_set_parallel_queries(unsigned num_threads) {
+  parallel_queries = max(num_threads, 1u);
+}
+
+unsigned solver_parallel_queries() {
+  return parallel_queries;
+}
+
+static set<string, less<>> incremental_queries;
+
+void solver_set_incremental(const vector<string> &query_names) {
+  incremental_queries = { query_names.begin(), query_names.end() };
+}
+
+bool solver_incremental(const char *query_name) {
+  return incremental_queries.count("all") ||
+         (query_name && incremental_queries.count(string_view(query_name)));
+}
+
+struct QueryBatch::Impl {
+  struct Query {
+    const char *name = nullptr;
+    Z3_context c = nullptr;
+    Z3_solver s = nullptr;
+    bool done = false;
+    Result::answer answer = Result::ERROR;
+    string reason;
+    double ms = 0;
+    // set if the answer is to be cached, along with the query that owns the
+    // symbols the model is serialized with
+    optional<QuerySerializer> serialized;
+    expr e;
+    bool replace_model = false;
+    // a SAT answer of the cache, owning a reference
+    Z3_model model = nullptr;
+    // set while profiling
+    optional<QueryProfile> profile;
+  };
+
+  mutex m;
+  condition_variable cv;
+  vector<unique_ptr<Query>> queries;
+  vector<thread> workers;
+  unsigned next = 0;
+  unsigned running = 0;
+  bool stop = false;
+
+  void work() {
+    unique_lock lock(m);
+    while (true) {
+      cv.wait(lock, [&]() { return stop || next < queries.size(); });
+      if (stop)
+        break;
+
+      auto &q = *queries[next++];
+      if (q.done)
+        continue;
+      ++running;
+      lock.unlock();
+
+      auto start = chrono::steady_clock::now();
+      auto answer = Z3_solver_check(q.c, q.s);
+      string_view reason;
+      if (answer == Z3_L_UNDEF)
+        reason = Z3_solver_get_reason_unknown(q.c, q.s);
+
+      lock.lock();
+      --running;
+      q.done = true;
+      q.ms = chrono::duration<double, milli>(chrono::steady_clock::now() -
+                                             start).count();
+      q.answer = answer == Z3_L_FALSE ? Result::UNSAT
+               : answer == Z3_L_TRUE  ? Result::SAT
+                                      : unknown_answer(reason);
+      q.reason = reason;
+      cv.notify_all();
+    }
+  }
+};
+
+QueryBatch::QueryBatch() : impl(make_unique<Impl>()) {}
+
+QueryBatch::~QueryBatch() {
+  {
+    unique_lock lock(impl->m);
+    impl->stop = true;
+    impl->cv.notify_all();
+    // keep interrupting, as a query may be about to start
+    while (impl->running > 0) {
+      for (auto &q : impl->queries) {
+        if (!q->done && q->c)
+          Z3_interrupt(q->c);
+      }
+      impl->cv.wait_for(lock, chrono::milliseconds(10));
+    }
+  }
+  for (auto &t : impl->workers) {
+    t.join();
+  }
+  for (auto &q : impl->queries) {
+    if (q->model)
+      Z3_model_dec_ref(ctx(), q->model);
+    if (q->c) {
+      Z3_solver_dec_ref(q->c, q->s);
+      Z3_del_context(q->c);
+    }
+  }
+}
+
+unsigned QueryBatch::add(const expr &e, const char *query_name) {
+  auto q = make_unique<Impl::Query>();
+  q->name = query_name;
+
+  // same shortcuts as Solver
+  if (e.isFalse()) {
+    ++num_trivial;
+    q->done = true;
+    q->answer = Result::UNSAT;
+  } else if (!e.isValid()) {
+    ++num_invalid;
+    q->done = true;
+    q->answer = Result::INVALID;
+  } else if (config::skip_smt) {
+    ++num_skips;
+    q->done = true;
+    q->answer = Result::SKIP;
+  } else {
+    ++num_queries;
+    if (query_observer)
+      query_observer(query_name, nullptr, 0);
+    if (profile_queries) {
+      q->profile.emplace();
+      q->profile->name = query_name ? query_name : "";
+      measure_query({ e() }, *q->profile);
+    }
+
+    // as in Solver::check_cached, a SAT answer is only good with a model
+    if (query_cache) {
+      QuerySerializer query;
+      serialize_query({ e() }, query);
+      auto entry = query_cache->find(query.key);
+      if (entry && entry->answer == Result::SAT)
+        q->model = query_cache->readModel(query.key, *entry, query);
+      if (entry && (entry->answer == Result::UNSAT || q->model)) {
+        cache_hit(query, entry->answer);
+        q->done = true;
+        q->answer = entry->answer;
+        if (query_observer) {
+          Result r = q->model ? Result(q->model) : Result(q->answer);
+          query_observer(query_name, &r, 0);
+        }
+      } else {
+        ++num_cache_misses;
+        q->serialized.emplace(std::move(query));
+        q->e = e;
+        q->replace_model = entry && entry->length != 0;
+      }
+    }
+
+    if (!q->done) {
+      // only this thread uses ctx(), so the copy is made here
+      q->c = mk_context();
+      q->s = mk_context_solver(q->c, { "default", false, 0 });
+      // the queries of a batch run at once, so each may take all the time
+      // left of the budget, without retries
+      if (auto left = budget_left())
+        set_solver_timeout(q->c, q->s, max(*left, 1u));
+      Z3_solver_assert(q->c, q->s, Z3_translate(ctx(), e(), q->c));
+    }
+  }
+
+  lock_guard lock(impl->m);
+  impl->queries.emplace_back(std::move(q));
+  if (impl->workers.size() < parallel_queries &&
+      impl->workers.size() < impl->queries.size())
+    impl->workers.emplace_back([this]() { impl->work(); });
+  impl->cv.notify_all();
+  return impl->queries.size() - 1;
+}
+
+Result QueryBatch::wait(unsigned idx) {
+  Impl::Query *q;
+  {
+    unique_lock lock(impl->m);
+    q = impl->queries[idx].get();
+    impl->cv.wait(lock, [&]() { return q->done; });
+  }
+
+  // the queries without a context were answered when added, e.g., by the
+  // query cache
+  Result r(q->answer);
+  if (q->model) {
+    r = Result(q->model);
+    Z3_model_dec_ref(ctx(), q->model);
+    q->model = nullptr;
+  }
+  if (q->c) {
+    switch (q->answer) {
+    case Result::UNSAT:   ++num_unsats; break;
+    case Result::SAT: {
+      // the worker is done with the context, so the model is translated to
+      // this thread's one, as in check_portfolio
+      ++num_sats;
+      auto model = Z3_solver_get_model(q->c, q->s);
+      Z3_model_inc_ref(q->c, model);
+      r = Result(Z3_model_translate(q->c, model, ctx()));
+      Z3_model_dec_ref(q->c, model);
+      break;
+    }
+    case Result::TIMEOUT: ++num_timeout; break;
+    default:
+      ++num_errors;
+      r.reason = std::move(q->reason);
+      break;
+    }
+    if (q->serialized && query_cache) {
+      if (r.isUnsat())
+        query_cache->insert(q->serialized->key, Result::UNSAT, {});
+      else if (r.isSat())
+        query_cache->insert(q->serialized->key, Result::SAT,
+                            serialize_model(r.m.m, *q->serialized),
+                            q->replace_model);
+    }
+    q->serialized.reset();
+    q->e = expr();
+    if (query_observer)
+      query_observer(q->name, &r, q->ms);
+  }
+
+  if (q->profile) {
+    q->profile->source = q->c ? "z3" : "cache";
+    if (q->c)
+      add_z3_stats(*q->profile, q->c, q->s);
+    q->profile->result = result_name(r);
+    q->profile->ms = q->ms;
+    query_profiles.emplace_back(std::move(*q->profile));
+    q->profile.reset();
+  }
+  return r;
+}
+
 Result check_expr(const expr &e, const char *query_name) {
   Solver s;
   s.add(e);
@@ -550,6 +2154,12 @@ SolverPush::~SolverPush() {
 }
 
 
+SolverStats solver_stats() {
+  return { num_queries, num_skips, num_invalid, num_trivial,
+           num_sats, num_unsats, num_timeout, num_errors,
+           num_cache_hits, num_cache_misses, num_escalations };
+}
+
 void solver_print_stats(ostream &os) {
   float total = num_queries / 100.0;
   float trivial_pc = num_queries == 0 ? 0 :
@@ -569,6 +2179,46 @@ void solver_print_stats(ostream &os) {
         "Num errors:  " << num_errors << " (" << error_pc << "%)\n"
         "Num SAT:     " << num_sats << " (" << sat_pc << "%)\n"
         "Num UNSAT:   " << num_unsats << " (" << unsat_pc << "%)\n";
+
+  if (!portfolio.empty()) {
+    os << "Portfolio wins:";
+    for (unsigned i = 0, e = portfolio.size(); i != e; ++i) {
+      os << ' ' << portfolio[i].name << '=' << portfolio_wins[i];
+    }
+    os << '\n';
+  }
+
+  if (num_escalations > 0)
+    os << "Timeout escalations: " << num_escalations << '\n';
+
+  if (query_cache) {
+    os << "Query cache: " << num_cache_hits << " hits, " << num_cache_misses
+       << " misses, " << cache_bytes_saved << " bytes saved\n";
+  }
+}
+
+void solver_set_query_cache(const string &dir, uint64_t max_size) {
+  if (dir.empty())
+    query_cache.reset();
+  else
+    query_cache = make_unique<QueryCache>(dir, max_size);
+}
+
+void solver_set_portfolio(unsigned num_configs) {
+  portfolio.clear();
+  if (num_configs > 1) {
+    portfolio.push_back({ "default", false, 0 });
+    portfolio.push_back({ "qfbv-sat", true, 0 });
+    for (unsigned i = 2; i < num_configs; ++i) {
+      portfolio.push_back({ "seed+" + to_string(i - 1), false, i - 1 });
+    }
+  }
+  portfolio_wins.assign(portfolio.size(), 0);
+  last_winner = nullptr;
+}
+
+const char* solver_last_winner() {
+  return last_winner;
 }
 
 
@@ -5,9 +5,12 @@
 
 #include "smt/expr.h"
 #include <cassert>
+#include <functional>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <utility>
+#include <vector>
 
 typedef struct _Z3_func_interp* Z3_func_interp;
 typedef struct _Z3_model* Z3_model;
@@ -25,6 +28,8 @@ class Model {
   ~Model();
 
   friend class Result;
+  friend class Solver;
+  friend class QueryBatch;
 
 public:
   Model(Model &&other) noexcept : m(0) {
@@ -143,6 +148,7 @@ private:
   Result(Z3_model m) : m(m), a(SAT) {}
 
   friend class Solver;
+  friend class QueryBatch;
 };
 
 
@@ -151,12 +157,20 @@ class Solver {
   bool valid = true;
   bool is_unsat = false;
 
+  Result check_cached() const;
+  Result check_budgeted() const;
+  // a timeout of 0 keeps the default one, see set_query_timeout
+  Result check_z3(unsigned timeout) const;
+  Result check_portfolio(unsigned timeout) const;
+
 public:
   Solver(bool simple = false);
   ~Solver();
 
   void add(const expr &e);
-  // use a negated solver for minimization
+  // use a negated (simple) solver for minimization, i.e., to block a small
+  // subset of the assignments that still implies the constraints, guided by
+  // its unsat cores and bounded in the number of checks
   void block(const Model &m, Solver *sneg = nullptr);
   void reset();
 
@@ -170,6 +184,24 @@ public:
 Result check_expr(const expr &e, const char *query_name = nullptr);
 
 
+// Solves independent queries concurrently in the background, each in its own
+// Z3 context, on up to solver_parallel_queries() threads. The queries still
+// pending are cancelled on destruction.
+class QueryBatch {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  QueryBatch();
+  ~QueryBatch();
+
+  // Returns the index of the query
+  unsigned add(const expr &e, const char *query_name = nullptr);
+  // Blocks until the given query is solved. A SAT result carries its model.
+  Result wait(unsigned idx);
+};
+
+
 class SolverPush {
   Solver &s;
   bool valid, is_unsat;
@@ -180,9 +212,83 @@ public:
 
 
 void solver_print_queries(bool yes);
+
+// Called before each solver query (with a null result) and after it (with
+// its result and the time spent in the solver, in ms); query_name may be null
+using QueryObserver =
+  std::function<void(const char *query_name, const Result *r, double ms)>;
+void solver_set_query_observer(QueryObserver observer);
+
+// A solver query, as recorded by the profiler
+struct QueryProfile {
+  std::string name;   // empty if the query has no name
+  std::string result; // sat, unsat, timeout, ...
+  std::string source; // what answered it: z3, a portfolio config, or cache
+  double ms = 0;      // wall time, including the query cache lookup
+  unsigned num_nodes = 0; // of the asserted formula, as a DAG
+  unsigned max_bits = 0;  // the widest bit-vector term
+  // Z3's statistics of the solver that answered it, which add up across the
+  // checks of a solver (e.g., under push/pop)
+  std::vector<std::pair<std::string, double>> z3_stats;
+};
+
+// Record a QueryProfile for every query sent to the solver (i.e., not the
+// trivial, invalid or skipped ones); off by default as it walks the formulas
+void solver_set_profile(bool enable);
+// The queries recorded since the last call, in the order they completed
+std::vector<QueryProfile> solver_take_profile();
 void solver_tactic_verbose(bool yes);
 void solver_print_stats(std::ostream &os);
 
+// The counters printed by solver_print_stats, for the current process. The
+// queries answered by the query cache count as queries (and SAT/UNSAT) too.
+struct SolverStats {
+  unsigned num_queries, num_skips, num_invalid, num_trivial;
+  unsigned num_sats, num_unsats, num_timeout, num_errors;
+  unsigned num_cache_hits, num_cache_misses;
+  // the timeouts retried with a longer one, see solver_set_time_budget; they
+  // are not counted as timeouts
+  unsigned num_escalations;
+};
+SolverStats solver_stats();
+
+// Race num_configs solver configurations (the default one, a bit-blasting
+// one, and the default one with other random seeds) on each query, each on its
+// own thread and Z3 context; the first definitive answer wins. 0 or 1 disables
+// the portfolio.
+void solver_set_portfolio(unsigned num_configs);
+// The configuration that decided the last query, or null if the portfolio is
+// disabled or no configuration did
+const char* solver_last_winner();
+
+// Keep the definitive answers of the queries (UNSAT, and SAT along with the
+// model) in the given directory, which may be shared by several processes, so
+// that a query solved before, by any of them, is answered without the solver.
+// Queries are identified up to the names of their variables and the order of
+// their conjuncts. The cache is emptied once it exceeds max_size bytes. An
+// empty directory disables the cache (the default).
+void solver_set_query_cache(const std::string &dir, uint64_t max_size);
+
+// Limits the total time of the queries from now on to budget_ms (0 removes the
+// limit, the default). Each query is first given a slice of the time left, no
+// longer than the query timeout (see set_query_timeout), and is retried with
+// a longer timeout, as long as the time left allows, if it times out. Past the
+// budget, the queries time out right away
+void solver_set_time_budget(unsigned budget_ms);
+
+// The maximum number of queries solved at once by a QueryBatch; refinement
+// checks only use QueryBatch if it is greater than 1
+void solver_set_parallel_queries(unsigned num_threads);
+unsigned solver_parallel_queries();
+
+// The queries (by name, or "all") checked incrementally: the refinement checks
+// of a function then assert their common axioms once into a long-lived solver,
+// and check each of these queries under push/pop on top of it, so that Z3
+// keeps what it learned in between. None by default, i.e., every query is
+// solved by a fresh solver
+void solver_set_incremental(const std::vector<std::string> &query_names);
+bool solver_incremental(const char *query_name);
+
 
 struct EnableSMTQueriesTMP {
   bool old;
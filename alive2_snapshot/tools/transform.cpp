@@ -168,6 +168,9 @@ static bool error(Errors &errs, State &src_state, State &tgt_state,
   optional<Result> newr;
 
   auto try_reduce = [&](const expr &e) {
+    if (config::skip_cex_minimization)
+      return false;
+
     bool ok = false;
     {
       SolverPush push(solver);
@@ -513,7 +516,28 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
     axioms_expr = std::move(axioms)();
   }
 
-  if (check_expr(axioms_expr && fndom_a, "ub_src").isUnsat()) {
+  // All the queries below share the axioms. The incremental ones (see
+  // solver_set_incremental) are checked in a scope of their own on top of a
+  // solver holding the axioms, which is created on first use
+  optional<Solver> shared;
+  auto get_shared = [&]() -> Solver& {
+    if (!shared) {
+      shared.emplace(true);
+      shared->add(axioms_expr);
+    }
+    return *shared;
+  };
+
+  auto check_axioms = [&](const expr &e, const char *name) {
+    if (!solver_incremental(name))
+      return check_expr(axioms_expr && e, name);
+    auto &s = get_shared();
+    SolverPush push(s);
+    s.add(e);
+    return s.check(name);
+  };
+
+  if (check_axioms(fndom_a, "ub_src").isUnsat()) {
     if (config::fail_if_src_is_ub) {
       errs.add("Source function is always UB", false);
       return;
@@ -528,7 +552,7 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
   {
     auto sink_src = src_state.sinkDomain(false);
     if (!sink_src.isFalse() &&
-        check_expr(axioms_expr && !sink_src, "return_src").isUnsat()) {
+        check_axioms(!sink_src, "return_src").isUnsat()) {
       errs.add("The source program doesn't reach a return instruction.\n"
                "Consider increasing the unroll factor if it has loops", false);
       return;
@@ -537,7 +561,7 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
     if (auto sink_tgt = tgt_state.sinkDomain(false);
         !sink_src.eq(sink_tgt) &&
         !sink_tgt.isFalse() &&
-        check_expr(axioms_expr && (!sink_tgt || sink_src), "return_tgt").isUnsat()) {
+        check_axioms(!sink_tgt || sink_src, "return_tgt").isUnsat()) {
       errs.add("The target program doesn't reach a return instruction.\n"
                "Consider increasing the unroll factor if it has loops", false);
       return;
@@ -562,7 +586,7 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
       pre_tgt = pre_tgt_and();
     }
 
-    if (check_expr(axioms_expr && (pre_src && pre_tgt), "pre").isUnsat()) {
+    if (check_axioms(pre_src && pre_tgt, "pre").isUnsat()) {
       errs.add("Precondition is always false", false);
       return;
     }
@@ -579,6 +603,7 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
   }
   pre_src_forall &= tgt_state.getFnPre();
 
+  // the axioms are added by the solver, see check_axioms
   auto mk_fml = [&](expr &&refines) -> expr {
     // from the check above we already know that
     // \exists v,v' . pre_tgt(v') && pre_src(v) is SAT (or timeout)
@@ -589,14 +614,22 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
     if (refines.isFalse())
       return std::move(refines);
 
-    return axioms_expr &&
-            preprocess(t, qvars, uvars, pre && pre_src_forall.implies(refines));
+    return preprocess(t, qvars, uvars, pre && pre_src_forall.implies(refines));
   };
 
-  auto check = [&](expr &&e, const char *name, auto &&printer, const char *msg) {
-    Solver s;
-    s.add(mk_fml(std::move(e)));
-    e = expr();
+  auto solve = [&](expr &&fml, const char *name, auto &&printer,
+                   const char *msg) {
+    optional<Solver> fresh;
+    optional<SolverPush> scope;
+    if (solver_incremental(name)) {
+      scope.emplace(get_shared());
+    } else {
+      fresh.emplace();
+      fresh->add(axioms_expr);
+    }
+    Solver &s = fresh ? *fresh : *shared;
+    s.add(fml);
+    fml = expr();
     auto res = s.check(name);
 
     // Some non-deterministic vars have preconditions. These preconditions are
@@ -616,6 +649,25 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
     return true;
   };
 
+  // With parallel queries, the checks below are only collected, and then
+  // solved all at once at the end (see QueryBatch)
+  struct Query {
+    expr fml;
+    const char *name;
+    print_var_val_ty printer;
+    const char *msg;
+  };
+  vector<Query> queries;
+  bool parallel = solver_parallel_queries() > 1;
+
+  auto check = [&](expr &&e, const char *name, auto &&printer, const char *msg) {
+    if (parallel) {
+      queries.push_back({ mk_fml(std::move(e)), name, printer, msg });
+      return true;
+    }
+    return solve(mk_fml(std::move(e)), name, printer, msg);
+  };
+
 #define CHECK(fml, name, printer, msg) \
   if (!check(fml, name, printer, msg)) \
     return
@@ -738,6 +790,33 @@ check_refinement(Errors &errs, const Transform &t, State &src_state,
         "memory", print_ptr_load, "Mismatch in memory");
 
 #undef CHECK
+
+  if (parallel) {
+    // The preconditions of the non-deterministic vars are added upfront, as
+    // solve does for the model: they don't change whether the query is SAT
+    QueryBatch batch;
+    for (auto &q : queries) {
+      q.fml = axioms_expr && q.fml && pre_src_forall;
+      batch.add(q.fml, q.name);
+    }
+
+    // Consume the answers in the sequential order; the queries after a
+    // failing one are cancelled
+    for (unsigned i = 0, e = queries.size(); i != e; ++i) {
+      auto &q = queries[i];
+      auto res = batch.wait(i);
+      if (res.isUnsat())
+        continue;
+
+      // the counterexample is minimized with further checks of the query
+      Solver s;
+      if (res.isSat())
+        s.add(q.fml);
+      if (!error(errs, src_state, tgt_state, res, s, var, q.msg,
+                 check_each_var, q.printer))
+        return;
+    }
+  }
 }
 
 static bool has_nullptr(const Value *v) {
@@ -1433,6 +1512,8 @@ Errors TransformVerify::verify() const {
   Errors errs;
   try {
     auto [src_state, tgt_state] = exec();
+    if (on_phase)
+      on_phase("executed");
 
     if (check_each_var) {
       for (auto &var : src_state->getFn().instrs()) {
@@ -7,6 +7,7 @@
 #include "ir/state.h"
 #include "smt/solver.h"
 #include "util/errors.h"
+#include <functional>
 #include <memory>
 #include <ostream>
 #include <string>
@@ -56,6 +57,9 @@ class TransformVerify {
   bool check_each_var;
 
 public:
+  // Called with "executed" once both functions are symbolically executed
+  std::function<void(const char*)> on_phase;
+
   TransformVerify(Transform &t, bool check_each_var);
   std::pair<std::unique_ptr<IR::State>,std::unique_ptr<IR::State>> exec() const;
   util::Errors verify() const;
@@ -12,6 +12,7 @@ namespace util::config {
 
 bool symexec_print_each_value = false;
 bool skip_smt = false;
+bool skip_cex_minimization = false;
 string smt_benchmark_dir;
 bool disable_poison_input = false;
 bool disable_undef_input = false;
@@ -12,6 +12,9 @@ extern bool symexec_print_each_value;
 
 extern bool skip_smt;
 
+// Report counterexamples as found, without trying to make their values smaller
+extern bool skip_cex_minimization;
+
 // don't dump if empty
 extern std::string smt_benchmark_dir;
 
@@ -186,8 +186,7 @@ void parallel::finishChild(bool is_timeout) {
    */
   putToken();
   if (is_timeout) {
-    const char *msg = "ERROR: Timeout asynchronous\n\n";
-    safe_write(fd_to_parent, msg, std::strlen(msg));
+    safe_write(fd_to_parent, timeout_msg, std::strlen(timeout_msg));
   } else {
     childProcess &me = children.back();
     auto data = std::move(me.output).str();
@@ -33,6 +33,7 @@ class parallel {
   std::vector<childProcess> children;
   std::stringstream &parent_ss;
   std::ostream &out_file;
+  const char *timeout_msg = "ERROR: Timeout asynchronous\n\n";
   void ensureParent();
   void ensureChild();
   void reapZombies();
@@ -66,6 +67,13 @@ public:
    */
   virtual std::tuple<pid_t, std::ostream *, int> limitedFork() = 0;
 
+  /*
+   * called from a child before finishChild(true) to replace the message
+   * sent to the parent in place of the child's output; the message must
+   * outlive the child since it is written from signal handling context
+   */
+  void setTimeoutMessage(const char *msg) { timeout_msg = msg; }
+
   /*
    * called from a child that has finished executing
    */
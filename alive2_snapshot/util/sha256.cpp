@@ -0,0 +1,106 @@
+// Copyright (c) 2018-present The Alive2 Authors.
+// Distributed under the MIT license that can be found in the LICENSE file.
+
+#include "util/sha256.h"
+#include <cstring>
+
+using namespace std;
+
+static constexpr uint32_t round_constants[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+  0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+  0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+  0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+  0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+  0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+  0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+  0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+  0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static uint32_t rotr(uint32_t x, unsigned n) {
+  return (x >> n) | (x << (32 - n));
+}
+
+namespace util {
+
+SHA256::SHA256()
+  : state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+           0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } {}
+
+void SHA256::compress(const unsigned char *data) {
+  uint32_t w[64];
+  for (unsigned i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 |
+           (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+  }
+  for (unsigned i = 16; i < 64; ++i) {
+    auto s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+    auto s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+    w[i] = w[i-16] + s0 + w[i-7] + s1;
+  }
+
+  auto [a, b, c, d, e, f, g, h] = state;
+  for (unsigned i = 0; i < 64; ++i) {
+    auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) +
+              ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+    auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) +
+              ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  uint32_t updated[8] = { a, b, c, d, e, f, g, h };
+  for (unsigned i = 0; i < 8; ++i) {
+    state[i] += updated[i];
+  }
+}
+
+void SHA256::update(string_view data) {
+  length += data.size();
+  auto *p = (const unsigned char*)data.data();
+  size_t n = data.size();
+  if (block_size != 0) {
+    size_t fill = min<size_t>(n, sizeof(block) - block_size);
+    memcpy(block + block_size, p, fill);
+    block_size += fill;
+    p += fill;
+    n -= fill;
+    if (block_size < sizeof(block))
+      return;
+    compress(block);
+    block_size = 0;
+  }
+  for (; n >= sizeof(block); p += sizeof(block), n -= sizeof(block)) {
+    compress(p);
+  }
+  memcpy(block, p, n);
+  block_size = n;
+}
+
+array<unsigned char, 32> SHA256::final() {
+  uint64_t bits = length * 8;
+  unsigned char padding[72] = { 0x80 };
+  size_t pad = (block_size < 56 ? 56 : 120) - block_size;
+  for (unsigned i = 0; i < 8; ++i) {
+    padding[pad + i] = (unsigned char)(bits >> (56 - 8 * i));
+  }
+  update({ (const char*)padding, pad + 8 });
+
+  array<unsigned char, 32> digest;
+  for (unsigned i = 0; i < 8; ++i) {
+    for (unsigned j = 0; j < 4; ++j) {
+      digest[4 * i + j] = (unsigned char)(state[i] >> (24 - 8 * j));
+    }
+  }
+  return digest;
+}
+
+}
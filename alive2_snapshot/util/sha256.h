@@ -0,0 +1,28 @@
+#pragma once
+
+// Copyright (c) 2018-present The Alive2 Authors.
+// Distributed under the MIT license that can be found in the LICENSE file.
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace util {
+
+// SHA-256 (FIPS 180-4) of the data given to update, in as many pieces as
+// convenient, e.g., to key a cache by contents it doesn't keep.
+class SHA256 {
+  uint32_t state[8];
+  uint64_t length = 0;
+  unsigned char block[64];
+  unsigned block_size = 0;
+
+  void compress(const unsigned char *data);
+
+public:
+  SHA256();
+  void update(std::string_view data);
+  std::array<unsigned char, 32> final();
+};
+
+}
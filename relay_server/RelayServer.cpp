@@ -1,16 +1,29 @@
+#include <array>
 #include <atomic>
 #include <cpprest/http_listener.h>
 #include <cpprest/json.h>
 #include <csignal>
+#include <cpprest/producerconsumerstream.h>
+#include <fcntl.h>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <random>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 #include <arpa/inet.h>
 
 #include "../src/Printer.h"
+#include "../src/Protocol.h"
 
 using namespace web;
 using namespace web::http;
@@ -27,144 +40,547 @@ const auto LOG_STORAGE_PREFIX = []() {
 }();
 constexpr auto LOG_FILE_DEFAULT_NAME = "relay_server.log";
 
+/// the errors replied with `503 Service Unavailable`, i.e., the client should
+/// retry later.
+struct ServiceUnavailable : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/// thrown when the validator server rejects a request because all of its
+/// workers are busy and its queue is full.
+struct ValidatorOverloaded : public ServiceUnavailable {
+    ValidatorOverloaded() : ServiceUnavailable("validator server is overloaded, please retry later") {}
+};
+
+/// thrown when the validator server cannot be reached at all.
+struct ValidatorUnavailable : public ServiceUnavailable {
+    ValidatorUnavailable() : ServiceUnavailable("validator server is unavailable, please retry later") {}
+};
+
+/// a persistent connection to the validator server shared by all the request
+/// handlers, i.e., every request is framed (see `protocol`) with a unique id,
+/// and a reader thread hands each response to the handler waiting for it, so
+/// many requests could be in flight at once and complete in any order.
+/// the connection is (re-)established lazily, the requests fail with
+/// "unavailable" if it cannot be, and the in-flight ones with "error" if it
+/// breaks.
+/// the responses complete `pplx` tasks, so the request handlers never block
+/// waiting for them, and connecting or sending a frame is bounded by a timeout
+/// in case the validator server stops responding.
+class ValidatorLink {
+public:
+    static constexpr int CONNECT_TIMEOUT_MS = 1000;
+    static constexpr int SEND_TIMEOUT_S = 5;
+
+    ValidatorLink(std::string host, int port, const Printer &printer)
+        : host_(std::move(host)), port_(port), printer_(printer) {}
+
+    ValidatorLink(const ValidatorLink &) = delete;
+    ValidatorLink &operator=(const ValidatorLink &) = delete;
+
+    /// called from the reader thread with every progress event (a single-line
+    /// json) of an in-flight request.
+    using EventHandler = std::function<void(const std::string &event)>;
+
+    /// send `command`, i.e., the command name followed by its fields (see
+    /// `protocol::write_fields`), which are only referred to until `submit`
+    /// returns, and return its id along with its eventual response, the
+    /// progress events before the response are handed to `on_event`.
+    auto submit(const std::vector<std::string_view> &command, EventHandler on_event = nullptr)
+        -> std::pair<uint64_t, pplx::task<std::string>> {
+        pplx::task<std::string> response {};
+        // the write lock keeps the frames from interleaving
+        std::lock_guard<std::mutex> write_lock { write_mutex_ };
+        int sock { -1 };
+        uint64_t request_id { 0 };
+        {
+            std::lock_guard<std::mutex> lock { mutex_ };
+            if (sock_ < 0 && !connect_to_validator()) {
+                return { 0, pplx::task_from_result(std::string("unavailable")) };
+            }
+            sock = sock_;
+            request_id = next_request_id_++;
+            auto &pending = pending_[request_id];
+            pending.on_event = std::move(on_event);
+            response = pplx::create_task(pending.response);
+        }
+
+        if (!protocol::write_fields(sock, request_id, command)) {
+            printer_.print_error("failed to send command", true);
+            // the reader thread fails the in-flight requests
+            shutdown(sock, SHUT_RDWR);
+        }
+        return { request_id, std::move(response) };
+    }
+
+    /// ask the validator server to cancel an in-flight request, its response
+    /// becomes "cancelled" unless it has completed already.
+    /// returns false if there is no such request.
+    auto cancel(uint64_t request_id) -> bool {
+        std::lock_guard<std::mutex> write_lock { write_mutex_ };
+        int sock { -1 };
+        {
+            std::lock_guard<std::mutex> lock { mutex_ };
+            if (sock_ < 0 || pending_.find(request_id) == pending_.end()) {
+                return false;
+            }
+            sock = sock_;
+        }
+        return protocol::write_frame(sock, request_id, {}, protocol::FrameKind::Cancel);
+    }
+
+private:
+    /// create a TCP connection with the validator server and start reading
+    /// the responses from it, must be called with `mutex_` held.
+    auto connect_to_validator() -> bool {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) {
+            printer_.print_error("failed to create socket", true);
+            return false;
+        }
+
+        struct sockaddr_in serv_addr = {
+            .sin_family = AF_INET,
+            .sin_port = htons(port_),
+            .sin_addr = {}
+        };
+
+        if (inet_pton(AF_INET, host_.c_str(), &serv_addr.sin_addr) <= 0) {
+            close(sock);
+            printer_.print_error("invalid address", true);
+            return false;
+        }
+
+        if (!connect_with_timeout(sock, serv_addr)) {
+            close(sock);
+            printer_.print_error("connection failed", true);
+            return false;
+        }
+        // a send blocked for longer fails, which fails the in-flight requests
+        struct timeval send_timeout { .tv_sec = SEND_TIMEOUT_S, .tv_usec = 0 };
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+        printer_.log("connected to validator server");
+
+        sock_ = sock;
+        std::thread(&ValidatorLink::read_responses, this, sock).detach();
+        return true;
+    }
+
+    /// connect without blocking for longer than `CONNECT_TIMEOUT_MS`, the
+    /// socket is left blocking for the reader thread.
+    static auto connect_with_timeout(int sock, const struct sockaddr_in &address) -> bool {
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+            return false;
+        }
+        if (connect(sock, (const struct sockaddr *) &address, sizeof(address)) < 0) {
+            if (errno != EINPROGRESS) {
+                return false;
+            }
+            struct pollfd pfd { .fd = sock, .events = POLLOUT, .revents = 0 };
+            int error { 0 };
+            socklen_t length { sizeof(error) };
+            if (poll(&pfd, 1, CONNECT_TIMEOUT_MS) != 1 ||
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0) {
+                return false;
+            }
+        }
+        return fcntl(sock, F_SETFL, flags) == 0;
+    }
+
+    void read_responses(int sock) {
+        protocol::Frame frame {};
+        while (protocol::read_frame(sock, frame)) {
+            std::lock_guard<std::mutex> lock { mutex_ };
+            auto it = pending_.find(frame.request_id);
+            if (it == pending_.end()) {
+                continue;
+            } else if (frame.kind == protocol::FrameKind::Event) {
+                if (it->second.on_event) {
+                    it->second.on_event(frame.payload);
+                }
+            } else {
+                it->second.response.set(std::move(frame.payload));
+                pending_.erase(it);
+            }
+        }
+
+        printer_.print_error("lost connection to validator server", true);
+        std::lock_guard<std::mutex> write_lock { write_mutex_ };
+        std::lock_guard<std::mutex> lock { mutex_ };
+        for (auto &[request_id, pending] : pending_) {
+            pending.response.set("error");
+        }
+        pending_.clear();
+        sock_ = -1;
+        close(sock);
+    }
+
+    struct Pending {
+        pplx::task_completion_event<std::string> response;
+        EventHandler on_event;
+    };
+
+    const std::string host_;
+    const int port_;
+    const Printer &printer_;
+    /// lock order: `write_mutex_` before `mutex_`.
+    std::mutex write_mutex_;
+    std::mutex mutex_;
+    int sock_ { -1 };
+    uint64_t next_request_id_ { 1 };
+    std::unordered_map<uint64_t, Pending> pending_;
+};
+
 /// the RelayServer is a relay server that,
 ///   0. runs/listens on port 3001.
 ///   1. receives a request from the client, i.e., the `validator-frontend`, from port 3001.
-///   2. sends the request (in plain text) to the actual validator server that runs the alive2 verifier
-///      through port 3002 via a simple TCP connection.
+///   2. sends the request to the actual validator server that runs the alive2 verifier
+///      through port 3002 via a persistent, multiplexed TCP connection (see `ValidatorLink`).
 ///   3. relays the response from the validator server back to the frontend,
 ///      which will then render/update the result.
+/// the handlers never block the listener threads, i.e., every request is a
+/// chain of `pplx` continuations which replies once the validator server
+/// responds, and at most `max_concurrent_requests` requests are relayed at once,
+/// the ones beyond are rejected right away with `429 Too Many Requests`.
 class RelayServer {
 public:
-    RelayServer(const std::string &url) : listener(url) {
+    RelayServer(const std::string &url, size_t max_concurrent_requests)
+        : listener(url), max_concurrent_requests_(max_concurrent_requests) {
         listener.support(
-            // only support POST requests
+            // the api requests
             methods::POST,
             // register the post handler
             std::bind(&RelayServer::handle_post, this, std::placeholders::_1)
         );
+        listener.support(
+            // only `/metrics`
+            methods::GET,
+            std::bind(&RelayServer::handle_get, this, std::placeholders::_1)
+        );
     }
 
+    /// holds one of the `max_concurrent_requests_` slots until destroyed, i.e.,
+    /// once the last continuation of the request is done with it.
+    struct Admission {
+        std::atomic<size_t> &in_flight;
+
+        explicit Admission(std::atomic<size_t> &in_flight) : in_flight(in_flight) {}
+        Admission(const Admission &) = delete;
+        Admission &operator=(const Admission &) = delete;
+        ~Admission() {
+            in_flight.fetch_sub(1, std::memory_order_relaxed);
+        }
+    };
+
+    /// the capability to cancel a `/api/validate-stream` request, i.e., 128
+    /// random bits mapped to the relay request id until the stream ends, so
+    /// the (sequential) request ids of the other clients cannot be cancelled.
+    struct CancelToken {
+        RelayServer &server;
+        std::string token;
+
+        CancelToken(RelayServer &server, uint64_t request_id) : server(server) {
+            static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+            std::random_device random {};
+            for (int i = 0; i < 4; ++i) {
+                uint32_t bits = random();
+                for (int j = 0; j < 8; ++j, bits >>= 4) {
+                    token.push_back(HEX_DIGITS[bits & 0xf]);
+                }
+            }
+            std::lock_guard lock { server.cancel_tokens_mutex_ };
+            server.cancel_tokens_[token] = request_id;
+        }
+        CancelToken(const CancelToken &) = delete;
+        CancelToken &operator=(const CancelToken &) = delete;
+        ~CancelToken() {
+            std::lock_guard lock { server.cancel_tokens_mutex_ };
+            server.cancel_tokens_.erase(token);
+        }
+    };
+
     void handle_post(http_request request) {
         auto path = uri::decode(request.relative_uri().path());
         printer_.log("received request: " + path);
+        count_request(path);
+
+        if (path == "/api/cancel") {
+            // not admitted, it is cheap and needed the most while saturated
+            handle_cancel(request);
+            return;
+        } else if (path != "/api/generate-ir" && path != "/api/validate" &&
+                   path != "/api/validate-stream" && path != "/api/check") {
+            // invalid request
+            request.reply(status_codes::NotFound);
+            return;
+        }
+
+        auto admission = admit();
+        if (admission == nullptr) {
+            rejected_requests_.fetch_add(1, std::memory_order_relaxed);
+            reply_with_error(request, "too many concurrent requests, please retry later",
+                             TOO_MANY_REQUESTS);
+            return;
+        }
 
         if (path == "/api/generate-ir") {
-            handle_generate_ir(request);
+            handle_generate_ir(request, std::move(admission));
         } else if (path == "/api/validate") {
-            handle_validate(request);
+            handle_validate(request, std::move(admission));
+        } else if (path == "/api/validate-stream") {
+            handle_validate_stream(request, std::move(admission));
         } else {
-            // invalid request
+            handle_check(request, std::move(admission));
+        }
+    }
+
+    /// `GET /metrics`, the metrics of the relay server followed by the ones
+    /// of the validator server (see `Metrics`), in the prometheus text format.
+    void handle_get(http_request request) {
+        auto path = uri::decode(request.relative_uri().path());
+        if (path != "/metrics") {
             request.reply(status_codes::NotFound);
+            return;
+        }
+
+        std::string metrics {
+            "# HELP relay_requests_total Requests received by the relay server.\n"
+            "# TYPE relay_requests_total counter\n"
+        };
+        for (size_t i = 0; i < API_PATHS.size(); ++i) {
+            metrics += "relay_requests_total{path=\"" + std::string(API_PATHS[i]) + "\"} " +
+                       std::to_string(request_counts_[i].load(std::memory_order_relaxed)) + "\n";
         }
+        metrics += "# HELP relay_rejected_requests_total Requests rejected by the concurrency limit.\n"
+                   "# TYPE relay_rejected_requests_total counter\n"
+                   "relay_rejected_requests_total " +
+                   std::to_string(rejected_requests_.load(std::memory_order_relaxed)) + "\n"
+                   "# HELP relay_in_flight_requests Requests being relayed.\n"
+                   "# TYPE relay_in_flight_requests gauge\n"
+                   "relay_in_flight_requests " +
+                   std::to_string(in_flight_.load(std::memory_order_relaxed)) + "\n";
+
+        validator_link_.submit({ "METRICS" }).second.then([request, metrics](std::string validator_metrics) {
+            bool validator_up = validator_metrics != "error" && validator_metrics != "unavailable";
+            auto all_metrics = metrics +
+                "# HELP relay_validator_up Whether the validator server answered the scrape.\n"
+                "# TYPE relay_validator_up gauge\n"
+                "relay_validator_up " + std::string(validator_up ? "1" : "0") + "\n";
+            if (validator_up) {
+                all_metrics += validator_metrics;
+            }
+            request.reply(status_codes::OK, all_metrics, "text/plain; version=0.0.4");
+        });
     }
 
-    void reply_with_error(http_request request, const std::string &error_message) {
-        json::value response {};
-        response["error"] = json::value::string(error_message);
-        request.reply(status_codes::InternalError, response);
+    static void reply_with_error(http_request request, const std::string &error_message,
+                                 status_code status = status_codes::InternalError) {
+        json::value body {};
+        body["error"] = json::value::string(error_message);
+        http_response response { status };
+        response.set_body(body);
+        if (status == TOO_MANY_REQUESTS || status == status_codes::ServiceUnavailable) {
+            response.headers().add(header_names::retry_after, "1");
+        }
+        request.reply(response);
     }
 
     /// `POST /api/generate-ir`
-    void handle_generate_ir(http_request request) {
+    void handle_generate_ir(http_request request, std::shared_ptr<Admission> admission) {
         printer_.log("received generate-ir request");
-        request.extract_json().then([this, &request](json::value body) {
-            try {
-                check_request_body(body, { "cppCode", "rustCode" });
-                auto cpp_code = body["cppCode"].as_string();
-                auto rust_code = body["rustCode"].as_string();
-
-                // format command and send to validator
-                std::string command {
-                    std::string("GENERATE") +
-                    "__CPPCODE__" + std::move(cpp_code) +
-                    "__RUSTCODE__" + std::move(rust_code)
-                };
-                std::string result = send_to_validator(std::move(command));
-                if (result == "error") {
-                    throw std::runtime_error("failed to send command for generating IR");
-                } else if (result.find("failed to generate") != std::string::npos ||
-                           result.find("compilation timed out (10s) or failed") != std::string::npos ||
-                           result.find("generated IR file exceeds the size limit") != std::string::npos ||
-                           result.find("generated IR file exceeds the length limit") != std::string::npos) {
-                    throw std::runtime_error(result);
-                }
+        auto response = request.extract_json().then([this](json::value body) {
+            check_request_body(body, { "cppCode", "rustCode" });
+
+            // the fields are sent right from the request body
+            return validator_link_.submit({
+                "GENERATE", body["cppCode"].as_string(), body["rustCode"].as_string()
+            }).second;
+        }).then([](std::string result) {
+            if (result == "error") {
+                throw std::runtime_error("failed to send command for generating IR");
+            } else if (result == "unavailable") {
+                throw ValidatorUnavailable {};
+            } else if (result == "overloaded") {
+                throw ValidatorOverloaded {};
+            } else if (is_generate_error(result)) {
+                throw std::runtime_error(result);
+            }
 
-                // parse result into cpp and rust IR by reading the generated IR files
-                std::string separator { "__GENERATED_IR_SEPARATOR__" };
-                auto irs = result.find(separator);
-                auto cpp_ir = result.substr(0, irs);
-                auto rust_ir = result.substr(irs + separator.length());
+            // parse result into cpp and rust IR by reading the generated IR files
+            std::string separator { "__GENERATED_IR_SEPARATOR__" };
+            auto irs = result.find(separator);
+            auto cpp_ir = result.substr(0, irs);
+            auto rust_ir = result.substr(irs + separator.length());
+
+            // create response
+            json::value response {};
+            response["cppIR"] = json::value::string(cpp_ir);
+            response["rustIR"] = json::value::string(rust_ir);
+            return response;
+        });
+        reply_when_done(request, std::move(admission), response);
+    }
 
-                // create response
-                json::value response {};
-                response["cppIR"] = json::value::string(cpp_ir);
-                response["rustIR"] = json::value::string(rust_ir);
+    /// `POST /api/validate`
+    void handle_validate(http_request request, std::shared_ptr<Admission> admission) {
+        printer_.log("received validate request");
+        auto response = request.extract_json().then([this](json::value body) {
+            return validator_link_.submit(make_validate_command(body)).second;
+        }).then([](std::string result) {
+            return make_validate_response(result);
+        });
+        reply_when_done(request, std::move(admission), response);
+    }
 
-                return response;
+    /// `POST /api/check`, generate and validate the IRs in a single request,
+    /// i.e., the IRs never travel through the relay server unless `includeIR`
+    /// is set, in which case they are added to the response of `/api/validate`
+    /// as "cppIR" and "rustIR".
+    void handle_check(http_request request, std::shared_ptr<Admission> admission) {
+        printer_.log("received check request");
+        // the IRs come with the "compiled" progress event
+        auto compiled = std::make_shared<json::value>();
+        auto include_ir = std::make_shared<bool>(false);
+        auto response = request.extract_json().then([this, compiled, include_ir](json::value body) {
+            check_request_body(body, { "cppCode", "rustCode", "cppFunctionName", "rustFunctionName" });
+            *include_ir = body.has_field("includeIR") && body["includeIR"].as_bool();
+            std::vector<std::string_view> command {
+                "CHECK", body["cppFunctionName"].as_string(), body["rustFunctionName"].as_string(),
+                *include_ir ? "1" : "0", body["cppCode"].as_string(), body["rustCode"].as_string()
+            };
+            return validator_link_.submit(command, [compiled](const std::string &event) {
+                try {
+                    auto value = json::value::parse(event);
+                    if (value.has_string_field("cpp_ir")) {
+                        *compiled = std::move(value);
+                    }
+                } catch (const std::exception &) {
+                    // not the "compiled" event
+                }
+            }).second;
+        }).then([compiled, include_ir](std::string output) {
+            if (is_generate_error(output)) {
+                throw std::runtime_error(output);
+            }
+
+            auto response = make_validate_response(output);
+            if (*include_ir && !compiled->is_null()) {
+                response["cppIR"] = (*compiled)["cpp_ir"];
+                response["rustIR"] = (*compiled)["rust_ir"];
+            }
+            return response;
+        });
+        reply_when_done(request, std::move(admission), response);
+    }
+
+    /// `POST /api/validate-stream`, same as `/api/validate` but replies with
+    /// server-sent events, i.e.,
+    ///   - "accepted", `{"cancelToken": ...}` to be used with `/api/cancel`
+    ///     while the stream lasts, first, unless the validator server is
+    ///     unavailable (the stream then only has the "error").
+    ///   - "progress", the progress events of the validator (e.g., the smt
+    ///     queries being solved) as they happen.
+    ///   - "result", the same response as `/api/validate`, or "error".
+    void handle_validate_stream(http_request request, std::shared_ptr<Admission> admission) {
+        printer_.log("received validate-stream request");
+        request.extract_json().then([this, request, admission](pplx::task<json::value> body) {
+            // the command refers to `value`
+            json::value value {};
+            std::vector<std::string_view> command {};
+            try {
+                value = body.get();
+                command = make_validate_command(value);
             } catch (const std::exception &e) {
                 reply_with_error(request, e.what());
-                // note: need to re-throw to break the promise chain
-                throw;
+                return;
+            }
+
+            concurrency::streams::producer_consumer_buffer<uint8_t> events {};
+            http_response response { status_codes::OK };
+            response.headers().add(header_names::cache_control, "no-cache");
+            response.set_body(events.create_istream(), "text/event-stream");
+            request.reply(response);
+
+            // the reader thread may forward progress events before `submit`
+            // returns, so they are held back until "accepted" is written
+            struct Progress {
+                std::mutex mutex;
+                bool accepted { false };
+                std::vector<std::string> held;
+            };
+            auto progress = std::make_shared<Progress>();
+            auto [request_id, result] = validator_link_.submit(command, [events, progress](const std::string &event) mutable {
+                std::lock_guard lock { progress->mutex };
+                if (progress->accepted) {
+                    write_event(events, "progress", event);
+                } else {
+                    progress->held.push_back(event);
+                }
+            });
+
+            // without a request (i.e., the validator server is unavailable),
+            // the stream only gets the "error" written below
+            std::shared_ptr<CancelToken> cancel_token {};
+            if (request_id != 0) {
+                cancel_token = std::make_shared<CancelToken>(*this, request_id);
+                json::value accepted {};
+                accepted["cancelToken"] = json::value::string(cancel_token->token);
+                std::lock_guard lock { progress->mutex };
+                write_event(events, "accepted", accepted.serialize());
+                for (const auto &event : progress->held) {
+                    write_event(events, "progress", event);
+                }
+                progress->held.clear();
+                progress->accepted = true;
             }
-        }).then([&request](json::value response) {
-            request.reply(status_codes::OK, response);
-        }).wait();
+
+            result.then([events, admission, cancel_token](std::string output) mutable {
+                try {
+                    write_event(events, "result", make_validate_response(output).serialize());
+                } catch (const std::exception &e) {
+                    json::value error {};
+                    error["error"] = json::value::string(e.what());
+                    write_event(events, "error", error.serialize());
+                }
+                events.close(std::ios_base::out);
+            });
+        });
     }
 
-    /// `POST /api/validate`
-    void handle_validate(http_request request) {
-        printer_.log("received validate request");
-        request.extract_json().then([this, &request](json::value body) {
+    /// `POST /api/cancel`, cancel a request started by `/api/validate-stream`
+    /// given the token of its "accepted" event, its stream then ends with the
+    /// "cancelled" error.
+    void handle_cancel(http_request request) {
+        printer_.log("received cancel request");
+        request.extract_json().then([this, request](pplx::task<json::value> body) {
             try {
-                check_request_body(body, { "cppIR", "rustIR", "cppFunctionName", "rustFunctionName" });
-                auto cpp_ir = body["cppIR"].as_string();
-                auto rust_ir = body["rustIR"].as_string();
-                auto cpp_function_name = body["cppFunctionName"].as_string();
-                auto rust_function_name = body["rustFunctionName"].as_string();
-
-                // format command and send to validator
-                std::string command {
-                    std::string("VALIDATE") +
-                    "__CPPIR__" + std::move(cpp_ir) +
-                    "__RUSTIR__" + std::move(rust_ir) +
-                    "__CPP_FUNCTION__" + std::move(cpp_function_name) +
-                    "__RUST_FUNCTION__" + std::move(rust_function_name)
-                };
-                std::string result = send_to_validator(std::move(command));
-                if (result == "error") {
-                    throw std::runtime_error("failed to send command for validating IR");
-                } else if (result.find("multiple functions found") != std::string::npos ||
-                           result.find("function not found") != std::string::npos ||
-                           result.find("no functions found") != std::string::npos) {
-                    throw std::runtime_error(result);
+                auto value = body.get();
+                check_request_body(value, { "cancelToken" });
+                std::optional<uint64_t> request_id {};
+                {
+                    std::lock_guard lock { cancel_tokens_mutex_ };
+                    auto it = cancel_tokens_.find(value["cancelToken"].as_string());
+                    if (it != cancel_tokens_.end()) {
+                        request_id = it->second;
+                    }
                 }
 
-                // parse validation result
-                bool success = result.find("Transformation seems to be correct!") != std::string::npos;
-                int num_errors = success ? 0 : 1;
-
-                // create response
                 json::value response {};
-                response["success"] = json::value::boolean(success);
-                response["verifier_output"] = json::value::string(result);
-                response["num_errors"] = json::value::number(num_errors);
-
-                return response;
+                response["cancelled"] = json::value::boolean(request_id && validator_link_.cancel(*request_id));
+                request.reply(status_codes::OK, response);
             } catch (const std::exception &e) {
-                // same as `handle_generate_ir`
                 reply_with_error(request, e.what());
-                throw;
             }
-        }).then([&request](json::value response) {
-            request.reply(status_codes::OK, response);
-        }).wait();
+        });
     }
 
     void start() {
         try {
             listener.open().wait();
-            printer_.print_info("relay server running at: " + listener.uri().to_string(), true);
+            printer_.print_info("relay server running at: " + listener.uri().to_string() +
+                                " (at most " + std::to_string(max_concurrent_requests_) +
+                                " concurrent requests)", true);
         } catch (const std::exception& e) {
             printer_.print_error("error starting relay server: " + std::string(e.what()), true);
         }
@@ -176,113 +592,115 @@ private:
                       LOG_STORAGE_PREFIX, LOG_FILE_DEFAULT_NAME };
 
     /// the validator server runs on "127.0.0.1:3002".
-    const std::string validator_host { "127.0.0.1" };
-    const int validator_port { 3002 };
-
-    void read_until_length(int client_socket, char *buffer, size_t length) {
-        size_t n { 0 };
-        while (n < length) {
-            size_t bytes_read = read(client_socket, buffer + n, length - n);
-            if (bytes_read == 0) {
-                throw std::runtime_error("connection closed by client");
-            }
-            n += bytes_read;
+    ValidatorLink validator_link_ { "127.0.0.1", 3002, printer_ };
+
+    /// the requests being relayed, see `admit`.
+    const size_t max_concurrent_requests_;
+    std::atomic<size_t> in_flight_ { 0 };
+    std::atomic<uint64_t> rejected_requests_ { 0 };
+
+    /// the relay request id of every `CancelToken` alive.
+    std::mutex cancel_tokens_mutex_;
+    std::unordered_map<std::string, uint64_t> cancel_tokens_;
+
+    static constexpr status_code TOO_MANY_REQUESTS = 429;
+
+    /// the requests received by path, for `/metrics`, the unknown paths are
+    /// counted as the last one.
+    static constexpr std::array<const char *, 6> API_PATHS {
+        "/api/generate-ir", "/api/validate", "/api/validate-stream",
+        "/api/check", "/api/cancel", "other"
+    };
+    std::array<std::atomic<uint64_t>, API_PATHS.size()> request_counts_ {};
+
+    void count_request(const std::string &path) {
+        size_t i { 0 };
+        while (i + 1 < API_PATHS.size() && path != API_PATHS[i]) {
+            ++i;
         }
+        request_counts_[i].fetch_add(1, std::memory_order_relaxed);
     }
 
-    /// the protocol between messages sent from the relay server is,
-    /// <length><blankspace><message>
-    /// where <length> is the exact length of the <message>.
-    bool read_validator_message(int client_socket, std::string &buffer) {
-        // first read the length of the message
-        size_t n { 0 };
-        char length_buffer[9] { 0 };
-
-        while ((read(client_socket, length_buffer + n, 1)) > 0) {
-            if (length_buffer[n] == ' ') {
-                // calculate the length of the message
-                size_t length = std::atoi(length_buffer);
-                buffer.resize(length);
-                // read the rest of the message until the length is reached
-                read_until_length(client_socket, buffer.data(), length);
-                break;
-            } else if (!isdigit(length_buffer[n])) {
-                // malformed message
-                return false;
-            } else {
-                n += 1;
-                if (n > 8) {
-                    // length buffer overflow
-                    return false;
-                }
-            }
+    /// take a slot for a request, nullptr if all of them are taken.
+    auto admit() -> std::shared_ptr<Admission> {
+        if (in_flight_.fetch_add(1, std::memory_order_relaxed) >= max_concurrent_requests_) {
+            in_flight_.fetch_sub(1, std::memory_order_relaxed);
+            return nullptr;
         }
-
-        return true;
+        return std::make_shared<Admission>(in_flight_);
     }
 
-    /// create a TCP connection with the validator server.
-    /// this function will block until the connection is established.
-    int make_connection_with_validator(bool &error) {
-        int sock = socket(AF_INET, SOCK_STREAM, 0);
-        if (sock < 0) {
-            throw std::runtime_error("failed to create socket");
-        }
+    /// reply with `response` once it is ready, or with the error it failed
+    /// with, and release the slot of the request afterwards.
+    static void reply_when_done(http_request request, std::shared_ptr<Admission> admission,
+                                pplx::task<json::value> response) {
+        response.then([request, admission](pplx::task<json::value> response) {
+            try {
+                request.reply(status_codes::OK, response.get());
+            } catch (const ServiceUnavailable &e) {
+                reply_with_error(request, e.what(), status_codes::ServiceUnavailable);
+            } catch (const std::exception &e) {
+                reply_with_error(request, e.what());
+            }
+        });
+    }
 
-        struct sockaddr_in serv_addr = {
-            .sin_family = AF_INET,
-            .sin_port = htons(validator_port),
-            .sin_addr = {}
+    /// the VALIDATE command of a `/api/validate` request body, i.e., the
+    /// fields refer to the strings in `body` rather than copying the IRs.
+    static auto make_validate_command(json::value &body) -> std::vector<std::string_view> {
+        check_request_body(body, { "cppIR", "rustIR", "cppFunctionName", "rustFunctionName" });
+        return {
+            "VALIDATE", body["cppIR"].as_string(), body["rustIR"].as_string(),
+            body["cppFunctionName"].as_string(), body["rustFunctionName"].as_string()
         };
+    }
 
-        if (inet_pton(AF_INET, validator_host.c_str(), &serv_addr.sin_addr) <= 0) {
-            close(sock);
-            printer_.print_error("invalid address", true);
-            error = true;
-            return -1;
-        }
-
-        if (connect(sock, (struct sockaddr *) &serv_addr, sizeof(serv_addr)) < 0) {
-            close(sock);
-            printer_.print_error("connection failed", true);
-            error = true;
-            return -1;
-        }
-        printer_.log("connected to validator server");
-        return sock;
+    /// whether the validator output of a GENERATE (or CHECK) command is an
+    /// error of the IR generation, i.e., the compilation failed.
+    static auto is_generate_error(const std::string &result) -> bool {
+        return result.find("failed to generate") != std::string::npos ||
+               result.starts_with("C++ compilation ") ||
+               result.starts_with("Rust compilation ") ||
+               result.find("generated IR file exceeds the size limit") != std::string::npos ||
+               result.find("generated IR file exceeds the length limit") != std::string::npos;
     }
 
-    /// send a command to the alive2 verifier server through a simple TCP connection.
-    /// note that this function will create a temporary TCP socket and then close it.
-    /// this function will block until the command is sent and the response is received.
-    auto send_to_validator(std::string command) -> std::string {
-        bool error { false };
-        int sock = make_connection_with_validator(error);
-        if (error) {
-            return { "error" };
+    /// parse the validator output of a VALIDATE command, throws if the
+    /// validation could not be done.
+    static auto make_validate_response(const std::string &result) -> json::value {
+        if (result == "error") {
+            throw std::runtime_error("failed to send command for validating IR");
+        } else if (result == "unavailable") {
+            throw ValidatorUnavailable {};
+        } else if (result == "cancelled") {
+            throw std::runtime_error("validation cancelled");
+        } else if (result == "overloaded") {
+            throw ValidatorOverloaded {};
+        } else if (result.find("multiple functions found") != std::string::npos ||
+                   result.find("function not found") != std::string::npos ||
+                   result.find("no functions found") != std::string::npos) {
+            throw std::runtime_error(result);
         }
 
-        // follows the format: <length><blankspace><command>
-        std::string relay_message { std::to_string(command.length()) + " " + std::move(command) };
-        ssize_t sent_bytes = send(sock, relay_message.c_str(), relay_message.length(), 0);
-        if (sent_bytes < 0 || static_cast<size_t>(sent_bytes) != relay_message.length()) {
-            close(sock);
-            printer_.print_error("failed to send command", true);
-            return { "error" };
-        }
+        // parse validation result
+        bool success = result.find("Transformation seems to be correct!") != std::string::npos;
+        int num_errors = success ? 0 : 1;
 
-        std::string buffer {};
-        if (!read_validator_message(sock, buffer)) {
-            close(sock);
-            printer_.print_error("failed to read validator message", true);
-            return { "error" };
-        }
+        json::value response {};
+        response["success"] = json::value::boolean(success);
+        response["verifier_output"] = json::value::string(result);
+        response["num_errors"] = json::value::number(num_errors);
+        return response;
+    }
 
-        close(sock);
-        return buffer;
+    /// write a server-sent event, `data` must be a single line.
+    static void write_event(concurrency::streams::producer_consumer_buffer<uint8_t> &events,
+                            const std::string &name, const std::string &data) {
+        std::string event { "event: " + name + "\ndata: " + data + "\n\n" };
+        events.putn_nocopy(reinterpret_cast<const uint8_t *>(event.data()), event.size()).wait();
     }
 
-    void check_request_body(const json::value &body, std::vector<std::string> required_fields) {
+    static void check_request_body(const json::value &body, std::vector<std::string> required_fields) {
         for (const auto &field : required_fields) {
             if (!body.has_field(field)) {
                 throw std::invalid_argument(field + " is required");
@@ -297,8 +715,23 @@ void signal_handler(int signum) {
     keep_running = false;
 }
 
-int main() {
-    RelayServer server { "http://127.0.0.1:3001" };
+int main(int argc, char **argv) {
+    // the only option, i.e., `--max-concurrent-requests=<n>`
+    size_t max_concurrent_requests { 64 };
+    const std::string option { "--max-concurrent-requests=" };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg { argv[i] };
+        char *end { nullptr };
+        auto value = arg.starts_with(option) ? std::strtoul(arg.c_str() + option.size(), &end, 10) : 0;
+        if (value > 0 && *end == '\0') {
+            max_concurrent_requests = value;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [" << option << "<n>]\n";
+            return 1;
+        }
+    }
+
+    RelayServer server { "http://127.0.0.1:3001", max_concurrent_requests };
     server.start();
 
     while (keep_running) {
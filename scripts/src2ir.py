@@ -1,36 +1,139 @@
+import hashlib
+import mmap
 import os
+import shutil
+import struct
 import subprocess
 
+# the compile cache shared with the validator server, see `src/CompileCache.h`
+# for the layout and the key, which must be computed the same way here, i.e.,
+# with the same flags as `ValidatorServer::compile_sources` and an empty source
+# name, as the rust crate is named by the flags.
+COMPILE_CACHE_DIR = os.path.expanduser('~/.translation_validator/compile_cache/')
+CPP_FLAGS = "clang++ -O0 -S -emit-llvm"
+RUST_FLAGS = "rustc --emit=llvm-ir --crate-type=lib --crate-name=input"
+
+# the offsets of `ResultCache::Counters` in the shared `stats` file, i.e.,
+# hits, misses, insertions, evictions and bytes, each a native uint64_t.
+COUNTERS_FORMAT = '=5Q'
+INSERTIONS_OFFSET = 16
+BYTES_OFFSET = 32
+
+def identify_compiler(compiler):
+    # the resolved path and the `--version` output, none if not found
+    path = shutil.which(compiler)
+    if path is None:
+        return None
+    result = subprocess.run([compiler, '--version'], capture_output=True)
+    if result.returncode != 0 or not result.stdout:
+        return None
+    return path.encode() + b'\n' + result.stdout
+
+def make_key(parts):
+    # each part is length-prefixed, i.e., the same as `ResultCache::make_key`
+    hasher = hashlib.sha256()
+    for part in parts:
+        hasher.update(f"{len(part)}:".encode())
+        hasher.update(part)
+    return hasher.hexdigest()
+
+def entry_path(key):
+    return os.path.join(COMPILE_CACHE_DIR, 'entries', key[:2], key)
+
+def lookup(key):
+    path = entry_path(key)
+    if not os.path.exists(path):
+        return None
+    with open(path, 'rb') as file:
+        ir = file.read()
+    # refresh the entry for the lru eviction done by the server
+    os.utime(path)
+    return ir
+
+def bump_counters(size):
+    # the server bumps the counters atomically, which python cannot do, so an
+    # update may rarely be lost; the byte counter is resynchronized with the
+    # disk by the server's next eviction anyway. the eviction itself is left
+    # to the server, on its next insertion.
+    stats_path = os.path.join(COMPILE_CACHE_DIR, 'stats')
+    counters_size = struct.calcsize(COUNTERS_FORMAT)
+    fd = os.open(stats_path, os.O_RDWR | os.O_CREAT, 0o644)
+    try:
+        if os.fstat(fd).st_size < counters_size:
+            os.ftruncate(fd, counters_size)
+        with mmap.mmap(fd, counters_size) as counters:
+            for offset, delta in ((INSERTIONS_OFFSET, 1), (BYTES_OFFSET, size)):
+                value, = struct.unpack_from('=Q', counters, offset)
+                struct.pack_into('=Q', counters, offset, value + delta)
+    finally:
+        os.close(fd)
+
+def insert(key, ir):
+    # written to a temporary file first and then renamed
+    path = entry_path(key)
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    tmp_path = f"{path}.tmp.{os.getpid()}"
+    with open(tmp_path, 'wb') as file:
+        file.write(ir)
+    os.replace(tmp_path, path)
+    bump_counters(len(ir))
+
 def convert_src_to_ir(source_folder, ir_folder):
+    identities = {
+        'clang++': identify_compiler('clang++'),
+        'rustc': identify_compiler('rustc'),
+    }
+    hits, misses = 0, 0
+
     # walk through all subdirectories and the corresponding source files
     for root, _, files in os.walk(source_folder):
         for file in files:
             # get relative path from `source_folder` to maintain structure
             rel_path = os.path.relpath(root, source_folder)
             base_name = os.path.splitext(file)[0]
-            
+
             # create corresponding ir folder structure
             ir_subfolder = os.path.join(ir_folder, rel_path)
             if not os.path.exists(ir_subfolder):
                 os.makedirs(ir_subfolder)
-            
+
             source_path = os.path.join(root, file)
             if file.endswith('.cpp'):
                 ir_path = os.path.join(ir_subfolder, f"{base_name}_cpp.ll")
+                compiler, flags = 'clang++', CPP_FLAGS
             elif file.endswith('.rs'):
                 ir_path = os.path.join(ir_subfolder, f"{base_name}_rs.ll")
+                compiler, flags = 'rustc', RUST_FLAGS
             else:
                 assert False, f"unsupported file type: {file}"
-            
-            if not os.path.exists(ir_path):
-                if file.endswith('.cpp'):
-                    command = f"clang++ -O0 -S -emit-llvm {source_path} -o {ir_path}"
-                elif file.endswith('.rs'):
-                    command = f"rustc --emit=llvm-ir --crate-type=lib {source_path} -o {ir_path}"
-                subprocess.run(command, shell=True, check=True)
-                print(f"converted {source_path} to {ir_path}")
-            else:
+
+            if os.path.exists(ir_path):
                 print(f"ir file {ir_path} already exists, skipping conversion.")
+                continue
+
+            key = None
+            if identities[compiler] is not None:
+                with open(source_path, 'rb') as source:
+                    key = make_key([b'COMPILE', identities[compiler], flags.encode(),
+                                    b'', source.read()])
+                ir = lookup(key)
+                if ir is not None:
+                    with open(ir_path, 'wb') as ir_file:
+                        ir_file.write(ir)
+                    hits += 1
+                    print(f"converted {source_path} to {ir_path} (cached)")
+                    continue
+                misses += 1
+
+            subprocess.run(f"{flags} {source_path} -o {ir_path}", shell=True, check=True)
+            if key is not None:
+                with open(ir_path, 'rb') as ir_file:
+                    insert(key, ir_file.read())
+            print(f"converted {source_path} to {ir_path}")
+
+    if hits + misses > 0:
+        print(f"compile cache hit rate: {hits * 100 // (hits + misses)}% "
+              f"({hits} hits, {misses} misses)")
 
 def main():
     source_folder = 'examples/source'
@@ -1,14 +1,46 @@
 #ifndef COMPARER_H
 #define COMPARER_H
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <poll.h>
+#include <sstream>
 #include <string>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
+#include "llvm/Demangle/Demangle.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm_util/compare.h"
 
+#include "ModuleSlice.h"
 #include "Printer.h"
+#include "SmtProfile.h"
+
+constexpr auto SRC_UB_PROMPT = "WARNING: Source function is always UB";
+
+/// how `Comparer::compare_all` pairs the cpp functions with the rust ones.
+enum class PairingMode {
+    /// by the demangled base name, e.g., `add(int, int)` <-> `example::add`.
+    Demangled,
+    /// by the llvm function type, only if the type is unique in both modules.
+    Signature,
+    /// by an explicit mapping file, i.e., one `<cpp_name> <rust_name>` per
+    /// line, where the names are matched the same way as `--cpp-func` and
+    /// `--rust-func` are.
+    Mapping
+};
 
 class Comparer {
 public:
@@ -87,7 +119,11 @@ public:
 
         bool success { false };
         try {
-            success = verifier_.compareFunctions(*cpp_func, *rust_func);
+            // only the selected functions and what they depend on are
+            // translated, see `ModuleSlice`.
+            ModuleSlice cpp_slice { *cpp_module_, { cpp_func } };
+            ModuleSlice rust_slice { *rust_module_, { rust_func } };
+            success = verifier_.compareFunctions(cpp_slice.get(*cpp_func), rust_slice.get(*rust_func));
         } catch (const std::exception &e) {
             printer_.print_error(e.what());
             return ComparisonResult {
@@ -104,7 +140,461 @@ public:
         };
     }
 
+    /// pair up all the functions in the two modules by `mode` and verify every
+    /// pair, the pairs are distributed across (at most) `num_jobs` forked
+    /// processes, each pair in its own process (see the note in
+    /// `ValidatorServer::process_relay_command`).
+    /// the verifier outputs are written to the verifier's stream and its
+    /// counters are accumulated in the pairing order, i.e., the same as if the
+    /// pairs were verified sequentially, the functions that could not be
+    /// paired are reported as failed results.
+    auto compare_all(PairingMode mode, const std::string &mapping_path,
+                     unsigned num_jobs) -> std::vector<ComparisonResult> {
+        auto cpp_funcs = collect_functions(*cpp_module_, cpp_pattern_);
+        auto rust_funcs = collect_functions(*rust_module_, rust_pattern_);
+        if (auto cpp_empty = check_empty(cpp_funcs)) {
+            return { *cpp_empty };
+        }
+        if (auto rust_empty = check_empty(rust_funcs)) {
+            return { *rust_empty };
+        }
+
+        std::vector<ComparisonResult> unpaired {};
+        auto pairs = pair_functions(mode, mapping_path, cpp_funcs, rust_funcs, unpaired);
+        auto outcomes = verify_pairs(pairs, std::max(1u, num_jobs));
+
+        std::vector<ComparisonResult> results {};
+        for (auto &outcome : outcomes) {
+            verifier_.out << outcome.output;
+            verifier_.num_correct += outcome.num_correct;
+            verifier_.num_unsound += outcome.num_unsound;
+            verifier_.num_failed += outcome.num_failed;
+            verifier_.num_errors += outcome.num_errors;
+            verifier_.num_cached += outcome.num_cached;
+            for (auto &query : outcome.smt_profile) {
+                pair_smt_profile_.push_back(std::move(query));
+            }
+            results.push_back(std::move(outcome.result));
+        }
+        verifier_.num_errors += unpaired.size();
+        results.insert(results.end(), unpaired.begin(), unpaired.end());
+        return results;
+    }
+
+    /// the smt queries run for the pairs of `compare_all` (see
+    /// `take_smt_profile`), which are recorded in the forked processes and
+    /// tagged with their pairs, i.e., "<cpp_name> <rust_name>".
+    auto take_pair_smt_profile() -> llvm::json::Array {
+        return std::move(pair_smt_profile_);
+    }
+
 private:
+    using FunctionPair = std::pair<llvm::Function *, llvm::Function *>;
+
+    /// the result of verifying a single pair in a forked process.
+    struct PairOutcome {
+        ComparisonResult result {};
+        std::string output {};
+        unsigned num_correct { 0 };
+        unsigned num_unsound { 0 };
+        unsigned num_failed { 0 };
+        unsigned num_errors { 0 };
+        unsigned num_cached { 0 };
+        llvm::json::Array smt_profile {};
+    };
+
+    auto collect_functions(llvm::Module &module, const std::string &pattern)
+        -> std::vector<llvm::Function *> {
+        std::vector<llvm::Function *> funcs {};
+        for (auto &func : module) {
+            if (!should_skip_function(func, pattern)) {
+                funcs.push_back(&func);
+            }
+        }
+        return funcs;
+    }
+
+    /// the name used to pair a function in the demangled mode, i.e., the
+    /// unqualified function name without parameters, template arguments, or
+    /// the rust (legacy mangling) hash suffix.
+    static auto base_name(const llvm::Function &func) -> std::string {
+        auto mangled = func.getName().str();
+        llvm::ItaniumPartialDemangler demangler {};
+        std::string name {};
+        if (!demangler.partialDemangle(mangled.c_str()) && demangler.isFunction()) {
+            size_t size { 0 };
+            if (char *buffer = demangler.getFunctionBaseName(nullptr, &size)) {
+                name = buffer;
+                std::free(buffer);
+            }
+        }
+
+        // e.g., `_ZN7example3add17h0123456789abcdefE` is demangled to
+        // `example::add::h0123456789abcdef`.
+        auto is_rust_hash = [](const std::string &component) {
+            return component.size() == 17 && component[0] == 'h' &&
+                   std::all_of(component.begin() + 1, component.end(),
+                               [](char c) { return std::isxdigit(static_cast<unsigned char>(c)); });
+        };
+        if (name.empty() || is_rust_hash(name)) {
+            name = llvm::demangle(mangled);
+            if (auto pos = name.rfind("::"); pos != std::string::npos && is_rust_hash(name.substr(pos + 2))) {
+                name.erase(pos);
+            }
+            if (auto pos = name.rfind("::"); pos != std::string::npos) {
+                name.erase(0, pos + 2);
+            }
+        }
+        return name;
+    }
+
+    static auto signature(const llvm::Function &func) -> std::string {
+        std::string type {};
+        llvm::raw_string_ostream os { type };
+        func.getFunctionType()->print(os);
+        return os.str();
+    }
+
+    /// pair the functions with the same key, the keys that are not unique in
+    /// either module are reported as unpaired.
+    template <typename KeyFn>
+    auto pair_by_key(const std::vector<llvm::Function *> &cpp_funcs,
+                     const std::vector<llvm::Function *> &rust_funcs,
+                     KeyFn key_of, std::vector<ComparisonResult> &unpaired)
+        -> std::vector<FunctionPair> {
+        std::map<std::string, std::vector<llvm::Function *>> rust_by_key {};
+        for (auto *rust_func : rust_funcs) {
+            rust_by_key[key_of(*rust_func)].push_back(rust_func);
+        }
+        std::map<std::string, size_t> cpp_key_counts {};
+        for (auto *cpp_func : cpp_funcs) {
+            cpp_key_counts[key_of(*cpp_func)] += 1;
+        }
+
+        std::vector<FunctionPair> pairs {};
+        std::vector<const llvm::Function *> paired_rust_funcs {};
+        for (auto *cpp_func : cpp_funcs) {
+            auto key = key_of(*cpp_func);
+            auto it = rust_by_key.find(key);
+            if (it == rust_by_key.end()) {
+                unpaired.push_back(ComparisonResult {
+                    .success = false,
+                    .cpp_name = cpp_func->getName().str(),
+                    .error_message = "no matching rust function found"
+                });
+            } else if (it->second.size() > 1 || cpp_key_counts[key] > 1) {
+                unpaired.push_back(ComparisonResult {
+                    .success = false,
+                    .cpp_name = cpp_func->getName().str(),
+                    .error_message = "ambiguous pairing for `" + key + "`, use a mapping file instead"
+                });
+            } else {
+                pairs.emplace_back(cpp_func, it->second[0]);
+                paired_rust_funcs.push_back(it->second[0]);
+            }
+        }
+        report_unpaired_rust_functions(rust_funcs, paired_rust_funcs, unpaired);
+        return pairs;
+    }
+
+    auto pair_by_mapping(const std::string &mapping_path,
+                         const std::vector<llvm::Function *> &cpp_funcs,
+                         const std::vector<llvm::Function *> &rust_funcs,
+                         std::vector<ComparisonResult> &unpaired)
+        -> std::vector<FunctionPair> {
+        std::vector<FunctionPair> pairs {};
+        std::ifstream mapping(mapping_path);
+        if (!mapping) {
+            printer_.print_error("failed to open the pairing map: " + mapping_path);
+            unpaired.push_back(ComparisonResult {
+                .success = false,
+                .error_message = "failed to open the pairing map: " + mapping_path
+            });
+            return pairs;
+        }
+
+        // the ones named by the map, even if their cpp function is missing,
+        // as that line is reported already
+        std::vector<const llvm::Function *> paired_rust_funcs {};
+        std::string line {};
+        while (std::getline(mapping, line)) {
+            std::stringstream line_stream { line };
+            std::string cpp_name {};
+            std::string rust_name {};
+            if (!(line_stream >> cpp_name) || cpp_name.starts_with("#")) {
+                continue;
+            }
+            if (!(line_stream >> rust_name)) {
+                unpaired.push_back(ComparisonResult {
+                    .success = false,
+                    .cpp_name = cpp_name,
+                    .error_message = "malformed pairing map line: " + line
+                });
+                continue;
+            }
+
+            bool cpp_found { true };
+            bool rust_found { true };
+            auto *cpp_func = find_function_by_name(cpp_funcs, cpp_name, cpp_found);
+            auto *rust_func = find_function_by_name(rust_funcs, rust_name, rust_found);
+            if (rust_found) {
+                paired_rust_funcs.push_back(rust_func);
+            }
+            if (!cpp_found || !rust_found) {
+                unpaired.push_back(ComparisonResult {
+                    .success = false,
+                    .cpp_name = cpp_name,
+                    .rust_name = rust_name,
+                    .error_message = std::string(cpp_found ? "rust" : "cpp") + " function not found"
+                });
+                continue;
+            }
+            pairs.emplace_back(cpp_func, rust_func);
+        }
+        report_unpaired_rust_functions(rust_funcs, paired_rust_funcs, unpaired);
+        return pairs;
+    }
+
+    auto pair_functions(PairingMode mode, const std::string &mapping_path,
+                        const std::vector<llvm::Function *> &cpp_funcs,
+                        const std::vector<llvm::Function *> &rust_funcs,
+                        std::vector<ComparisonResult> &unpaired)
+        -> std::vector<FunctionPair> {
+        switch (mode) {
+        case PairingMode::Demangled:
+            return pair_by_key(cpp_funcs, rust_funcs, base_name, unpaired);
+        case PairingMode::Signature:
+            return pair_by_key(cpp_funcs, rust_funcs, signature, unpaired);
+        case PairingMode::Mapping:
+            return pair_by_mapping(mapping_path, cpp_funcs, rust_funcs, unpaired);
+        }
+        return {};
+    }
+
+    void report_unpaired_rust_functions(const std::vector<llvm::Function *> &rust_funcs,
+                                        const std::vector<const llvm::Function *> &paired,
+                                        std::vector<ComparisonResult> &unpaired) {
+        for (auto *rust_func : rust_funcs) {
+            if (std::find(paired.begin(), paired.end(), rust_func) == paired.end()) {
+                unpaired.push_back(ComparisonResult {
+                    .success = false,
+                    .rust_name = rust_func->getName().str(),
+                    .error_message = "no matching cpp function found"
+                });
+            }
+        }
+    }
+
+    /// verify a single pair, this runs in the forked process and returns the
+    /// serialized `PairOutcome`.
+    auto verify_pair(const FunctionPair &pair) -> std::string {
+        auto [cpp_func, rust_func] = pair;
+        // same as `compare`, the slices (and the function bodies they
+        // materialize) are only needed in this process
+        ModuleSlice cpp_slice { *cpp_module_, { cpp_func } };
+        ModuleSlice rust_slice { *rust_module_, { rust_func } };
+        auto &cpp_sliced = cpp_slice.get(*cpp_func);
+        auto &rust_sliced = rust_slice.get(*rust_func);
+        std::stringstream buffer {};
+        llvm_util::Verifier verifier { verifier_.TLI, verifier_.smt_init, buffer };
+        verifier.quiet = verifier_.quiet;
+        verifier.always_verify = verifier_.always_verify;
+        verifier.bidirectional = verifier_.bidirectional;
+        verifier.verdict_cache = verifier_.verdict_cache;
+
+        std::string error {};
+        bool success { false };
+        try {
+            success = verifier.compareFunctions(cpp_sliced, rust_sliced);
+        } catch (const std::exception &e) {
+            error = e.what();
+        }
+
+        // switch the source and target if the cpp function is always ub, the
+        // same way as the standalone version does.
+        auto *counted = &verifier;
+        llvm_util::Verifier reversed_verifier { verifier_.TLI, verifier_.smt_init, buffer };
+        if (error.empty() && buffer.str().find(SRC_UB_PROMPT) != std::string::npos) {
+            buffer.str("");
+            Printer { buffer }.print_src_ub_prompt();
+            reversed_verifier.quiet = verifier_.quiet;
+            reversed_verifier.always_verify = verifier_.always_verify;
+            reversed_verifier.bidirectional = verifier_.bidirectional;
+            reversed_verifier.verdict_cache = verifier_.verdict_cache;
+            try {
+                success = reversed_verifier.compareFunctions(rust_sliced, cpp_sliced);
+            } catch (const std::exception &e) {
+                error = e.what();
+            }
+            counted = &reversed_verifier;
+        }
+
+        llvm::json::Object outcome {
+            { "success", success },
+            { "error", error.empty() ? (success ? "" : "functions are not semantically equivalent") : error },
+            { "output", buffer.str() },
+            { "num_correct", static_cast<int64_t>(counted->num_correct) },
+            { "num_unsound", static_cast<int64_t>(counted->num_unsound) },
+            { "num_failed", static_cast<int64_t>(counted->num_failed) },
+            { "num_errors", static_cast<int64_t>(counted->num_errors + (error.empty() ? 0 : 1)) },
+            { "num_cached", static_cast<int64_t>(verifier.num_cached + reversed_verifier.num_cached) }
+        };
+        if (auto queries = take_smt_profile(); !queries.empty()) {
+            outcome["smt_profile"] = std::move(queries);
+        }
+        std::string serialized {};
+        llvm::raw_string_ostream os { serialized };
+        os << llvm::json::Value(std::move(outcome));
+        return os.str();
+    }
+
+    /// deserialize the `PairOutcome` sent by the forked process of `pair`,
+    /// `status` is its wait status.
+    static auto decode_outcome(const FunctionPair &pair, const std::string &data,
+                               int status) -> PairOutcome {
+        PairOutcome outcome {};
+        outcome.result = ComparisonResult {
+            .success = false,
+            .cpp_name = pair.first->getName().str(),
+            .rust_name = pair.second->getName().str()
+        };
+
+        auto value = llvm::json::parse(data);
+        auto *object = value ? value->getAsObject() : nullptr;
+        if (!value) {
+            llvm::consumeError(value.takeError());
+        }
+        if (object == nullptr) {
+            outcome.num_errors = 1;
+            outcome.result.error_message =
+                WIFSIGNALED(status)
+                    ? "verifier crashed with signal " + std::to_string(WTERMSIG(status)) +
+                      " (" + strsignal(WTERMSIG(status)) + ")"
+                    : "verifier exited without a result";
+            return outcome;
+        }
+
+        auto count = [object](llvm::StringRef key) {
+            return static_cast<unsigned>(object->getInteger(key).value_or(0));
+        };
+        outcome.result.success = object->getBoolean("success").value_or(false);
+        outcome.result.error_message = object->getString("error").value_or("").str();
+        outcome.output = object->getString("output").value_or("").str();
+        outcome.num_correct = count("num_correct");
+        outcome.num_unsound = count("num_unsound");
+        outcome.num_failed = count("num_failed");
+        outcome.num_errors = count("num_errors");
+        outcome.num_cached = count("num_cached");
+        if (auto *queries = object->getArray("smt_profile")) {
+            auto pair_name = outcome.result.cpp_name + " " + outcome.result.rust_name;
+            for (auto &query : *queries) {
+                if (auto *fields = query.getAsObject()) {
+                    (*fields)["pair"] = pair_name;
+                }
+                outcome.smt_profile.push_back(std::move(query));
+            }
+        }
+        return outcome;
+    }
+
+    /// verify the pairs in forked processes, at most `num_jobs` at a time,
+    /// the outcomes are returned in the same order as `pairs`.
+    auto verify_pairs(const std::vector<FunctionPair> &pairs, unsigned num_jobs)
+        -> std::vector<PairOutcome> {
+        struct Running {
+            pid_t pid;
+            int fd;
+            size_t index;
+            std::string data;
+        };
+        std::vector<PairOutcome> outcomes(pairs.size());
+        std::vector<Running> running {};
+        size_t next { 0 };
+
+        while (next < pairs.size() || !running.empty()) {
+            while (next < pairs.size() && running.size() < num_jobs) {
+                int fds[2] { -1, -1 };
+                if (pipe(fds) < 0) {
+                    printer_.print_error("failed to create pipe: " + std::string(std::strerror(errno)));
+                    break;
+                }
+                std::cout.flush();
+                std::fflush(nullptr);
+                pid_t pid = fork();
+                if (pid < 0) {
+                    printer_.print_error("failed to fork verifier process: " +
+                                         std::string(std::strerror(errno)));
+                    close(fds[0]);
+                    close(fds[1]);
+                    break;
+                } else if (pid == 0) {
+                    // child -- report the outcome and skip the parent's cleanup
+                    close(fds[0]);
+                    auto data = verify_pair(pairs[next]);
+                    for (size_t written = 0; written < data.size(); ) {
+                        auto n = write(fds[1], data.data() + written, data.size() - written);
+                        if (n < 0 && errno == EINTR) {
+                            continue;
+                        } else if (n <= 0) {
+                            break;
+                        }
+                        written += n;
+                    }
+                    close(fds[1]);
+                    std::cout.flush();
+                    _exit(EXIT_SUCCESS);
+                }
+                close(fds[1]);
+                running.push_back(Running { .pid = pid, .fd = fds[0], .index = next, .data = {} });
+                next += 1;
+            }
+            if (running.empty()) {
+                // failed to start any process, report the remaining pairs
+                for (; next < pairs.size(); ++next) {
+                    outcomes[next] = decode_outcome(pairs[next], "", 0);
+                }
+                break;
+            }
+
+            // drain the pipes, the outputs can be larger than the pipe buffer
+            std::vector<pollfd> pfds {};
+            for (const auto &process : running) {
+                pfds.push_back(pollfd { .fd = process.fd, .events = POLLIN, .revents = 0 });
+            }
+            if (poll(pfds.data(), pfds.size(), -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                printer_.print_error("failed to poll verifier processes: " +
+                                     std::string(std::strerror(errno)));
+                exit(EXIT_FAILURE);
+            }
+
+            for (size_t i = pfds.size(); i-- > 0; ) {
+                if (pfds[i].revents == 0) {
+                    continue;
+                }
+                auto &process = running[i];
+                char chunk[4096];
+                auto n = read(process.fd, chunk, sizeof(chunk));
+                if (n > 0) {
+                    process.data.append(chunk, n);
+                    continue;
+                } else if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+
+                // eof, i.e., the process has finished or died
+                close(process.fd);
+                int status { 0 };
+                while (waitpid(process.pid, &status, 0) < 0 && errno == EINTR) {}
+                outcomes[process.index] = decode_outcome(pairs[process.index], process.data, status);
+                running.erase(running.begin() + i);
+            }
+        }
+        return outcomes;
+    }
+
     /// check if the function should be skipped
     auto should_skip_function(const llvm::Function &func,
                               const std::string &pattern) -> bool const {
@@ -163,6 +653,7 @@ private:
     bool use_specified_function_name_ { false };
     std::string cpp_function_name_ { "" };
     std::string rust_function_name_ { "" };
+    llvm::json::Array pair_smt_profile_ {};
 };
 
 #endif  // COMPARER_H
@@ -0,0 +1,100 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "Printer.h"
+#include "ResultCache.h"
+
+/// the storage to store the compiled IRs, shared by the validator server and
+/// `scripts/src2ir.py`, i.e., both compile textual IR with the same flags and
+/// an empty source name, so either one hits the entries of the other (the
+/// bitcode entries are only ever used by the server). the script bumps the
+/// shared counters but never evicts, so the size limit is enforced by the
+/// server, on its next insertion.
+const auto COMPILE_CACHE_PREFIX = []() {
+    const char* home = getenv("HOME");
+    if (!home) {
+        home = getpwuid(getuid())->pw_dir;
+    }
+    return std::string(home) + "/.translation_validator/compile_cache/";
+}();
+
+/// a ccache-style cache of the IRs generated by the compilers, i.e., an IR is
+/// stored under the hash of,
+///   - the identity of the compiler, i.e., its resolved path and its
+///     `--version` output (see `identify`), so upgrading a toolchain
+///     invalidates its entries.
+///   - the flags it is invoked with (except the output path).
+///   - the source file name, if it ends up in the IR, empty if it does not
+///     matter (e.g., the rust crate is named by the flags).
+///   - the source itself.
+/// a hit is served without spawning the compiler at all.
+class CompileCache {
+public:
+    CompileCache(uint64_t size_limit, const Printer &printer)
+        : cache_(COMPILE_CACHE_PREFIX, size_limit, printer) {}
+
+    auto enabled() const -> bool {
+        return cache_.enabled();
+    }
+
+    static auto make_key(std::string_view compiler_identity, std::string_view flags,
+                         std::string_view source_name, std::string_view source) -> std::string {
+        return ResultCache::make_key({ "COMPILE", compiler_identity, flags, source_name, source });
+    }
+
+    auto lookup(const std::string &key, std::string &ir) const -> bool {
+        return cache_.lookup(key, ir);
+    }
+
+    void insert(const std::string &key, const std::string &ir) const {
+        cache_.insert(key, ir);
+    }
+
+    /// the counters along with the hit rate, used for logging.
+    auto describe_counters() const -> std::string {
+        auto c = cache_.counters();
+        auto lookups = c.hits + c.misses;
+        auto hit_rate = lookups == 0 ? 0 : c.hits * 100 / lookups;
+        return "hit rate: " + std::to_string(hit_rate) + "%, " + cache_.describe_counters();
+    }
+
+    /// the identity of `compiler`, i.e., the path it resolves to and its
+    /// `--version` output, empty if it cannot be found. this spawns the
+    /// compiler, so it is meant to be computed once and reused.
+    static auto identify(const std::string &compiler) -> std::string {
+        auto path = run("command -v " + compiler);
+        auto version = run(compiler + " --version 2>/dev/null");
+        if (path.empty() || version.empty()) {
+            return "";
+        }
+        while (!path.empty() && path.back() == '\n') {
+            path.pop_back();
+        }
+        return path + "\n" + version;
+    }
+
+private:
+    /// the standard output of `command`, empty if it fails.
+    static auto run(const std::string &command) -> std::string {
+        FILE *pipe = popen(command.c_str(), "r");
+        if (pipe == nullptr) {
+            return "";
+        }
+        std::string output {};
+        char buffer[4096];
+        size_t n { 0 };
+        while ((n = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+            output.append(buffer, n);
+        }
+        return pclose(pipe) == 0 ? output : "";
+    }
+
+    ResultCache cache_;
+};
+
+#endif  // COMPILE_CACHE_H
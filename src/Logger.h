@@ -0,0 +1,335 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <string>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+/// the lowest level written to the log files, the calls of the lower levels
+/// are compiled out, e.g., `-DLOG_LEVEL_MIN=1` drops the `Printer::log` lines.
+#ifndef LOG_LEVEL_MIN
+#define LOG_LEVEL_MIN 0
+#endif
+
+enum class LogLevel : int { Log = 0, Info = 1, Error = 2 };
+
+constexpr auto log_level_enabled(LogLevel level) -> bool {
+    return static_cast<int>(level) >= LOG_LEVEL_MIN;
+}
+
+/// an asynchronous, per-process log file writer, i.e.,
+///   - `append` only takes the time and pushes the line into a bounded
+///     lock-free ring buffer, it never blocks nor touches the file, the lines
+///     are dropped (and counted) if the buffer is full.
+///   - a background thread drains the buffer in batches, formats the
+///     timestamps, and writes each batch with a single `write` to a file
+///     descriptor kept open with `O_APPEND` (so the processes sharing the file
+///     never interleave within a line).
+///   - the file is rotated once it exceeds `ROTATE_SIZE`, keeping
+///     `NUM_BACKUPS` old files, the processes sharing the file coordinate
+///     through `flock` and reopen the file once another one has rotated it.
+/// threads do not survive `fork`, so a forked child gets its own loggers
+/// (see `of`) and leaves the inherited ones to the parent.
+class Logger {
+public:
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr uint64_t ROTATE_SIZE = 16 * 1024 * 1024;
+    static constexpr int NUM_BACKUPS = 3;
+    /// how often the queued lines are written, the writers never wake the
+    /// flusher up themselves, so that `append` stays free of syscalls.
+    static constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(50);
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    /// the logger of `directory + file_name` owned by the current process,
+    /// created on first use, and never destroyed (see `flush_all`).
+    static auto of(const std::string &directory, const std::string &file_name) -> Logger * {
+        auto &registry = get_registry();
+        std::lock_guard<std::mutex> lock { registry.mutex };
+        if (registry.generation != fork_generation()) {
+            // the loggers inherited from the parent have no flusher here,
+            // they are left untouched (and leaked) on purpose.
+            registry.loggers.clear();
+            registry.generation = fork_generation();
+        }
+        auto &logger = registry.loggers[directory + file_name];
+        if (logger == nullptr) {
+            logger = new Logger { directory, file_name };
+            static const bool registered = []() {
+                std::atexit([]() { flush_all(); });
+                return true;
+            }();
+            (void) registered;
+        }
+        return logger;
+    }
+
+    /// whether the logger belongs to the current process, i.e., it has not
+    /// been inherited through `fork`.
+    auto owned() const -> bool {
+        return generation_ == fork_generation();
+    }
+
+    /// queue a line to be written, never blocks.
+    void append(LogLevel level, std::string message) {
+        auto time = std::chrono::steady_clock::now();
+        uint64_t pos { enqueue_pos_.load(std::memory_order_relaxed) };
+        Cell *cell { nullptr };
+        while (true) {
+            cell = &cells_[pos % CAPACITY];
+            uint64_t sequence { cell->sequence.load(std::memory_order_acquire) };
+            if (sequence == pos) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (sequence < pos) {
+                // full, i.e., the flusher is behind
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->entry = Entry { .time = time, .level = level, .message = std::move(message) };
+        cell->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+private:
+    struct Entry {
+        std::chrono::steady_clock::time_point time;
+        LogLevel level;
+        std::string message;
+    };
+
+    /// a slot of the ring buffer, see Dmitry Vyukov's bounded mpmc queue,
+    /// with a single consumer here.
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        Entry entry;
+    };
+
+    Logger(const std::string &directory, const std::string &file_name)
+        : directory_(directory),
+          path_(directory + file_name),
+          generation_(fork_generation()),
+          pid_(getpid()),
+          cells_(std::make_unique<Cell[]>(CAPACITY)),
+          base_wall_(std::chrono::system_clock::now()),
+          base_steady_(std::chrono::steady_clock::now()) {
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        flusher_ = std::thread { [this]() { run(); } };
+    }
+
+    /// incremented in the child on every `fork`.
+    static auto fork_generation() -> unsigned {
+        static std::atomic<unsigned> generation { 0 };
+        static const bool registered = []() {
+            pthread_atfork(nullptr, nullptr, []() {
+                generation.fetch_add(1, std::memory_order_release);
+            });
+            return true;
+        }();
+        (void) registered;
+        return generation.load(std::memory_order_acquire);
+    }
+
+    struct Registry {
+        std::mutex mutex;
+        std::unordered_map<std::string, Logger *> loggers;
+        unsigned generation;
+    };
+
+    static auto get_registry() -> Registry & {
+        static auto *registry = new Registry {};
+        return *registry;
+    }
+
+    /// write the queued lines of every logger of the current process, called
+    /// at exit (which is inherited through `fork` as well).
+    static void flush_all() {
+        auto &registry = get_registry();
+        std::lock_guard<std::mutex> lock { registry.mutex };
+        for (auto &[path, logger] : registry.loggers) {
+            if (logger->owned()) {
+                logger->stop();
+            }
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock { flusher_mutex_ };
+            if (stopping_ || !flusher_.joinable()) {
+                return;
+            }
+            stopping_ = true;
+        }
+        wake_flusher_.notify_one();
+        flusher_.join();
+    }
+
+    /// the flusher thread, i.e., drain and write until stopped.
+    void run() {
+        std::string batch {};
+        bool stopping { false };
+        while (true) {
+            batch.clear();
+            drain(batch);
+            if (!batch.empty()) {
+                write_batch(batch);
+            } else if (stopping) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock { flusher_mutex_ };
+            wake_flusher_.wait_for(lock, FLUSH_INTERVAL, [this]() { return stopping_; });
+            stopping = stopping_;
+        }
+        if (fd_ != -1) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    /// move the queued lines into `batch`, formatted.
+    void drain(std::string &batch) {
+        while (true) {
+            auto &cell = cells_[dequeue_pos_ % CAPACITY];
+            if (cell.sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1) {
+                break;
+            }
+            format(batch, cell.entry.time, cell.entry.level, cell.entry.message);
+            cell.entry.message.clear();
+            cell.sequence.store(dequeue_pos_ + CAPACITY, std::memory_order_release);
+            dequeue_pos_ += 1;
+        }
+        if (auto dropped = dropped_.exchange(0, std::memory_order_relaxed); dropped > 0) {
+            format(batch, std::chrono::steady_clock::now(), LogLevel::Error,
+                   std::to_string(dropped) + " log line(s) dropped, the logger could not keep up");
+        }
+    }
+
+    /// the timestamps are taken from the monotonic clock, and shown as the
+    /// utc wall clock time relative to when the logger was created.
+    /// note: the calendar is computed by hand, since `localtime_r`/`gmtime_r`
+    ///       take a libc lock that a forked child may inherit locked.
+    void format(std::string &batch, std::chrono::steady_clock::time_point time,
+                LogLevel level, const std::string &message) const {
+        using namespace std::chrono;
+        auto wall = base_wall_ + duration_cast<system_clock::duration>(time - base_steady_);
+        auto days = floor<std::chrono::days>(wall);
+        year_month_day date { days };
+        hh_mm_ss clock { floor<milliseconds>(wall - days) };
+        char timestamp[32];
+        std::snprintf(timestamp, sizeof(timestamp), "%04d-%02u-%02uT%02d:%02d:%02d.%03dZ",
+                      static_cast<int>(date.year()), static_cast<unsigned>(date.month()),
+                      static_cast<unsigned>(date.day()), static_cast<int>(clock.hours().count()),
+                      static_cast<int>(clock.minutes().count()), static_cast<int>(clock.seconds().count()),
+                      static_cast<int>(clock.subseconds().count()));
+
+        static constexpr const char *level_names[] { "LOG", "INFO", "ERROR" };
+        batch += std::string("[") + timestamp + "] [" + std::to_string(pid_) + "] [" +
+                 level_names[static_cast<int>(level)] + "] " + message + "\n";
+    }
+
+    void write_batch(const std::string &batch) {
+        if (fd_ == -1 || rotated_elsewhere()) {
+            reopen();
+        }
+        if (fd_ == -1) {
+            return;
+        }
+
+        struct stat info {};
+        if (fstat(fd_, &info) == 0 && static_cast<uint64_t>(info.st_size) + batch.size() > ROTATE_SIZE) {
+            rotate();
+        }
+
+        size_t written { 0 };
+        while (written < batch.size()) {
+            ssize_t n = write(fd_, batch.data() + written, batch.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n <= 0) {
+                std::fprintf(stderr, "failed to write to log file %s: %s\n", path_.c_str(), std::strerror(errno));
+                return;
+            }
+            written += n;
+        }
+    }
+
+    void reopen() {
+        if (fd_ != -1) {
+            close(fd_);
+        }
+        std::error_code ec {};
+        std::filesystem::create_directories(directory_, ec);
+        fd_ = open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ == -1) {
+            std::fprintf(stderr, "failed to open log file %s: %s\n", path_.c_str(), std::strerror(errno));
+        }
+    }
+
+    /// whether the file has been rotated by another process sharing it.
+    auto rotated_elsewhere() const -> bool {
+        struct stat by_path {};
+        struct stat by_fd {};
+        return stat(path_.c_str(), &by_path) != 0 || fstat(fd_, &by_fd) != 0 ||
+               by_path.st_ino != by_fd.st_ino || by_path.st_dev != by_fd.st_dev;
+    }
+
+    /// shift the backups, i.e., `path.1` to `path.2` and so on, unless another
+    /// process has just done it.
+    void rotate() {
+        if (flock(fd_, LOCK_EX) == 0) {
+            struct stat info {};
+            if (!rotated_elsewhere() && fstat(fd_, &info) == 0 &&
+                static_cast<uint64_t>(info.st_size) > ROTATE_SIZE / 2) {
+                for (int i = NUM_BACKUPS - 1; i >= 1; --i) {
+                    std::rename((path_ + "." + std::to_string(i)).c_str(),
+                                (path_ + "." + std::to_string(i + 1)).c_str());
+                }
+                std::rename(path_.c_str(), (path_ + ".1").c_str());
+            }
+            flock(fd_, LOCK_UN);
+        }
+        reopen();
+    }
+
+    const std::string directory_;
+    const std::string path_;
+    const unsigned generation_;
+    const pid_t pid_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<uint64_t> enqueue_pos_ { 0 };
+    std::atomic<uint64_t> dropped_ { 0 };
+    /// only used to stop the flusher.
+    std::mutex flusher_mutex_;
+    std::condition_variable wake_flusher_;
+    bool stopping_ { false };
+    /// only touched by the flusher thread.
+    uint64_t dequeue_pos_ { 0 };
+    int fd_ { -1 };
+    const std::chrono::system_clock::time_point base_wall_;
+    const std::chrono::steady_clock::time_point base_steady_;
+    std::thread flusher_;
+};
+
+#endif  // LOGGER_H
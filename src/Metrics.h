@@ -0,0 +1,269 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <utility>
+
+#include "smt/solver.h"
+
+/// the metrics of the validator server in the prometheus text format, i.e.,
+///   - the workers record the phase latencies, the smt query latencies (by
+///     query name) and the solver counters into their own slot of a shared
+///     anonymous mapping (created before the workers are forked), so that
+///     recording is a handful of uncontended atomic adds without any lock,
+///     and the counters survive the recycling of the workers.
+///   - the server itself counts the requests by command and outcome.
+///   - `render` merges all the slots on every scrape.
+/// there is no reset, the counters only grow as prometheus expects.
+class Metrics {
+public:
+    enum Phase : size_t { Parse, Translate, Exec, NumPhases };
+
+    /// the upper bounds of the histogram buckets, in seconds.
+    static constexpr std::array<double, 11> BUCKETS {
+        0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10, 30, 60
+    };
+    /// the query names beyond are recorded as "other".
+    static constexpr size_t MAX_QUERY_NAMES = 32;
+    static constexpr size_t QUERY_NAME_LENGTH = 96;
+
+    explicit Metrics(size_t num_slots) : num_slots_(num_slots) {
+        void *mapping = mmap(nullptr, sizeof(Slot) * num_slots_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED) {
+            slots_ = static_cast<Slot *>(mapping);
+        }
+    }
+
+    ~Metrics() {
+        if (slots_ != nullptr) {
+            munmap(slots_, sizeof(Slot) * num_slots_);
+        }
+    }
+
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    /// called from the worker owning `slot`.
+    void observe_phase(size_t slot, Phase phase, double seconds) const {
+        if (auto *s = get_slot(slot)) {
+            observe(s->phases[phase], seconds);
+        }
+    }
+
+    /// called from the worker owning `slot`.
+    void observe_query(size_t slot, std::string_view name, double seconds) const {
+        auto *s = get_slot(slot);
+        if (s == nullptr) {
+            return;
+        }
+        name = name.substr(0, QUERY_NAME_LENGTH - 1);
+        auto num_names = std::atomic_ref<uint32_t>(s->num_query_names).load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < num_names; ++i) {
+            if (name == s->query_names[i]) {
+                observe(s->queries[i], seconds);
+                return;
+            }
+        }
+        if (num_names == MAX_QUERY_NAMES) {
+            observe(s->other_queries, seconds);
+            return;
+        }
+        // a slot has a single writer, the name only needs to be visible
+        // before the count that publishes it.
+        std::memcpy(s->query_names[num_names], name.data(), name.size());
+        s->query_names[num_names][name.size()] = '\0';
+        observe(s->queries[num_names], seconds);
+        std::atomic_ref<uint32_t>(s->num_query_names).store(num_names + 1, std::memory_order_release);
+    }
+
+    /// called from the worker owning `slot`, with the solver counters gained
+    /// since the last call.
+    void add_solver_stats(size_t slot, const smt::SolverStats &delta) const {
+        auto *s = get_slot(slot);
+        if (s == nullptr) {
+            return;
+        }
+        auto fields = solver_fields(delta);
+        for (size_t i = 0; i < fields.size(); ++i) {
+            add(s->solver[i], fields[i].second);
+        }
+    }
+
+    /// called from the server, `outcome` is e.g. "ok" or "error".
+    void count_request(const std::string &command, const std::string &outcome) {
+        requests_[{ command, outcome }] += 1;
+    }
+
+    /// the merged metrics along with the gauges of the server.
+    auto render(size_t queue_depth, size_t busy_workers, size_t num_workers) const -> std::string {
+        std::string out {};
+        out += "# HELP validator_requests_total Requests handled by the validator server.\n"
+               "# TYPE validator_requests_total counter\n";
+        for (const auto &[key, count] : requests_) {
+            out += "validator_requests_total{command=\"" + escape(key.first) +
+                   "\",outcome=\"" + escape(key.second) + "\"} " + std::to_string(count) + "\n";
+        }
+        out += "# HELP validator_queue_depth Requests waiting for a worker.\n"
+               "# TYPE validator_queue_depth gauge\n"
+               "validator_queue_depth " + std::to_string(queue_depth) + "\n"
+               "# HELP validator_busy_workers Workers processing a request.\n"
+               "# TYPE validator_busy_workers gauge\n"
+               "validator_busy_workers " + std::to_string(busy_workers) + "\n"
+               "# HELP validator_workers Worker processes in the pool.\n"
+               "# TYPE validator_workers gauge\n"
+               "validator_workers " + std::to_string(num_workers) + "\n";
+        if (slots_ == nullptr) {
+            return out;
+        }
+
+        static constexpr std::array<const char *, NumPhases> phase_names {
+            "parse", "translate", "exec"
+        };
+        std::array<Histogram, NumPhases> phases {};
+        std::map<std::string, Histogram> queries {};
+        std::array<uint64_t, NUM_SOLVER_COUNTERS> solver {};
+        for (size_t i = 0; i < num_slots_; ++i) {
+            const auto &s = slots_[i];
+            for (size_t phase = 0; phase < NumPhases; ++phase) {
+                merge(phases[phase], s.phases[phase]);
+            }
+            auto num_names = std::atomic_ref<uint32_t>(const_cast<uint32_t &>(s.num_query_names))
+                                 .load(std::memory_order_acquire);
+            for (uint32_t j = 0; j < num_names; ++j) {
+                merge(queries[s.query_names[j]], s.queries[j]);
+            }
+            merge(queries["other"], s.other_queries);
+            for (size_t j = 0; j < NUM_SOLVER_COUNTERS; ++j) {
+                solver[j] += load(s.solver[j]);
+            }
+        }
+
+        out += "# HELP validator_phase_duration_seconds Time spent in each validation phase.\n"
+               "# TYPE validator_phase_duration_seconds histogram\n";
+        for (size_t phase = 0; phase < NumPhases; ++phase) {
+            render_histogram(out, "validator_phase_duration_seconds",
+                             std::string("phase=\"") + phase_names[phase] + "\"", phases[phase]);
+        }
+        out += "# HELP validator_smt_query_duration_seconds Time spent in the solver by query.\n"
+               "# TYPE validator_smt_query_duration_seconds histogram\n";
+        for (const auto &[name, histogram] : queries) {
+            if (histogram.count > 0) {
+                render_histogram(out, "validator_smt_query_duration_seconds",
+                                 "query=\"" + escape(name) + "\"", histogram);
+            }
+        }
+        auto fields = solver_fields({});
+        for (size_t i = 0; i < fields.size(); ++i) {
+            std::string name { std::string("validator_smt_") + fields[i].first + "_total" };
+            out += "# TYPE " + name + " counter\n" + name + " " + std::to_string(solver[i]) + "\n";
+        }
+        return out;
+    }
+
+private:
+    static constexpr size_t NUM_SOLVER_COUNTERS = 11;
+
+    struct Histogram {
+        uint64_t buckets[BUCKETS.size() + 1];
+        uint64_t count;
+        uint64_t sum_us;
+    };
+
+    struct Slot {
+        Histogram phases[NumPhases];
+        uint32_t num_query_names;
+        char query_names[MAX_QUERY_NAMES][QUERY_NAME_LENGTH];
+        Histogram queries[MAX_QUERY_NAMES];
+        Histogram other_queries;
+        uint64_t solver[NUM_SOLVER_COUNTERS];
+    };
+
+    static auto solver_fields(const smt::SolverStats &stats)
+        -> std::array<std::pair<const char *, unsigned>, NUM_SOLVER_COUNTERS> {
+        return { {
+            { "queries", stats.num_queries }, { "skips", stats.num_skips },
+            { "invalid", stats.num_invalid }, { "trivial", stats.num_trivial },
+            { "sat", stats.num_sats }, { "unsat", stats.num_unsats },
+            { "timeouts", stats.num_timeout }, { "errors", stats.num_errors },
+            { "query_cache_hits", stats.num_cache_hits }, { "query_cache_misses", stats.num_cache_misses },
+            { "timeout_escalations", stats.num_escalations }
+        } };
+    }
+
+    auto get_slot(size_t slot) const -> Slot * {
+        return slots_ == nullptr || slot >= num_slots_ ? nullptr : &slots_[slot];
+    }
+
+    static void add(uint64_t &counter, uint64_t delta) {
+        std::atomic_ref<uint64_t>(counter).fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    static auto load(const uint64_t &counter) -> uint64_t {
+        return std::atomic_ref<uint64_t>(const_cast<uint64_t &>(counter)).load(std::memory_order_relaxed);
+    }
+
+    static void observe(Histogram &histogram, double seconds) {
+        auto bucket = std::lower_bound(BUCKETS.begin(), BUCKETS.end(), seconds) - BUCKETS.begin();
+        add(histogram.buckets[bucket], 1);
+        add(histogram.count, 1);
+        add(histogram.sum_us, static_cast<uint64_t>(std::max(seconds, 0.0) * 1e6));
+    }
+
+    static void merge(Histogram &into, const Histogram &from) {
+        for (size_t i = 0; i <= BUCKETS.size(); ++i) {
+            into.buckets[i] += load(from.buckets[i]);
+        }
+        into.count += load(from.count);
+        into.sum_us += load(from.sum_us);
+    }
+
+    static void render_histogram(std::string &out, const std::string &name,
+                                 const std::string &labels, const Histogram &histogram) {
+        uint64_t cumulative { 0 };
+        for (size_t i = 0; i <= BUCKETS.size(); ++i) {
+            cumulative += histogram.buckets[i];
+            auto le = i < BUCKETS.size() ? format_number(BUCKETS[i]) : std::string("+Inf");
+            out += name + "_bucket{" + labels + ",le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+        }
+        out += name + "_sum{" + labels + "} " + format_number(histogram.sum_us / 1e6) + "\n";
+        out += name + "_count{" + labels + "} " + std::to_string(histogram.count) + "\n";
+    }
+
+    static auto format_number(double value) -> std::string {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%g", value);
+        return buffer;
+    }
+
+    /// escape a label value, i.e., the backslashes, quotes and newlines.
+    static auto escape(std::string_view value) -> std::string {
+        std::string escaped {};
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped.push_back('\\');
+                escaped.push_back(c);
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped.push_back(c);
+            }
+        }
+        return escaped;
+    }
+
+    size_t num_slots_;
+    Slot *slots_ { nullptr };
+    std::map<std::pair<std::string, std::string>, uint64_t> requests_ {};
+};
+
+#endif  // METRICS_H
@@ -0,0 +1,156 @@
+#ifndef MODULE_SLICE_H
+#define MODULE_SLICE_H
+
+#include <memory>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+/// a copy of a module with only what the given functions depend on, the same
+/// way as `llvm-extract --recursive` does, i.e.,
+///   - the functions themselves, and the functions they (transitively) call
+///     or refer to.
+///   - the global variables (along with their initializers) and the aliases
+///     referred to by any of those.
+///   - the declarations of the rest that is referred to, everything else
+///     (e.g., the core/alloc glue of a rust crate) is dropped.
+/// so that translating and verifying a function does not pay for the code
+/// around it, the names (and so the verdict fingerprints) are kept as they are.
+/// for a lazily loaded module (e.g., from bitcode), only the function bodies
+/// in the slice are materialized, throws if one of them fails to load.
+class ModuleSlice {
+public:
+    ModuleSlice(llvm::Module &module, const std::vector<llvm::Function *> &roots) {
+        check(module.materializeMetadata());
+        auto kept = collect_dependencies(roots);
+        module_ = llvm::CloneModule(module, value_map_, [&kept](const llvm::GlobalValue *value) {
+            return kept.contains(value);
+        });
+        drop_unused_declarations();
+    }
+
+    ModuleSlice(const ModuleSlice &) = delete;
+    ModuleSlice &operator=(const ModuleSlice &) = delete;
+
+    auto module() -> llvm::Module & {
+        return *module_;
+    }
+
+    /// the copy of `func`, which must be one of the roots, in the slice.
+    auto get(const llvm::Function &func) -> llvm::Function & {
+        return *llvm::cast<llvm::Function>(value_map_[&func]);
+    }
+
+private:
+    static void check(llvm::Error error) {
+        if (error) {
+            throw std::runtime_error("failed to load the module: " + llvm::toString(std::move(error)));
+        }
+    }
+
+    /// the definitions reachable from `roots` through the instruction
+    /// operands, the initializers and the aliasees, the functions are
+    /// materialized as they are reached.
+    static auto collect_dependencies(const std::vector<llvm::Function *> &roots)
+        -> std::unordered_set<const llvm::GlobalValue *> {
+        std::unordered_set<const llvm::GlobalValue *> kept {};
+        std::unordered_set<llvm::Constant *> visited {};
+        std::vector<llvm::GlobalValue *> worklist {};
+        std::vector<llvm::Constant *> constants {};
+
+        auto visit = [&](llvm::Value *value) {
+            auto *constant = llvm::dyn_cast_or_null<llvm::Constant>(value);
+            if (constant == nullptr || !visited.insert(constant).second) {
+                return;
+            }
+            if (auto *global = llvm::dyn_cast<llvm::GlobalValue>(constant)) {
+                // note: a function yet to be materialized is not a declaration
+                if (!global->isDeclaration()) {
+                    kept.insert(global);
+                    worklist.push_back(global);
+                }
+            } else {
+                constants.push_back(constant);
+            }
+        };
+
+        for (auto *root : roots) {
+            visit(root);
+        }
+        while (!worklist.empty() || !constants.empty()) {
+            if (!constants.empty()) {
+                auto *constant = constants.back();
+                constants.pop_back();
+                for (auto &operand : constant->operands()) {
+                    visit(operand);
+                }
+                continue;
+            }
+
+            auto *global = worklist.back();
+            worklist.pop_back();
+            if (auto *func = llvm::dyn_cast<llvm::Function>(global)) {
+                check(func->materialize());
+                if (func->hasPersonalityFn()) {
+                    visit(func->getPersonalityFn());
+                }
+                if (func->hasPrefixData()) {
+                    visit(func->getPrefixData());
+                }
+                if (func->hasPrologueData()) {
+                    visit(func->getPrologueData());
+                }
+                for (auto &inst : llvm::instructions(*func)) {
+                    for (auto &operand : inst.operands()) {
+                        visit(operand);
+                    }
+                }
+            } else if (auto *var = llvm::dyn_cast<llvm::GlobalVariable>(global)) {
+                visit(var->getInitializer());
+            } else if (auto *alias = llvm::dyn_cast<llvm::GlobalAlias>(global)) {
+                visit(alias->getAliasee());
+            } else if (auto *ifunc = llvm::dyn_cast<llvm::GlobalIFunc>(global)) {
+                visit(ifunc->getResolver());
+            }
+        }
+        return kept;
+    }
+
+    /// `CloneModule` keeps a declaration for everything that is not cloned,
+    /// the ones that nothing refers to are dropped.
+    void drop_unused_declarations() {
+        for (auto &func : llvm::make_early_inc_range(module_->functions())) {
+            func.removeDeadConstantUsers();
+            if (func.isDeclaration() && func.use_empty()) {
+                func.eraseFromParent();
+            }
+        }
+        for (auto &var : llvm::make_early_inc_range(module_->globals())) {
+            var.removeDeadConstantUsers();
+            if (var.isDeclaration() && var.use_empty()) {
+                var.eraseFromParent();
+            }
+        }
+        for (auto &ifunc : llvm::make_early_inc_range(module_->ifuncs())) {
+            if (ifunc.use_empty()) {
+                ifunc.eraseFromParent();
+            }
+        }
+    }
+
+    llvm::ValueToValueMapTy value_map_;
+    std::unique_ptr<llvm::Module> module_;
+};
+
+#endif  // MODULE_SLICE_H
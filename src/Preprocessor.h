@@ -1,10 +1,18 @@
 #ifndef PREPROCESSOR_H
 #define PREPROCESSOR_H
 
+#include <algorithm>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <pwd.h>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 #include "Printer.h"
@@ -18,14 +26,37 @@ const std::string RUST_IR_SUFFIX = "_rs.ll";
 const std::string FIXED_CPP_IR_SUFFIX = "_cpp_fixed.ll";
 const std::string FIXED_RUST_IR_SUFFIX = "_rs_fixed.ll";
 
+/// the directory of the smt query cache when `--smt-query-cache` is given
+/// without one, shared with the `ValidatorServer` if it is pointed there.
+const auto DEFAULT_SMT_QUERY_CACHE_DIR = []() {
+    const char* home = getenv("HOME");
+    if (!home) {
+        home = getpwuid(getuid())->pw_dir;
+    }
+    return std::string(home) + "/.translation_validator/smt_query_cache/";
+}();
+
+/// the part of the time limit of a batch pair (in seconds) left to the
+/// parsing and the translation by the default smt time budget.
+constexpr unsigned BATCH_TIME_MARGIN = 5;
+
 static std::string cpp_path_;
 static std::string rust_path_;
 
+/// a cpp/rust ir pair to be validated in the batch mode.
+struct IrPair {
+    std::string name;
+    std::string cpp_path;
+    std::string rust_path;
+    std::string cpp_func_name;
+    std::string rust_func_name;
+};
+
 class Preprocessor {
 public:
     Preprocessor(int argc, char *argv[]) {
-        if (argc < 2 || argc > 5) {
-            printer_.print_error("preprocessor expects at least 2 and at most 5 arguments");
+        if (argc < 2 || argc > 17) {
+            printer_.print_error("preprocessor expects at least 2 and at most 17 arguments");
             exit(EXIT_FAILURE);
         }
         for (int i = 1; i < argc; ++i) {
@@ -34,19 +65,53 @@ public:
                 // parse the option
                 if (str_arg == "--fixed") {
                     is_fixed_ = true;
+                } else if (str_arg == "--incremental") {
+                    is_incremental_ = true;
                 } else if (str_arg.starts_with("--cpp-func")) {
                     cpp_func_name_ = str_arg.substr(11);
                     use_specified_function_name_ = true;
                 } else if (str_arg.starts_with("--rust-func")) {
                     rust_func_name_ = str_arg.substr(12);
                     use_specified_function_name_ = true;
+                } else if (str_arg == "--batch" || str_arg.starts_with("--batch=")) {
+                    // `--batch` alone validates every pair in `examples/ir/`
+                    is_batch_ = true;
+                    batch_input_ = str_arg == "--batch" ? "" : str_arg.substr(8);
+                } else if (str_arg.starts_with("--jobs=")) {
+                    num_jobs_ = parse_number(str_arg, str_arg.substr(7), 1);
+                } else if (str_arg.starts_with("--smt-portfolio=")) {
+                    smt_portfolio_ = parse_number(str_arg, str_arg.substr(16), 1);
+                } else if (str_arg.starts_with("--smt-parallel-queries=")) {
+                    smt_parallel_queries_ = parse_number(str_arg, str_arg.substr(23), 1);
+                } else if (str_arg.starts_with("--smt-incremental=")) {
+                    std::stringstream names { str_arg.substr(18) };
+                    for (std::string name; std::getline(names, name, ',');) {
+                        smt_incremental_.push_back(name);
+                    }
+                } else if (str_arg.starts_with("--smt-time-budget=")) {
+                    smt_time_budget_ = parse_number(str_arg, str_arg.substr(18), 0);
+                } else if (str_arg.starts_with("--smt-profile=")) {
+                    smt_profile_ = str_arg.substr(14);
+                } else if (str_arg == "--smt-query-cache" || str_arg.starts_with("--smt-query-cache=")) {
+                    smt_query_cache_ = str_arg == "--smt-query-cache" ? DEFAULT_SMT_QUERY_CACHE_DIR
+                                                                       : str_arg.substr(18);
+                } else if (str_arg.starts_with("--batch-timeout=")) {
+                    batch_timeout_ = parse_number(str_arg, str_arg.substr(16), 0);
+                } else if (str_arg == "--pairing=demangled" || str_arg == "--pairing=signature") {
+                    pairing_ = str_arg.substr(10);
+                } else if (str_arg.starts_with("--pairing-map=")) {
+                    pairing_ = "mapping";
+                    pairing_map_ = str_arg.substr(14);
                 } else {
                     printer_.print_error("unknown option: " + str_arg);
                     exit(EXIT_FAILURE);
                 }
             } else {
                 // the base name of the ir files, e.g., `add`.
-                if (base_name_.empty()) {
+                if (is_batch_) {
+                    printer_.print_error("the base name is not expected in batch mode");
+                    exit(EXIT_FAILURE);
+                } else if (base_name_.empty()) {
                     base_name_ = str_arg;
                 } else {
                     printer_.print_error("expect only one base name");
@@ -54,6 +119,11 @@ public:
                 }
             }
         }
+        if (!pairing_.empty() && (use_specified_function_name_ || is_batch_)) {
+            printer_.print_error("`--pairing` and `--pairing-map` cannot be combined with "
+                                 "the function names or the batch mode");
+            exit(EXIT_FAILURE);
+        }
     }
 
     auto process(std::vector<char *> &argv) -> bool {
@@ -62,23 +132,7 @@ public:
             exit(EXIT_FAILURE);
         }
 
-        if (is_fixed_) {
-            // probe for both fixed and original ir files
-            cpp_path_ = FIXED_IR_DIR + base_name_ + "/" + base_name_ + FIXED_CPP_IR_SUFFIX;
-            rust_path_ = FIXED_IR_DIR + base_name_ + "/" + base_name_ + FIXED_RUST_IR_SUFFIX;
-            if (!std::filesystem::exists(cpp_path_)) {
-                // fallback to the original ir files
-                cpp_path_ = DEFAULT_IR_DIR + base_name_ + "/" + base_name_ + CPP_IR_SUFFIX;
-            }
-            if (!std::filesystem::exists(rust_path_)) {
-                // same here
-                rust_path_ = DEFAULT_IR_DIR + base_name_ + "/" + base_name_ + RUST_IR_SUFFIX;
-            }
-        } else {
-            // only probe for the original ir files
-            cpp_path_ = DEFAULT_IR_DIR + base_name_ + "/" + base_name_ + CPP_IR_SUFFIX;
-            rust_path_ = DEFAULT_IR_DIR + base_name_ + "/" + base_name_ + RUST_IR_SUFFIX;
-        }
+        std::tie(cpp_path_, rust_path_) = resolve_ir_paths(base_name_);
 
         argv.push_back(&cpp_path_[0]);
         argv.push_back(&rust_path_[0]);
@@ -95,7 +149,197 @@ public:
         return use_specified_function_name_;
     }
 
+    /// how all the functions in the ir files are paired up and verified, i.e.,
+    /// `demangled`, `signature`, or `mapping` (see `PairingMode`), empty if
+    /// only a single pair is verified.
+    auto pairing() -> std::string {
+        return pairing_;
+    }
+
+    /// the mapping file for the `mapping` pairing.
+    auto pairing_map() -> std::string {
+        return pairing_map_;
+    }
+
+    /// whether the verdicts of the previous runs are reused for the unchanged
+    /// function pairs (see `VerdictStore`).
+    auto is_incremental() -> bool {
+        return is_incremental_;
+    }
+
+    auto is_batch() -> bool {
+        return is_batch_;
+    }
+
+    /// the maximum number of pairs validated concurrently in batch mode or
+    /// with the `--pairing` options.
+    auto num_jobs() -> unsigned {
+        return num_jobs_;
+    }
+
+    /// the time limit (in seconds) for validating a single pair in batch mode,
+    /// 0 means no limit.
+    auto batch_timeout() -> unsigned {
+        return batch_timeout_;
+    }
+
+    /// the number of solver configurations raced on each smt query (see
+    /// `smt::solver_set_portfolio`), 1 means no racing.
+    auto smt_portfolio() -> unsigned {
+        return smt_portfolio_;
+    }
+
+    /// the number of independent refinement queries solved at once (see
+    /// `smt::QueryBatch`), 1 means one after another.
+    auto smt_parallel_queries() -> unsigned {
+        return smt_parallel_queries_;
+    }
+
+    /// the smt queries (by name, or "all") checked under push/pop on a solver
+    /// shared by the refinement checks of a function (see
+    /// `smt::solver_set_incremental`), none by default.
+    auto smt_incremental() -> const std::vector<std::string> & {
+        return smt_incremental_;
+    }
+
+    /// the time budget (in ms) of the smt queries of a validation (see
+    /// `smt::solver_set_time_budget`), 0 means no budget. by default, only a
+    /// pair of the batch mode has one, i.e., its time limit minus a margin for
+    /// the parsing and the translation, so that it reports its remaining
+    /// queries as timeouts instead of nothing.
+    auto smt_time_budget() -> unsigned {
+        if (smt_time_budget_) {
+            return *smt_time_budget_;
+        } else if (is_batch_ && batch_timeout_ > BATCH_TIME_MARGIN) {
+            return (batch_timeout_ - BATCH_TIME_MARGIN) * 1000;
+        }
+        return 0;
+    }
+
+    /// the json file to write the smt query profile to (see `SmtProfile.h`),
+    /// empty if disabled.
+    auto smt_profile() -> const std::string & {
+        return smt_profile_;
+    }
+
+    /// the directory of the smt query cache (see `smt::solver_set_query_cache`),
+    /// empty if disabled.
+    auto smt_query_cache() -> const std::string & {
+        return smt_query_cache_;
+    }
+
+    /// collect the ir pairs to be validated in batch mode, the batch input is
+    /// either,
+    ///   - empty, i.e., every `<name>/<name>_cpp.ll` + `<name>/<name>_rs.ll`
+    ///     pair in `examples/ir/` (respecting `--fixed` the same way as the
+    ///     single pair mode does).
+    ///   - a directory laid out the same way as `examples/ir/`.
+    ///   - a manifest file, each line of which is either a base name in
+    ///     `examples/ir/`, or `<cpp_ir_path> <rust_ir_path>` optionally followed
+    ///     by `<cpp_function_name> <rust_function_name>`, lines starting with
+    ///     `#` are ignored.
+    /// note: the pairs with missing ir files are kept and reported by the caller.
+    auto collect_batch_pairs() -> std::vector<IrPair> {
+        std::vector<IrPair> pairs {};
+        if (batch_input_.empty() || std::filesystem::is_directory(batch_input_)) {
+            std::string ir_dir { batch_input_.empty() ? DEFAULT_IR_DIR : batch_input_ };
+            if (!ir_dir.ends_with("/")) {
+                ir_dir += "/";
+            }
+            if (!std::filesystem::is_directory(ir_dir)) {
+                printer_.print_error("ir directory not found: " + str_path(ir_dir));
+                exit(EXIT_FAILURE);
+            }
+
+            std::vector<std::string> names {};
+            for (const auto &entry : std::filesystem::directory_iterator(ir_dir)) {
+                if (entry.is_directory()) {
+                    names.push_back(entry.path().filename().string());
+                }
+            }
+            std::sort(names.begin(), names.end());
+
+            for (const auto &name : names) {
+                auto [cpp_path, rust_path] = resolve_ir_paths(name, ir_dir);
+                pairs.push_back(IrPair { .name = name, .cpp_path = cpp_path, .rust_path = rust_path });
+            }
+            return pairs;
+        }
+
+        std::ifstream manifest(batch_input_);
+        if (!manifest) {
+            printer_.print_error("batch input not found: " + str_path(batch_input_));
+            exit(EXIT_FAILURE);
+        }
+
+        std::string line {};
+        size_t line_number { 0 };
+        while (std::getline(manifest, line)) {
+            line_number += 1;
+            std::stringstream line_stream { line };
+            std::vector<std::string> fields {};
+            for (std::string field {}; line_stream >> field; ) {
+                fields.push_back(field);
+            }
+            if (fields.empty() || fields[0].starts_with("#")) {
+                continue;
+            }
+
+            if (fields.size() == 1) {
+                auto [cpp_path, rust_path] = resolve_ir_paths(fields[0]);
+                pairs.push_back(IrPair { .name = fields[0], .cpp_path = cpp_path, .rust_path = rust_path });
+            } else if (fields.size() == 2 || fields.size() == 4) {
+                pairs.push_back(IrPair {
+                    .name = std::filesystem::path(fields[0]).stem().string(),
+                    .cpp_path = fields[0],
+                    .rust_path = fields[1],
+                    .cpp_func_name = fields.size() == 4 ? fields[2] : "",
+                    .rust_func_name = fields.size() == 4 ? fields[3] : ""
+                });
+            } else {
+                printer_.print_error("malformed manifest line " + std::to_string(line_number) +
+                                     " in " + str_path(batch_input_) + ": " + line);
+                exit(EXIT_FAILURE);
+            }
+        }
+        return pairs;
+    }
+
 private:
+    /// resolve the cpp and rust ir paths of `base_name` in `ir_dir`, when
+    /// `--fixed` is specified, the ir files in `examples/ir_fixed/` are
+    /// preferred and the original ones are used as the fallback.
+    auto resolve_ir_paths(const std::string &base_name,
+                          const std::string &ir_dir = DEFAULT_IR_DIR)
+        -> std::pair<std::string, std::string> {
+        std::string cpp_path { ir_dir + base_name + "/" + base_name + CPP_IR_SUFFIX };
+        std::string rust_path { ir_dir + base_name + "/" + base_name + RUST_IR_SUFFIX };
+        if (is_fixed_) {
+            // probe for both fixed and original ir files
+            auto fixed_cpp_path = FIXED_IR_DIR + base_name + "/" + base_name + FIXED_CPP_IR_SUFFIX;
+            auto fixed_rust_path = FIXED_IR_DIR + base_name + "/" + base_name + FIXED_RUST_IR_SUFFIX;
+            if (std::filesystem::exists(fixed_cpp_path)) {
+                cpp_path = fixed_cpp_path;
+            }
+            if (std::filesystem::exists(fixed_rust_path)) {
+                rust_path = fixed_rust_path;
+            }
+        }
+        return { cpp_path, rust_path };
+    }
+
+    auto parse_number(const std::string &arg, const std::string &value,
+                      unsigned minimum) -> unsigned {
+        try {
+            auto number = std::stoul(value);
+            if (number >= minimum) {
+                return static_cast<unsigned>(number);
+            }
+        } catch (const std::exception &) {}
+        printer_.print_error("expect a number no less than " + std::to_string(minimum) + ": " + arg);
+        exit(EXIT_FAILURE);
+    }
+
     auto check_ir_file_exists(const std::string &path,
                               bool is_cpp,
                               bool is_fixed = false) -> bool {
@@ -131,6 +375,19 @@ private:
     std::string rust_func_name_ { "" };
     bool use_specified_function_name_ { false };
     bool is_fixed_ { false };
+    bool is_incremental_ { false };
+    bool is_batch_ { false };
+    std::string batch_input_ { "" };
+    unsigned num_jobs_ { std::max(1u, std::thread::hardware_concurrency()) };
+    unsigned batch_timeout_ { 60 };
+    std::optional<unsigned> smt_time_budget_ {};
+    unsigned smt_portfolio_ { 1 };
+    unsigned smt_parallel_queries_ { 1 };
+    std::vector<std::string> smt_incremental_ {};
+    std::string smt_profile_ { "" };
+    std::string smt_query_cache_ { "" };
+    std::string pairing_ { "" };
+    std::string pairing_map_ { "" };
     Printer printer_ { std::cout, "preprocessor" };
 };
 
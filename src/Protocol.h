@@ -0,0 +1,355 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+/// the framing used between the relay server and the validator server, and
+/// between the validator server and its workers, i.e., every message is a
+/// fixed-size binary header followed by the payload,
+///   | magic (4 bytes) | kind (4 bytes) | request id (8 bytes) | payload length (8 bytes) | payload |
+/// where the integers are in network byte order (i.e., big-endian).
+/// the request id is chosen by the sender of a request and echoed in its
+/// response (and the progress events before it), so many requests could be in
+/// flight on the same (persistent) connection and the responses may arrive in
+/// any order.
+/// the payload of a request is a sequence of fields (see `write_fields`),
+/// e.g., the command name followed by the IRs and the function names, so the
+/// receiver could refer to every field within the received payload directly.
+namespace protocol {
+
+/// "TVF1", i.e., translation validator frame, version 1.
+constexpr uint32_t FRAME_MAGIC = 0x54564631;
+constexpr size_t FRAME_HEADER_SIZE = 24;
+/// a sanity limit to reject garbage headers rather than a protocol limit,
+/// the receivers of untrusted frames pass their own (see `FrameReader`).
+constexpr uint64_t MAX_PAYLOAD_SIZE = uint64_t { 64 } << 20;
+/// the payloads are received in chunks of this size, so that the memory held
+/// for a frame grows with the bytes received rather than with the length
+/// claimed by its header.
+constexpr size_t READ_CHUNK_SIZE = 64 * 1024;
+
+enum class FrameKind : uint32_t {
+    /// a request, or the final response to it.
+    Message = 0,
+    /// a progress event of an in-flight request, i.e., a single-line json.
+    Event = 1,
+    /// ask for an in-flight request to be cancelled, its response is
+    /// "cancelled" if it has not completed yet.
+    Cancel = 2
+};
+
+struct Frame {
+    FrameKind kind { FrameKind::Message };
+    uint64_t request_id { 0 };
+    std::string payload {};
+};
+
+inline void store_be(unsigned char *buffer, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        buffer[size - 1 - i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+inline auto load_be(const unsigned char *buffer, size_t size) -> uint64_t {
+    uint64_t value { 0 };
+    for (size_t i = 0; i < size; ++i) {
+        value = (value << 8) | buffer[i];
+    }
+    return value;
+}
+
+/// read exactly `length` bytes, returns false on eof or error.
+inline auto read_exact(int fd, char *buffer, size_t length) -> bool {
+    size_t n { 0 };
+    while (n < length) {
+        ssize_t bytes_read = read(fd, buffer + n, length - n);
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes_read <= 0) {
+            return false;
+        }
+        n += static_cast<size_t>(bytes_read);
+    }
+    return true;
+}
+
+/// the payload length of a header, or nothing if the header is malformed or
+/// the payload is larger than `max_payload_size`.
+inline auto parse_header(const unsigned char *header, uint64_t max_payload_size)
+    -> std::optional<uint64_t> {
+    const auto length = load_be(header + 16, 8);
+    if (load_be(header, 4) != FRAME_MAGIC ||
+        load_be(header + 4, 4) > static_cast<uint32_t>(FrameKind::Cancel) ||
+        length > max_payload_size) {
+        return std::nullopt;
+    }
+    return length;
+}
+
+/// read a whole frame from a blocking fd, returns false on eof, error, or a
+/// malformed header.
+inline auto read_frame(int fd, Frame &frame, uint64_t max_payload_size = MAX_PAYLOAD_SIZE) -> bool {
+    unsigned char header[FRAME_HEADER_SIZE] {};
+    if (!read_exact(fd, reinterpret_cast<char *>(header), FRAME_HEADER_SIZE)) {
+        return false;
+    }
+    const auto length = parse_header(header, max_payload_size);
+    if (!length) {
+        return false;
+    }
+    frame.kind = static_cast<FrameKind>(load_be(header + 4, 4));
+    frame.request_id = load_be(header + 8, 8);
+    frame.payload.clear();
+    while (frame.payload.size() < *length) {
+        const auto offset = frame.payload.size();
+        frame.payload.resize(offset + std::min<uint64_t>(*length - offset, READ_CHUNK_SIZE));
+        if (!read_exact(fd, frame.payload.data() + offset, frame.payload.size() - offset)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// the frames received on a non-blocking fd, assembled from the bytes as they
+/// arrive (e.g., whenever the fd is reported readable by epoll), so that a
+/// peer sending a partial frame never blocks the receiver.
+class FrameReader {
+public:
+    explicit FrameReader(uint64_t max_payload_size = MAX_PAYLOAD_SIZE)
+        : max_payload_size_(max_payload_size) {}
+
+    /// read what is available on `fd` (at most up to the end of a whole
+    /// frame), and append the whole frames received so far to `frames`.
+    /// returns false on eof, error, or a malformed (or oversized) header,
+    /// i.e., the fd should be closed after the appended frames are handled.
+    auto receive(int fd, std::vector<Frame> &frames) -> bool {
+        bool open { true };
+        char chunk[READ_CHUNK_SIZE];
+        while (!malformed_ && next_frame_size() == 0) {
+            ssize_t bytes_read = read(fd, chunk, sizeof(chunk));
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            } else if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else if (bytes_read <= 0) {
+                open = false;
+                break;
+            }
+            buffer_.append(chunk, static_cast<size_t>(bytes_read));
+        }
+
+        size_t offset { 0 };
+        while (auto size = next_frame_size(offset)) {
+            const auto *header = reinterpret_cast<const unsigned char *>(buffer_.data() + offset);
+            frames.push_back(Frame {
+                .kind = static_cast<FrameKind>(load_be(header + 4, 4)),
+                .request_id = load_be(header + 8, 8),
+                .payload = buffer_.substr(offset + FRAME_HEADER_SIZE, size - FRAME_HEADER_SIZE)
+            });
+            offset += size;
+        }
+        buffer_.erase(0, offset);
+        return open && !malformed_;
+    }
+
+private:
+    /// the size of the whole frame at `offset` of the buffer, i.e., 0 if it
+    /// is not completely received yet (or malformed, see `malformed_`).
+    auto next_frame_size(size_t offset = 0) -> size_t {
+        if (buffer_.size() - offset < FRAME_HEADER_SIZE) {
+            return 0;
+        }
+        const auto length = parse_header(
+            reinterpret_cast<const unsigned char *>(buffer_.data() + offset), max_payload_size_);
+        if (!length) {
+            malformed_ = true;
+            return 0;
+        }
+        return buffer_.size() - offset - FRAME_HEADER_SIZE < *length
+            ? 0 : FRAME_HEADER_SIZE + static_cast<size_t>(*length);
+    }
+
+    uint64_t max_payload_size_;
+    std::string buffer_ {};
+    bool malformed_ { false };
+};
+
+/// fill in the header of a frame.
+inline void store_header(unsigned char *header, uint64_t request_id, uint64_t length,
+                         FrameKind kind) {
+    store_be(header, FRAME_MAGIC, 4);
+    store_be(header + 4, static_cast<uint32_t>(kind), 4);
+    store_be(header + 8, request_id, 8);
+    store_be(header + 16, length, 8);
+}
+
+/// send `message` until all of it is sent, or the (non-blocking) fd would
+/// block, in which case `message` is left with what remains to be sent.
+/// returns false on error.
+inline auto send_message(int fd, struct msghdr &message) -> bool {
+    while (message.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        } else if (sent < 0) {
+            return false;
+        }
+        // skip what has been sent
+        auto remaining = static_cast<size_t>(sent);
+        while (message.msg_iovlen > 0 && remaining >= message.msg_iov->iov_len) {
+            remaining -= message.msg_iov->iov_len;
+            message.msg_iov += 1;
+            message.msg_iovlen -= 1;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + remaining;
+            message.msg_iov->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+/// write a whole frame whose payload is the concatenation of `parts` to a
+/// blocking fd, the header and the parts are sent with a single `sendmsg`
+/// whenever possible (i.e., without copying the payload).
+inline auto write_frame_parts(int fd, uint64_t request_id, std::span<const std::string_view> parts,
+                              FrameKind kind = FrameKind::Message) -> bool {
+    uint64_t length { 0 };
+    for (auto part : parts) {
+        length += part.size();
+    }
+    unsigned char header[FRAME_HEADER_SIZE] {};
+    store_header(header, request_id, length, kind);
+
+    std::vector<struct iovec> iov {};
+    iov.reserve(parts.size() + 1);
+    iov.push_back({ .iov_base = header, .iov_len = FRAME_HEADER_SIZE });
+    for (auto part : parts) {
+        iov.push_back({ .iov_base = const_cast<char *>(part.data()), .iov_len = part.size() });
+    }
+    struct msghdr message {};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = iov.size();
+    return send_message(fd, message) && message.msg_iovlen == 0;
+}
+
+/// write a whole frame, see `write_frame_parts`.
+inline auto write_frame(int fd, uint64_t request_id, std::string_view payload,
+                        FrameKind kind = FrameKind::Message) -> bool {
+    return write_frame_parts(fd, request_id, { &payload, 1 }, kind);
+}
+
+/// the frames sent on a non-blocking fd, i.e., what could not be sent right
+/// away is kept (in order) until `flush` is called once the fd is writable,
+/// so that a peer not reading its responses never blocks the sender.
+class FrameWriter {
+public:
+    /// send (or queue) a whole frame, returns false on error.
+    auto send(int fd, uint64_t request_id, std::string_view payload,
+              FrameKind kind = FrameKind::Message) -> bool {
+        unsigned char header[FRAME_HEADER_SIZE] {};
+        store_header(header, request_id, payload.size(), kind);
+        if (!pending_.empty()) {
+            pending_.append(reinterpret_cast<const char *>(header), FRAME_HEADER_SIZE);
+            pending_.append(payload);
+            return true;
+        }
+
+        struct iovec iov[2] {
+            { .iov_base = header, .iov_len = FRAME_HEADER_SIZE },
+            { .iov_base = const_cast<char *>(payload.data()), .iov_len = payload.size() }
+        };
+        struct msghdr message {};
+        message.msg_iov = iov;
+        message.msg_iovlen = 2;
+        if (!send_message(fd, message)) {
+            return false;
+        }
+        for (size_t i = 0; i < message.msg_iovlen; ++i) {
+            pending_.append(static_cast<const char *>(message.msg_iov[i].iov_base),
+                            message.msg_iov[i].iov_len);
+        }
+        return true;
+    }
+
+    /// send what has been queued, returns false on error, in which case the
+    /// queued frames are dropped.
+    auto flush(int fd) -> bool {
+        struct iovec iov { .iov_base = pending_.data(), .iov_len = pending_.size() };
+        struct msghdr message {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = pending_.empty() ? 0 : 1;
+        if (!send_message(fd, message)) {
+            pending_.clear();
+            return false;
+        }
+        pending_.erase(0, pending_.size() - (message.msg_iovlen > 0 ? iov.iov_len : 0));
+        return true;
+    }
+
+    /// whether some frames are waiting for the fd to be writable.
+    auto pending() const -> bool {
+        return !pending_.empty();
+    }
+
+private:
+    std::string pending_ {};
+};
+
+/// the size of the length prefix of a field.
+constexpr size_t FIELD_LENGTH_SIZE = 8;
+
+/// write a request made of `fields`, each of which is encoded as,
+///   | length (8 bytes) | bytes | '\0' |
+/// i.e., the fields are sent right from where they are, and the terminator
+/// lets the receiver hand a field to the apis expecting a null-terminated
+/// buffer (e.g., the llvm ir parser) without copying it.
+inline auto write_fields(int fd, uint64_t request_id, std::span<const std::string_view> fields) -> bool {
+    static constexpr char terminator[1] { '\0' };
+    std::vector<unsigned char> lengths(fields.size() * FIELD_LENGTH_SIZE);
+    std::vector<std::string_view> parts {};
+    parts.reserve(fields.size() * 3);
+    for (size_t i = 0; i < fields.size(); ++i) {
+        auto *length = lengths.data() + i * FIELD_LENGTH_SIZE;
+        store_be(length, fields[i].size(), FIELD_LENGTH_SIZE);
+        parts.emplace_back(reinterpret_cast<const char *>(length), FIELD_LENGTH_SIZE);
+        parts.push_back(fields[i]);
+        parts.emplace_back(terminator, 1);
+    }
+    return write_frame_parts(fd, request_id, parts);
+}
+
+/// split a payload written by `write_fields` into `fields`, which refer to
+/// `payload` (and are followed by a '\0' each), returns false if malformed.
+inline auto parse_fields(std::string_view payload, std::vector<std::string_view> &fields) -> bool {
+    fields.clear();
+    while (!payload.empty()) {
+        if (payload.size() < FIELD_LENGTH_SIZE) {
+            return false;
+        }
+        auto length = load_be(reinterpret_cast<const unsigned char *>(payload.data()), FIELD_LENGTH_SIZE);
+        payload.remove_prefix(FIELD_LENGTH_SIZE);
+        if (length >= payload.size() || payload[length] != '\0') {
+            return false;
+        }
+        fields.push_back(payload.substr(0, length));
+        payload.remove_prefix(length + 1);
+    }
+    return true;
+}
+
+}  // namespace protocol
+
+#endif  // PROTOCOL_H
@@ -0,0 +1,298 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/SHA256.h"
+
+#include "Printer.h"
+
+/// a local, persistent and content-addressed result store, i.e.,
+///   - each entry lives in its own file named by the sha256 of the key parts,
+///     i.e., `<cache_dir>/entries/<first two hex digits>/<hex digest>`.
+///   - entries are written to a temporary file first and then renamed, so
+///     concurrent readers/writers (the forked workers) never see partial data.
+///   - the last write time of an entry is refreshed on every hit, once the
+///     total size exceeds `size_limit` the least recently used entries are
+///     evicted until the cache is back to 90% of the limit.
+///   - the counters live in a small shared mapping of `<cache_dir>/stats`, so
+///     that every process sharing the cache directory sees the same numbers.
+/// a `size_limit` of zero disables the cache entirely.
+class ResultCache {
+public:
+    struct Counters {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;
+        uint64_t bytes;
+    };
+
+    ResultCache(std::string cache_dir, uint64_t size_limit, const Printer &printer)
+        : cache_dir_(std::move(cache_dir)), size_limit_(size_limit), printer_(printer) {
+        if (size_limit_ == 0) {
+            return;
+        }
+
+        std::error_code ec {};
+        std::filesystem::create_directories(entries_dir(), ec);
+        if (ec && !std::filesystem::exists(entries_dir())) {
+            printer_.print_error("failed to create result cache directory: " +
+                                 entries_dir().string() + ", result cache disabled", true);
+            size_limit_ = 0;
+            return;
+        }
+
+        // map the shared counters, the file is zero-filled on creation.
+        auto stats_path = cache_dir_ / "stats";
+        int fd { open(stats_path.c_str(), O_RDWR | O_CREAT, 0644) };
+        if (fd == -1 || ftruncate(fd, sizeof(Counters)) == -1) {
+            printer_.print_error("failed to open result cache stats: " +
+                                 std::string(std::strerror(errno)) + ", result cache disabled", true);
+            if (fd != -1) {
+                close(fd);
+            }
+            size_limit_ = 0;
+            return;
+        }
+        void *mapping = mmap(nullptr, sizeof(Counters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            printer_.print_error("failed to map result cache stats: " +
+                                 std::string(std::strerror(errno)) + ", result cache disabled", true);
+            size_limit_ = 0;
+            return;
+        }
+        counters_ = static_cast<Counters *>(mapping);
+    }
+
+    ~ResultCache() {
+        if (counters_ != nullptr) {
+            munmap(counters_, sizeof(Counters));
+        }
+    }
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    auto enabled() const -> bool {
+        return size_limit_ > 0;
+    }
+
+    /// compute the key for the given parts, each part is length-prefixed so
+    /// that moving bytes between adjacent parts changes the key.
+    static auto make_key(std::initializer_list<std::string_view> parts) -> std::string {
+        llvm::SHA256 hasher {};
+        for (const auto &part : parts) {
+            hasher.update(std::to_string(part.size()) + ":");
+            hasher.update(llvm::StringRef(part.data(), part.size()));
+        }
+        return llvm::toHex(hasher.final(), /*LowerCase=*/true);
+    }
+
+    /// look up the entry for `key`, returns true and fills `value` on a hit.
+    auto lookup(const std::string &key, std::string &value) const -> bool {
+        if (!enabled()) {
+            return false;
+        }
+
+        auto path = entry_path(key);
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            bump(&Counters::misses, 1);
+            return false;
+        }
+
+        std::stringstream content {};
+        content << file.rdbuf();
+        value = std::move(content).str();
+
+        // refresh the entry for the lru eviction
+        std::error_code ec {};
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        bump(&Counters::hits, 1);
+        return true;
+    }
+
+    /// store `value` under `key`, overwriting any existing entry.
+    void insert(const std::string &key, const std::string &value) const {
+        if (!enabled() || value.size() > size_limit_) {
+            return;
+        }
+
+        auto path = entry_path(key);
+        std::error_code ec {};
+        std::filesystem::create_directories(path.parent_path(), ec);
+
+        auto tmp_path = path;
+        tmp_path += ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+            file << value;
+            if (!file) {
+                std::filesystem::remove(tmp_path, ec);
+                printer_.print_error("failed to write result cache entry: " + path.string(), true);
+                return;
+            }
+        }
+        std::filesystem::rename(tmp_path, path, ec);
+        if (ec) {
+            std::filesystem::remove(tmp_path, ec);
+            return;
+        }
+
+        bump(&Counters::insertions, 1);
+        if (bump(&Counters::bytes, value.size()) > size_limit_) {
+            evict();
+        }
+    }
+
+    auto counters() const -> Counters {
+        if (counters_ == nullptr) {
+            return {};
+        }
+        auto load = [this](uint64_t Counters::*field) {
+            return std::atomic_ref<uint64_t>(counters_->*field).load(std::memory_order_relaxed);
+        };
+        return Counters {
+            .hits = load(&Counters::hits),
+            .misses = load(&Counters::misses),
+            .insertions = load(&Counters::insertions),
+            .evictions = load(&Counters::evictions),
+            .bytes = load(&Counters::bytes)
+        };
+    }
+
+    /// a short human-readable summary of the counters, used for logging.
+    auto describe_counters() const -> std::string {
+        auto c = counters();
+        return "hits: " + std::to_string(c.hits) + ", misses: " + std::to_string(c.misses) +
+               ", entries written: " + std::to_string(c.insertions) +
+               ", evictions: " + std::to_string(c.evictions) +
+               ", size: " + std::to_string(c.bytes) + "/" + std::to_string(size_limit_) + " bytes";
+    }
+
+    /// strip the parts of a textual llvm ir that do not affect its semantics,
+    /// i.e., the module id and source file name (which contain the temporary
+    /// file names), comments, blank lines and trailing whitespace.
+    /// bitcode (raw or wrapped, see `llvm::isBitcode`) is kept as it is.
+    static auto normalize_ir(std::string_view ir) -> std::string {
+        if (ir.starts_with("BC\xC0\xDE") || ir.starts_with("\xDE\xC0\x17\x0B")) {
+            return std::string(ir);
+        }
+        std::string normalized {};
+        normalized.reserve(ir.size());
+        while (!ir.empty()) {
+            auto end = ir.find('\n');
+            auto line = ir.substr(0, end);
+            ir = end == std::string_view::npos ? std::string_view {} : ir.substr(end + 1);
+
+            while (!line.empty() && std::isspace(static_cast<unsigned char>(line.back()))) {
+                line.remove_suffix(1);
+            }
+            if (line.empty() || line.starts_with(";") || line.starts_with("source_filename = ")) {
+                continue;
+            }
+            normalized.append(line);
+            normalized.push_back('\n');
+        }
+        return normalized;
+    }
+
+private:
+    auto entries_dir() const -> std::filesystem::path {
+        return cache_dir_ / "entries";
+    }
+
+    auto entry_path(const std::string &key) const -> std::filesystem::path {
+        return entries_dir() / key.substr(0, 2) / key;
+    }
+
+    /// atomically add `delta` to the shared counter, returns the new value.
+    auto bump(uint64_t Counters::*field, uint64_t delta) const -> uint64_t {
+        if (counters_ == nullptr) {
+            return 0;
+        }
+        return std::atomic_ref<uint64_t>(counters_->*field).fetch_add(delta) + delta;
+    }
+
+    /// remove the least recently used entries until the cache is back to 90%
+    /// of its size limit. only one process evicts at a time, the others simply
+    /// skip the eviction while the lock is held.
+    void evict() const {
+        auto lock_path = cache_dir_ / "lock";
+        int fd { open(lock_path.c_str(), O_RDWR | O_CREAT, 0644) };
+        if (fd == -1) {
+            return;
+        }
+        struct FileGuard {
+            int fd;
+            ~FileGuard() { close(fd); }
+        } guard { fd };
+        if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+            return;
+        }
+
+        using Entry = std::tuple<std::filesystem::file_time_type, std::filesystem::path, uint64_t>;
+        std::vector<Entry> entries {};
+        uint64_t total { 0 };
+        std::error_code ec {};
+        for (auto it = std::filesystem::recursive_directory_iterator(entries_dir(), ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec) || it->path().filename().string().find(".tmp.") != std::string::npos) {
+                continue;
+            }
+            auto size = it->file_size(ec);
+            auto time = it->last_write_time(ec);
+            if (ec) {
+                ec.clear();
+                continue;
+            }
+            entries.emplace_back(time, it->path(), size);
+            total += size;
+        }
+        std::sort(entries.begin(), entries.end());
+
+        const uint64_t target { size_limit_ / 10 * 9 };
+        uint64_t evicted { 0 };
+        for (const auto &[time, path, size] : entries) {
+            if (total <= target) {
+                break;
+            }
+            if (std::filesystem::remove(path, ec)) {
+                total -= size;
+                evicted += 1;
+            }
+        }
+
+        // resynchronize the size counter with what is actually on disk
+        std::atomic_ref<uint64_t>(counters_->bytes).store(total);
+        bump(&Counters::evictions, evicted);
+        printer_.log("result cache evicted " + std::to_string(evicted) + " entries");
+    }
+
+    std::filesystem::path cache_dir_;
+    uint64_t size_limit_;
+    const Printer &printer_;
+    Counters *counters_ { nullptr };
+};
+
+#endif  // RESULT_CACHE_H
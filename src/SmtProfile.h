@@ -0,0 +1,72 @@
+#ifndef SMT_PROFILE_H
+#define SMT_PROFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "smt/solver.h"
+#include "llvm/Support/JSON.h"
+
+/// the smt queries recorded since the last call (see `smt::solver_set_profile`)
+/// as json, i.e., one object per query with its name, result, wall time, what
+/// answered it (z3, a portfolio configuration, or the query cache), the size of
+/// its formula (the distinct terms and the widest bit-vector), and the
+/// statistics of z3.
+inline auto take_smt_profile() -> llvm::json::Array {
+    llvm::json::Array queries {};
+    for (auto &query : smt::solver_take_profile()) {
+        llvm::json::Object z3_stats {};
+        for (const auto &[key, value] : query.z3_stats) {
+            z3_stats[key] = value;
+        }
+        queries.push_back(llvm::json::Object {
+            { "query", query.name.empty() ? "unnamed" : query.name },
+            { "result", query.result },
+            { "source", query.source },
+            { "ms", query.ms },
+            { "num_nodes", static_cast<int64_t>(query.num_nodes) },
+            { "max_bits", static_cast<int64_t>(query.max_bits) },
+            { "z3_stats", std::move(z3_stats) }
+        });
+    }
+    return queries;
+}
+
+/// the totals of `queries` (see `take_smt_profile`) by query name, i.e., the
+/// count, the total and the maximum wall time, and the largest formula.
+inline auto summarize_smt_profile(const llvm::json::Array &queries) -> llvm::json::Object {
+    struct Total {
+        int64_t count { 0 };
+        double total_ms { 0 };
+        double max_ms { 0 };
+        int64_t max_nodes { 0 };
+    };
+    std::map<std::string, Total> totals {};
+    for (const auto &value : queries) {
+        const auto *query = value.getAsObject();
+        if (query == nullptr) {
+            continue;
+        }
+        auto &total = totals[query->getString("query").value_or("unnamed").str()];
+        double ms { query->getNumber("ms").value_or(0) };
+        total.count += 1;
+        total.total_ms += ms;
+        total.max_ms = std::max(total.max_ms, ms);
+        total.max_nodes = std::max(total.max_nodes, query->getInteger("num_nodes").value_or(0));
+    }
+
+    llvm::json::Object summary {};
+    for (const auto &[name, total] : totals) {
+        summary[name] = llvm::json::Object {
+            { "count", total.count },
+            { "total_ms", total.total_ms },
+            { "max_ms", total.max_ms },
+            { "max_nodes", total.max_nodes }
+        };
+    }
+    return summary;
+}
+
+#endif  // SMT_PROFILE_H
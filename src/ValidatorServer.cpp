@@ -1,15 +1,24 @@
 #include "ValidatorServer.h"
 
+#include <algorithm>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/epoll.h>
 #include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/time.h>
+#include <thread>
 
 #include "llvm_util/compare.h"
 #include "llvm_util/llvm2alive.h"
 #include "llvm_util/llvm_optimizer.h"
 #include "llvm_util/utils.h"
 #include "smt/smt.h"
+#include "smt/solver.h"
 
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Bitcode/BitcodeReader.h"
@@ -20,6 +29,8 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/TargetParser/Triple.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -34,8 +45,8 @@ using namespace std;
 
 constexpr auto CPP_MANGLING_PREFIX = "_Z";
 constexpr auto RUST_MANGLING_PREFIX = "_ZN";
-constexpr auto SRC_UB_PROMPT = "WARNING: Source function is always UB";
-/// the temporary storage to store the intermediate ir files
+/// the temporary storage to store the intermediate source files, and the ir
+/// files when `--keep-ir-files` is specified for debugging.
 constexpr auto TMP_STORAGE_PREFIX = "/tmp/__validator_server__/";
 /// the storage to store the logs for validator server
 const auto LOG_STORAGE_PREFIX = []() {
@@ -47,8 +58,29 @@ const auto LOG_STORAGE_PREFIX = []() {
     return std::string(home) + "/.translation_validator/validator_server/logs/";
 }();
 constexpr auto LOG_FILE_DEFAULT_NAME = "validator_server.log";
-/// the limit for the size of the generated IR files, currently set to 50000 bytes.
-constexpr auto IR_FILE_SIZE_LIMIT = 50000;
+/// the storage to store the cached validation results
+const auto CACHE_STORAGE_PREFIX = []() {
+    const char* home = getenv("HOME");
+    if (!home) {
+        // fallback to passwd entry if HOME is not set
+        home = getpwuid(getuid())->pw_dir;
+    }
+    return std::string(home) + "/.translation_validator/validator_server/cache/";
+}();
+/// the limit for the size of the generated IR files, currently set to 2000000 bytes.
+/// note: only the compared functions and their dependencies are translated
+///       (see `ModuleSlice`), so the glue code generated along with them
+///       (e.g., the rust core/alloc instantiations) mostly costs the parsing.
+constexpr auto IR_FILE_SIZE_LIMIT = 2000000;
+/// the limit for the payload of a request from the relay server, i.e., two
+/// IRs (or sources) of at most `IR_FILE_SIZE_LIMIT` bytes each along with the
+/// command, the function names and the framing of the fields.
+constexpr uint64_t MAX_REQUEST_SIZE = 2 * IR_FILE_SIZE_LIMIT + 64 * 1024;
+/// the cpu time (in seconds) a job may use before its worker is killed by
+/// `SIGXCPU`, and the part of it left to the parsing and the translation by
+/// the default time budget of the smt queries, see `job_smt_time_budget`.
+constexpr unsigned JOB_CPU_LIMIT = 30;
+constexpr unsigned JOB_CPU_MARGIN = 5;
 
 namespace {
 
@@ -66,32 +98,102 @@ llvm::cl::opt<std::string> opt_rust_pattern {
     llvm::cl::init(RUST_MANGLING_PREFIX)
 };
 
-}  // namespace
+/// the number of pre-forked worker processes, i.e., the maximum number of
+/// requests being processed concurrently.
+llvm::cl::opt<unsigned> opt_pool_size {
+    "pool-size",
+    llvm::cl::desc("number of pre-forked validator worker processes (default=4)"),
+    llvm::cl::init(4)
+};
 
-/// a simple RAII wrapper for a client socket
-class ClientSocket {
-    public:
-        explicit ClientSocket(int fd) : fd_(fd) {}
-        ~ClientSocket() { if (fd_ >= 0) close(fd_); }
-        
-        // Prevent copying
-        ClientSocket(const ClientSocket&) = delete;
-        ClientSocket& operator=(const ClientSocket&) = delete;
-        
-        int get() const { return fd_; }
-    private:
-        int fd_;
+/// the number of requests waiting for a worker when all of them are busy,
+/// the requests beyond are rejected with the "overloaded" response right away.
+llvm::cl::opt<unsigned> opt_max_queued_jobs {
+    "max-queued-jobs",
+    llvm::cl::desc("number of requests allowed to wait for a busy worker pool (default=32)"),
+    llvm::cl::init(32)
 };
 
-ValidatorServer::ValidatorServer(int port) 
+/// the number of requests a worker serves before being replaced by a fresh one,
+/// note: values larger than 1 trade the per-request isolation for throughput.
+llvm::cl::opt<unsigned> opt_recycle_after {
+    "recycle-after",
+    llvm::cl::desc("number of requests served by a worker before it is recycled (default=1)"),
+    llvm::cl::init(1)
+};
+
+/// the IRs are parsed from memory directly, this keeps a copy of the received
+/// IRs in the temporary storage for debugging purposes.
+llvm::cl::opt<bool> opt_keep_ir_files {
+    "keep-ir-files",
+    llvm::cl::desc("keep the received IRs in the temporary storage for debugging (default=false)"),
+    llvm::cl::init(false)
+};
+
+/// whether every job ends with an "smt_profile" progress event, i.e., the smt
+/// queries it has run, see `take_smt_profile`.
+llvm::cl::opt<bool> opt_smt_profile {
+    "smt-profile",
+    llvm::cl::desc("report the profile of the smt queries of every request in its progress events (default=false)"),
+    llvm::cl::init(false)
+};
+
+/// the size limit of the on-disk validation result cache, 0 disables it.
+llvm::cl::opt<unsigned> opt_result_cache_size {
+    "result-cache-size",
+    llvm::cl::desc("size limit of the validation result cache in MB, 0 to disable (default=256)"),
+    llvm::cl::init(256)
+};
+
+/// the size limit of the on-disk per-function verdict store (see
+/// `VerdictStore`), 0 disables it.
+llvm::cl::opt<unsigned> opt_verdict_cache_size {
+    "verdict-cache-size",
+    llvm::cl::desc("size limit of the per-function verdict cache in MB, 0 to disable (default=256)"),
+    llvm::cl::init(256)
+};
+
+/// the size limit of the on-disk compile cache (see `CompileCache`), 0
+/// disables it.
+llvm::cl::opt<unsigned> opt_compile_cache_size {
+    "compile-cache-size",
+    llvm::cl::desc("size limit of the generated IR cache in MB, 0 to disable (default=256)"),
+    llvm::cl::init(256)
+};
+
+/// the time budget (in ms) of the smt queries of a job (see
+/// `smt::solver_set_time_budget`), i.e., `--smt-time-budget`, or by default
+/// the cpu time limit of a job minus the margin, shared by the threads the
+/// solver may run at once, so that a long validation reports its remaining
+/// queries as timeouts (i.e., "failed to prove") instead of getting killed.
+auto job_smt_time_budget() -> unsigned {
+    if (opt_smt_time_budget.getNumOccurrences() > 0) {
+        return opt_smt_time_budget;
+    }
+    unsigned threads { std::max(1u, opt_smt_portfolio.getValue()) *
+                       std::max(1u, opt_smt_parallel_queries.getValue()) };
+    return (JOB_CPU_LIMIT - JOB_CPU_MARGIN) * 1000 / threads;
+}
+
+}  // namespace
+
+ValidatorServer::ValidatorServer(int port, size_t pool_size, size_t recycle_after,
+                                 size_t max_queued_jobs, uint64_t result_cache_size,
+                                 uint64_t verdict_cache_size, uint64_t compile_cache_size)
     : port_(port)
     , printer_(std::cout, "validator_server",
                LOG_STORAGE_PREFIX, LOG_FILE_DEFAULT_NAME)
-    , server_fd_(socket(AF_INET, SOCK_STREAM, 0))
+    , pool_(pool_size, recycle_after, max_queued_jobs, printer_)
+    , metrics_(pool_.pool_size())
+    , result_cache_(CACHE_STORAGE_PREFIX, result_cache_size, printer_)
+    , verdict_store_(std::make_unique<VerdictStore>(verdict_cache_size, printer_))
+    , compile_cache_(compile_cache_size, printer_)
+    , server_fd_(socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0))
     , address_ {
         .sin_family = AF_INET,
         .sin_port = htons(port),
-        .sin_addr = { .s_addr = INADDR_ANY }
+        // only the relay server (on the same host) talks to the validator server
+        .sin_addr = { .s_addr = htonl(INADDR_LOOPBACK) }
     }
 {
     if (server_fd_ < 0) {
@@ -108,11 +210,19 @@ ValidatorServer::ValidatorServer(int port)
 
 ValidatorServer::~ValidatorServer() {
     close(server_fd_);
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+    if (signal_fd_ >= 0) {
+        close(signal_fd_);
+    }
 }
 
 void ValidatorServer::start() {
-    bind(server_fd_, (struct sockaddr *) &address_, sizeof(address_));
-    listen(server_fd_, 3);
+    if (listen(server_fd_, SOMAXCONN) < 0) {
+        printer_.print_error("failed to listen on port " + std::to_string(port_), true);
+        exit(EXIT_FAILURE);
+    }
     printer_.print_info("validator server running at: " +
                       std::string("http://127.0.0.1:") + std::to_string(port_) + std::string("/"),
                       true);
@@ -129,206 +239,501 @@ void ValidatorServer::start() {
         }
     }
 
-    while (true) {
-        struct sockaddr_in client_addr {};
-        socklen_t client_len = sizeof(client_addr);
-        int client_socket = accept(server_fd_, (struct sockaddr*) &client_addr, &client_len);
+    // the exited workers are reaped through a signalfd instead of a signal
+    // handler, so that it happens in the event loop below.
+    sigset_t sigchld {};
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &sigchld, nullptr);
+    signal_fd_ = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd_ < 0 || epoll_fd_ < 0) {
+        printer_.print_error("failed to set up the event loop: " +
+                             std::string(std::strerror(errno)), true);
+        exit(EXIT_FAILURE);
+    }
+    watch(server_fd_, true);
+    watch(signal_fd_, true);
+
+    // the compilers are identified once here instead of once per request,
+    // an unknown compiler simply bypasses the compile cache.
+    if (compile_cache_.enabled()) {
+        clang_identity_ = CompileCache::identify("clang++");
+        rustc_identity_ = CompileCache::identify("rustc");
+    }
 
-        if (client_socket < 0) {
-            printer_.print_error("failed to accept client connection", true);
+    // the workers are forked after the setup above so that they inherit it
+    pool_.start(
+        [this](int channel, size_t slot) { run_worker(channel, slot); },
+        [this](int channel, bool opened) { watch(channel, opened); },
+        [this](uint64_t job_id, double wait_ms) {
+            if (wait_ms >= 1) {
+                printer_.log("job " + std::to_string(job_id) + " started after waiting " +
+                             std::to_string(static_cast<int64_t>(wait_ms)) + "ms, " +
+                             std::to_string(pool_.queue_depth() - 1) + " job(s) still queued");
+            }
+            send_event(job_id, llvm::json::Object { { "phase", "started" }, { "wait_ms", wait_ms } });
+        },
+        [this](int channel, bool pending) { watch_output(channel, pending); });
+
+    // the relay server keeps its connections open and sends many requests on
+    // each of them, the requests are handed to the workers as they arrive and
+    // the responses are sent back in the order they complete.
+    std::vector<epoll_event> events(64);
+    while (true) {
+        int num_events = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), -1);
+        if (num_events < 0) {
+            if (errno != EINTR) {
+                printer_.print_error("failed to wait for events: " +
+                                     std::string(std::strerror(errno)), true);
+            }
             continue;
         }
 
-        printer_.log("accepted client connection from socket " + std::to_string(client_socket));
-        recv_and_process_relay_server_request(client_socket);
+        for (int i = 0; i < num_events; ++i) {
+            // the fds closed while handling the previous events are no longer
+            // watched, but may still have been reported in this batch
+            int fd = events[i].data.fd;
+            const bool readable = events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR);
+            if (!watched_.contains(fd)) {
+                continue;
+            } else if (fd == server_fd_) {
+                accept_connection();
+            } else if (fd == signal_fd_) {
+                struct signalfd_siginfo info {};
+                while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {}
+                pool_.reap();
+            } else if (connections_.contains(fd)) {
+                if (events[i].events & EPOLLOUT) {
+                    flush_connection(fd);
+                }
+                if (readable && connections_.contains(fd)) {
+                    read_requests(fd);
+                }
+            } else {
+                if (events[i].events & EPOLLOUT) {
+                    pool_.flush(fd);
+                }
+                if (readable) {
+                    for (const auto &response : pool_.collect(fd)) {
+                        send_response(response);
+                    }
+                }
+            }
+        }
     }
 }
 
-void read_until_length(int client_socket, char *buffer, size_t length) {
-    size_t n { 0 };
-    while (n < length) {
-        size_t bytes_read = read(client_socket, buffer + n, length - n);
-        if (bytes_read == 0) {
-            throw std::runtime_error("connection closed by client");
+void ValidatorServer::watch(int fd, bool enable) {
+    if (enable) {
+        epoll_event event { .events = EPOLLIN, .data = { .fd = fd } };
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+            printer_.print_error("failed to watch fd " + std::to_string(fd) + ": " +
+                                 std::strerror(errno), true);
+            return;
         }
-        n += bytes_read;
-    }
-}
-
-/// the protocol between messages sent from the relay server is,
-/// :: <length><blankspace><message>
-/// where <length> is the exact length of the <message>.
-bool read_relay_message(int client_socket, std::string &buffer) {
-    constexpr auto MAX_LENGTH_BUFFER_SIZE = 8;
-    // first read the length of the message
-    size_t n { 0 };
-    char length_buffer[MAX_LENGTH_BUFFER_SIZE + 1] { 0 };
-
-    while ((read(client_socket, length_buffer + n, 1)) > 0) {
-        if (length_buffer[n] == ' ') {
-            // calculate the length of the message
-            size_t length = std::atoi(length_buffer);
-            // make sure the buffer has enough space to hold the message
-            buffer.resize(length);
-            // read the rest of the message until the length is reached
-            read_until_length(client_socket, buffer.data(), length);
-            break;
-        } else if (!isdigit(length_buffer[n])) {
-            // malformed message
+        watched_.insert(fd);
+    } else {
+        // removed explicitly (before the fd is closed), as the forked workers
+        // may briefly hold copies of it
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        watched_.erase(fd);
+    }
+}
+
+void ValidatorServer::watch_output(int fd, bool enable) {
+    epoll_event event { .events = EPOLLIN | (enable ? EPOLLOUT : 0u), .data = { .fd = fd } };
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+        printer_.print_error("failed to watch fd " + std::to_string(fd) + ": " +
+                             std::strerror(errno), true);
+    }
+}
+
+void ValidatorServer::accept_connection() {
+    struct sockaddr_in client_addr {};
+    socklen_t client_len = sizeof(client_addr);
+    int client_socket = accept4(server_fd_, (struct sockaddr*) &client_addr, &client_len,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (client_socket < 0) {
+        // e.g., the connection has been reset before being accepted
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            printer_.print_error("failed to accept client connection", true);
+        }
+        return;
+    }
+
+    printer_.log("accepted client connection from socket " + std::to_string(client_socket));
+    connections_.emplace(client_socket, Connection {
+        .reader = protocol::FrameReader { MAX_REQUEST_SIZE },
+        .writer = {}
+    });
+    watch(client_socket, true);
+}
+
+void ValidatorServer::close_connection(int connection) {
+    printer_.log("closed client connection on socket " + std::to_string(connection));
+    watch(connection, false);
+    close(connection);
+    connections_.erase(connection);
+    // nobody is left to reply to, so the jobs of the connection are cancelled
+    // as on a Cancel frame, the queued ones right away
+    std::erase_if(jobs_, [this, connection](const auto &job) {
+        if (job.second.connection != connection) {
             return false;
-        } else {
-            n += 1;
-            if (n >= MAX_LENGTH_BUFFER_SIZE) {
-                // length buffer overflow
-                return false;
+        }
+        pool_.cancel(job.first);
+        return true;
+    });
+}
+
+void ValidatorServer::read_requests(int connection) {
+    std::vector<protocol::Frame> requests {};
+    const bool open = connections_.at(connection).reader.receive(connection, requests);
+    for (auto &request : requests) {
+        handle_request(connection, std::move(request));
+    }
+    if (!open) {
+        // the relay server has closed the connection (or sent garbage)
+        close_connection(connection);
+    }
+}
+
+void ValidatorServer::handle_request(int connection, protocol::Frame request) {
+    if (request.kind == protocol::FrameKind::Cancel) {
+        auto job = std::find_if(jobs_.begin(), jobs_.end(), [&](const auto &job) {
+            return job.second.connection == connection &&
+                   job.second.request_id == request.request_id;
+        });
+        if (job != jobs_.end()) {
+            if (auto response = pool_.cancel(job->first)) {
+                send_response(*response);
             }
         }
+        return;
     }
 
-    return true;
+    // only the command name is looked at here, the payload is handed to the
+    // worker as it is, and parsed again there (see `process_relay_command`).
+    std::vector<std::string_view> fields {};
+    if (!protocol::parse_fields(request.payload, fields) || fields.empty()) {
+        printer_.print_error("malformed request " + std::to_string(request.request_id), true);
+        send_frame(connection, request.request_id, "error");
+        return;
+    }
+    if (fields[0] == "METRICS") {
+        // answered by the server itself, there is nothing for a worker to do
+        send_frame(connection, request.request_id,
+                   metrics_.render(pool_.queue_depth(), pool_.busy_workers(), pool_.pool_size()));
+        return;
+    }
+
+    const auto job_id = next_job_id_++;
+    jobs_[job_id] = Job {
+        .connection = connection,
+        .request_id = request.request_id,
+        .command = std::string(fields[0].substr(0, 16))
+    };
+    if (!pool_.submit(job_id, std::move(request.payload))) {
+        printer_.print_error("rejected request " + std::to_string(request.request_id) +
+                             ", " + std::to_string(pool_.queue_depth()) +
+                             " job(s) already queued", true);
+        send_response(protocol::Frame { .request_id = job_id, .payload = "overloaded" });
+    } else if (jobs_.contains(job_id) && pool_.queue_depth() > 0) {
+        // not started yet, i.e., all the workers are busy
+        send_event(job_id, llvm::json::Object {
+            { "phase", "queued" },
+            { "queue_depth", static_cast<int64_t>(pool_.queue_depth()) }
+        });
+    }
 }
 
-void ValidatorServer::recv_and_process_relay_server_request(int client_socket) {
-    // the fork here is to isolate the alive2 verifier environment with the
-    // validator server, i.e., a single, isolated process will be used to handle
-    // each individual validation/generate request, this is needed because alive2's
-    // verifier has its own "bug" that will cause mysterious segmentation faults
-    // if running the `llvm_util::Verifier::compareFunctions` multiple times in
-    // the same process.
-    pid_t pid = fork();
-    if (pid < 0) {
-        printer_.print_error("failed to fork process for client request", true);
-        exit(EXIT_FAILURE);
-    } else if (pid == 0) {
-        try {
-            #ifdef __APPLE__
-                // skip setting memory limit on macOS as it requires root privileges..
-                printer_.print_info("skipping setting memory limit on macOS", true);
-            #else
-                // set resource limits for the current child process to prevent
-                // overwhelming/crashing/OOMing the validator server.
-                struct rlimit mem_limit {
-                    // 512 MB soft limit
-                    .rlim_cur = static_cast<rlim_t>(512 * 1024 * 1024),
-                    // 1 GB hard limit
-                    .rlim_max = static_cast<rlim_t>(1024 * 1024 * 1024)
-                };
-
-                if (setrlimit(RLIMIT_AS, &mem_limit) != 0) {
-                    printer_.print_error("failed to set memory limit for child process: " +
-                                       std::to_string(pid) + "; error: " + std::strerror(errno), true);
-                    exit(EXIT_FAILURE);
-                }
-            #endif
-
-            // set the CPU time limit for the child process for all platforms
-            struct rlimit cpu_limit {
-                // 30 seconds CPU time
-                .rlim_cur = 30,
-                // 60 seconds hard limit
-                .rlim_max = 60
-            };
-            if (setrlimit(RLIMIT_CPU, &cpu_limit) != 0) {
-                printer_.print_error("failed to set CPU limit for child process: " +
-                                   std::to_string(pid) + "; error: " + std::strerror(errno), true);
-                exit(EXIT_FAILURE);
-            }
+void ValidatorServer::send_event(uint64_t job_id, llvm::json::Object event) {
+    std::string payload {};
+    llvm::raw_string_ostream os { payload };
+    os << llvm::json::Value(std::move(event));
+    send_response(protocol::Frame {
+        .kind = protocol::FrameKind::Event,
+        .request_id = job_id,
+        .payload = std::move(os.str())
+    });
+}
 
-            ClientSocket socket(client_socket);
+void ValidatorServer::send_response(const protocol::Frame &response) {
+    auto job = jobs_.find(response.request_id);
+    if (job == jobs_.end()) {
+        return;
+    }
+    auto [connection, request_id, command] = job->second;
+    if (response.kind != protocol::FrameKind::Event) {
+        const auto &payload = response.payload;
+        metrics_.count_request(command, payload == "error" || payload == "cancelled" ||
+                                        payload == "overloaded" ? payload : "ok");
+        jobs_.erase(job);
+    }
 
-            // read the command from the relay server
-            auto command = [this, &socket, pid]() -> std::string {
-                std::string buffer;
-                if (!read_relay_message(socket.get(), buffer)) {
-                    printer_.print_error("failed to read message from client for child process: " +
-                                       std::to_string(pid), true);
-                    exit(EXIT_FAILURE);
-                }
-                return buffer;
-            }();
-
-            // process the command and get the result
-            const auto result = [this, &command]() -> std::string {
-                if (command.starts_with("VALIDATE")) {
-                    return handle_validate_command(command);
-                } else if (command.starts_with("GENERATE")) {
-                    return handle_generate_command(command);
-                }
-                printer_.print_error("unknown command received: " + command, true);
-                exit(EXIT_FAILURE);
-            }();
-
-            // send response back to relay server
-            const auto response = std::to_string(result.length()) + " " + result;
-            if (send(socket.get(), response.c_str(), response.length(), 0) < 0) {
-                printer_.print_error("failed to send response for child process: " +
-                                   std::to_string(pid), true);
-            }
+    send_frame(connection, request_id, response.payload, response.kind);
+}
 
-            exit(EXIT_SUCCESS);
-        } catch (const std::exception &e) {
-            printer_.print_error("child process error: " + std::string(e.what()) +
-                                 "; pid: " + std::to_string(pid), true);
-            exit(EXIT_FAILURE);
-        }
-    } else {
-        // parent process simply returns
+void ValidatorServer::send_frame(int connection, uint64_t request_id, std::string_view payload,
+                                 protocol::FrameKind kind) {
+    auto it = connections_.find(connection);
+    if (it == connections_.end()) {
         return;
     }
+    auto &writer = it->second.writer;
+    const bool was_pending = writer.pending();
+    if (!writer.send(connection, request_id, payload, kind)) {
+        // the connection is closed once its eof (or error) is read
+        printer_.print_error("failed to send response for request " +
+                             std::to_string(request_id), true);
+    } else if (!was_pending && writer.pending()) {
+        watch_output(connection, true);
+    }
 }
 
-auto ValidatorServer::handle_validate_command(const std::string &command) const -> std::string {
-    static const std::string cpp_ir_separator { "__CPPIR__" };
-    static const std::string rust_ir_separator { "__RUSTIR__" };
-    static const std::string cpp_function_name_separator { "__CPP_FUNCTION__" };
-    static const std::string rust_function_name_separator { "__RUST_FUNCTION__" };
+void ValidatorServer::flush_connection(int connection) {
+    auto &writer = connections_.at(connection).writer;
+    if (!writer.flush(connection)) {
+        printer_.print_error("failed to send responses on socket " + std::to_string(connection), true);
+        close_connection(connection);
+    } else if (!writer.pending()) {
+        watch_output(connection, false);
+    }
+}
 
-    const auto pos1 = command.find(cpp_ir_separator);
-    const auto pos2 = command.find(rust_ir_separator, pos1 + cpp_ir_separator.length());
-    const auto pos3 = command.find(cpp_function_name_separator, pos2 + rust_ir_separator.length());
-    const auto pos4 = command.find(rust_function_name_separator, pos3 + cpp_function_name_separator.length());
+void ValidatorServer::run_worker(int channel, size_t slot) {
+    const auto pid = getpid();
 
-    if (pos1 == std::string::npos || pos2 == std::string::npos || pos3 == std::string::npos || pos4 == std::string::npos) {
-        printer_.print_error("invalid validate command format", true);
+    // the worker only talks through its channel, and waits for its own
+    // children (e.g., the compilers) as usual.
+    close(server_fd_);
+    close(epoll_fd_);
+    close(signal_fd_);
+    for (const auto &[connection, _] : connections_) {
+        close(connection);
+    }
+    sigset_t sigchld {};
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &sigchld, nullptr);
+
+    #ifdef __APPLE__
+        // skip setting memory limit on macOS as it requires root privileges..
+        printer_.print_info("skipping setting memory limit on macOS", true);
+    #else
+        // set resource limits for the current worker process to prevent
+        // overwhelming/crashing/OOMing the validator server.
+        struct rlimit mem_limit {
+            // 512 MB soft limit
+            .rlim_cur = static_cast<rlim_t>(512 * 1024 * 1024),
+            // 1 GB hard limit
+            .rlim_max = static_cast<rlim_t>(1024 * 1024 * 1024)
+        };
+
+        if (setrlimit(RLIMIT_AS, &mem_limit) != 0) {
+            printer_.print_error("failed to set memory limit for worker process: " +
+                               std::to_string(pid) + "; error: " + std::strerror(errno), true);
+            exit(EXIT_FAILURE);
+        }
+    #endif
+
+    // the CPU time limit is accounted for the whole lifetime of a process, so
+    // the hard limit covers every job the worker may serve (twice the limit of
+    // a job each), and the soft limit is moved forward before each job.
+    const auto cpu_hard_limit = static_cast<rlim_t>(2 * JOB_CPU_LIMIT * pool_.recycle_after());
+    struct rlimit cpu_limit {
+        .rlim_cur = std::min<rlim_t>(JOB_CPU_LIMIT, cpu_hard_limit),
+        .rlim_max = cpu_hard_limit
+    };
+    if (setrlimit(RLIMIT_CPU, &cpu_limit) != 0) {
+        printer_.print_error("failed to set CPU limit for worker process: " +
+                           std::to_string(pid) + "; error: " + std::strerror(errno), true);
         exit(EXIT_FAILURE);
     }
 
-    const auto cpp_ir = command.substr(pos1 + cpp_ir_separator.length(),
-                                     pos2 - pos1 - cpp_ir_separator.length());
-    const auto rust_ir = command.substr(pos2 + rust_ir_separator.length(),
-                                      pos3 - pos2 - rust_ir_separator.length());
-    const auto cpp_function_name = command.substr(pos3 + cpp_function_name_separator.length(),
-                                                 pos4 - pos3 - cpp_function_name_separator.length());
-    const auto rust_function_name = command.substr(pos4 + rust_function_name_separator.length());
+    // warm up the worker before any request arrives
+    smt_initializer_ = std::make_unique<smt::smt_initializer>();
+
+    // report every smt query of the current job as a progress event
+    event_channel_ = channel;
+    worker_slot_ = slot;
+    smt::solver_set_query_observer([this](const char *query_name, const smt::Result *result,
+                                          double solver_ms) {
+        std::string query { query_name ? query_name : "unnamed" };
+        if (result == nullptr) {
+            emit_progress(llvm::json::Object { { "phase", "query_started" }, { "query", query } });
+            return;
+        }
+        metrics_.observe_query(worker_slot_, query, solver_ms / 1000);
+        phase_mark_ = std::chrono::steady_clock::now();
+        emit_progress(llvm::json::Object {
+            { "phase", "query_finished" },
+            { "query", query },
+            { "result", result->isSat()     ? "sat"
+                      : result->isUnsat()   ? "unsat"
+                      : result->isTimeout() ? "timeout"
+                      : result->isSkip()    ? "skip"
+                      : result->isInvalid() ? "invalid"
+                                            : "error" },
+            { "solver_ms", solver_ms },
+            { "solver", smt::solver_last_winner() ? smt::solver_last_winner() : "default" }
+        });
+    });
+
+    protocol::Frame job {};
+    while (WorkerPool::receive_job(channel, job)) {
+        current_job_id_ = job.request_id;
+        job_start_ = std::chrono::steady_clock::now();
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        cpu_limit.rlim_cur = std::min<rlim_t>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + JOB_CPU_LIMIT,
+                                              cpu_hard_limit);
+        setrlimit(RLIMIT_CPU, &cpu_limit);
+        smt::solver_set_time_budget(job_smt_time_budget());
+
+        auto response = process_relay_command(job.payload);
+        if (auto queries = take_smt_profile(); !queries.empty()) {
+            emit_progress(llvm::json::Object { { "phase", "smt_profile" }, { "queries", std::move(queries) } });
+        }
+
+        // the solver counters are per process, only the new ones are added
+        auto stats = smt::solver_stats();
+        const auto &last = recorded_solver_stats_;
+        metrics_.add_solver_stats(worker_slot_, smt::SolverStats {
+            stats.num_queries - last.num_queries, stats.num_skips - last.num_skips,
+            stats.num_invalid - last.num_invalid, stats.num_trivial - last.num_trivial,
+            stats.num_sats - last.num_sats, stats.num_unsats - last.num_unsats,
+            stats.num_timeout - last.num_timeout, stats.num_errors - last.num_errors,
+            stats.num_cache_hits - last.num_cache_hits, stats.num_cache_misses - last.num_cache_misses,
+            stats.num_escalations - last.num_escalations
+        });
+        recorded_solver_stats_ = stats;
+
+        WorkerPool::finish_job(channel, job.request_id, response);
+    }
 
-    return handle_validate_request(cpp_ir, rust_ir, cpp_function_name, rust_function_name);
+    smt_initializer_.reset();
+    exit(EXIT_SUCCESS);
 }
 
-auto ValidatorServer::handle_generate_command(const std::string &command) const -> std::string {
-    static const std::string cpp_code_separator { "__CPPCODE__" };
-    static const std::string rust_code_separator { "__RUSTCODE__" };
+void ValidatorServer::record_phase(const char *phase) const {
+    auto now = std::chrono::steady_clock::now();
+    double seconds { std::chrono::duration<double>(now - phase_mark_).count() };
+    if (std::strcmp(phase, "parsed") == 0) {
+        metrics_.observe_phase(worker_slot_, Metrics::Parse, seconds);
+    } else if (std::strcmp(phase, "translated") == 0) {
+        metrics_.observe_phase(worker_slot_, Metrics::Translate, seconds);
+    } else if (std::strcmp(phase, "executed") == 0) {
+        metrics_.observe_phase(worker_slot_, Metrics::Exec, seconds);
+    }
+    phase_mark_ = now;
+}
 
-    const auto pos1 = command.find(cpp_code_separator);
-    const auto pos2 = command.find(rust_code_separator, pos1 + cpp_code_separator.length());
+void ValidatorServer::emit_progress(llvm::json::Object event) const {
+    if (event_channel_ < 0) {
+        return;
+    }
+    event["elapsed_ms"] = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - job_start_).count();
+    std::string line {};
+    llvm::raw_string_ostream os { line };
+    os << llvm::json::Value(std::move(event));
+    WorkerPool::emit_event(event_channel_, current_job_id_, os.str());
+}
 
-    if (pos1 == std::string::npos || pos2 == std::string::npos) {
-        printer_.print_error("invalid generate command format", true);
-        exit(EXIT_FAILURE);
+auto ValidatorServer::handle_check_command(std::span<const std::string_view> fields) const -> std::string {
+    // CHECK, cpp function name, rust function name, include ir (0 or 1),
+    // cpp code, rust code
+    if (fields.size() != 6) {
+        printer_.print_error("invalid check command format", true);
+        return "error";
     }
+    return handle_check_request(fields[4], fields[5], fields[1], fields[2], fields[3] == "1");
+}
 
-    const auto cpp_code = command.substr(pos1 + cpp_code_separator.length(),
-                                       pos2 - pos1 - cpp_code_separator.length());
-    const auto rust_code = command.substr(pos2 + rust_code_separator.length());
+auto ValidatorServer::process_relay_command(const std::string &payload) -> std::string {
+    // this runs in a pre-forked worker process (see `run_worker`) to isolate
+    // the alive2 verifier environment with the validator server, i.e., a
+    // single, isolated process will be used to handle each individual
+    // validation/generate request (unless `--recycle-after` is raised), this is
+    // needed because alive2's verifier has its own "bug" that will cause
+    // mysterious segmentation faults if running the
+    // `llvm_util::Verifier::compareFunctions` multiple times in the same process.
+    const auto pid = getpid();
+    // the fields refer to `payload`, i.e., the IRs and the sources are never
+    // copied out of the received frame.
+    std::vector<std::string_view> fields {};
+    try {
+        if (!protocol::parse_fields(payload, fields) || fields.empty()) {
+            printer_.print_error("malformed command received", true);
+        } else if (fields[0] == "VALIDATE") {
+            return handle_validate_command(fields);
+        } else if (fields[0] == "GENERATE") {
+            return handle_generate_command(fields);
+        } else if (fields[0] == "CHECK") {
+            return handle_check_command(fields);
+        } else {
+            printer_.print_error("unknown command received: " + std::string(fields[0]), true);
+        }
+    } catch (const std::exception &e) {
+        printer_.print_error("worker process error: " + std::string(e.what()) +
+                             "; pid: " + std::to_string(pid), true);
+    }
+    return "error";
+}
+
+auto ValidatorServer::handle_validate_command(std::span<const std::string_view> fields) const -> std::string {
+    // VALIDATE, cpp ir, rust ir, cpp function name, rust function name
+    if (fields.size() != 5) {
+        printer_.print_error("invalid validate command format", true);
+        return "error";
+    }
+    return handle_validate_request(fields[1], fields[2], fields[3], fields[4]);
+}
 
-    return handle_generate_request(cpp_code, rust_code);
+auto ValidatorServer::handle_generate_command(std::span<const std::string_view> fields) const -> std::string {
+    // GENERATE, cpp code, rust code
+    if (fields.size() != 3) {
+        printer_.print_error("invalid generate command format", true);
+        return "error";
+    }
+    return handle_generate_request(fields[1], fields[2]);
 }
 
-auto open_input_file(llvm::LLVMContext &context, const std::string &path) -> std::unique_ptr<llvm::Module> {
+/// whether `ir` is bitcode rather than textual IR.
+auto is_bitcode(std::string_view ir) -> bool {
+    auto *begin = reinterpret_cast<const unsigned char *>(ir.data());
+    return llvm::isBitcode(begin, begin + ir.size());
+}
+
+/// parse the IR received from the relay server (or generated by the worker)
+/// without going through the file system nor copying it, the `name` is only
+/// used as the buffer identifier, i.e.,
+///   - bitcode is loaded lazily, the function bodies are only materialized
+///     once selected for the comparison (see `ModuleSlice`), so `ir` must
+///     outlive the module.
+///   - textual IR is parsed as a whole.
+/// note: the text parser requires `ir` to be followed by a '\0', which holds
+///       for a protocol field (see `protocol::write_fields`) and a `std::string`.
+auto parse_input_ir(llvm::LLVMContext &context,
+                    std::string_view ir,
+                    const std::string &name) -> std::unique_ptr<llvm::Module> {
+    llvm::MemoryBufferRef buffer { llvm::StringRef(ir.data(), ir.size()), name };
+    if (is_bitcode(ir)) {
+        auto module = llvm::getLazyBitcodeModule(buffer, context);
+        if (!module) {
+            llvm::errs() << "parse_input_ir: " << llvm::toString(module.takeError()) << "\n";
+            return nullptr;
+        }
+        return std::move(*module);
+    }
+
     llvm::SMDiagnostic err {};
-    auto module = llvm::parseIRFile(path, err, context);
+    auto module = llvm::parseIR(buffer, err, context);
 
     if (!module) {
-        err.print("open_input_file", llvm::errs());
+        err.print("parse_input_ir", llvm::errs());
         return nullptr;
     }
 
@@ -337,52 +742,86 @@ auto open_input_file(llvm::LLVMContext &context, const std::string &path) -> std
 
 /// generate a random hash based on the current time and the source code/IRs,
 /// note that the `cpp` and `rust` could be the source code or the IRs.
-auto generate_random_hash(const std::string &cpp, const std::string &rust) -> std::string {
-    return std::to_string(std::hash<std::string>{}(cpp + rust + 
+auto generate_random_hash(std::string_view cpp, std::string_view rust) -> std::string {
+    return std::to_string(std::hash<std::string>{}(std::string(cpp) + std::string(rust) +
                       std::to_string(std::chrono::system_clock::now().time_since_epoch().count())));
 }
 
+/// the alive2 and validator settings that affect the verifier output, used as
+/// part of the result cache key.
+auto validation_config_fingerprint() -> std::string {
+    return VerdictStore::config_fingerprint() +
+           ";cpp-pattern=" + opt_cpp_pattern.getValue() +
+           ";rust-pattern=" + opt_rust_pattern.getValue();
+}
+
 auto ValidatorServer::handle_validate_request(
-        const std::string &cpp_ir,
-        const std::string &rust_ir,
-        const std::string &cpp_function_name,
-        const std::string &rust_function_name) const -> std::string {
+        std::string_view cpp_ir,
+        std::string_view rust_ir,
+        std::string_view cpp_function_name,
+        std::string_view rust_function_name) const -> std::string {
     bool use_specified_function_name = cpp_function_name != "EMPTY" && rust_function_name != "EMPTY";
     printer_.log(std::string("use specified function name: ") + (use_specified_function_name ? "true" : "false") +
-                "; cpp function name: " + cpp_function_name + "; rust function name: " + rust_function_name);
-
-    // generate unique hash for this request
-    auto random_hash = generate_random_hash(cpp_ir, rust_ir);
+                "; cpp function name: " + std::string(cpp_function_name) +
+                "; rust function name: " + std::string(rust_function_name));
+
+    // identical requests (after normalizing the IRs) produce identical results
+    const auto cache_key = ResultCache::make_key({
+        "VALIDATE",
+        ResultCache::normalize_ir(cpp_ir),
+        ResultCache::normalize_ir(rust_ir),
+        use_specified_function_name ? cpp_function_name : "",
+        use_specified_function_name ? rust_function_name : "",
+        validation_config_fingerprint()
+    });
+    if (std::string cached_output {}; result_cache_.lookup(cache_key, cached_output)) {
+        emit_progress(llvm::json::Object { { "phase", "cache_hit" } });
+        printer_.log("result cache hit for " + cache_key + " (" + result_cache_.describe_counters() + ")");
+        return cached_output;
+    }
 
-    // write IR to temporary files
-    std::string cpp_file = TMP_STORAGE_PREFIX + random_hash + "_cpp.ll";
-    std::string rust_file = TMP_STORAGE_PREFIX + random_hash + "_rs.ll";
-    std::ofstream(cpp_file) << cpp_ir;
-    std::ofstream(rust_file) << rust_ir;
+    if (opt_keep_ir_files) {
+        // the IRs are parsed from memory, this copy is only for debugging
+        auto random_hash = generate_random_hash(cpp_ir, rust_ir);
+        std::string cpp_file = TMP_STORAGE_PREFIX + random_hash + (is_bitcode(cpp_ir) ? "_cpp.bc" : "_cpp.ll");
+        std::string rust_file = TMP_STORAGE_PREFIX + random_hash + (is_bitcode(rust_ir) ? "_rs.bc" : "_rs.ll");
+        std::ofstream(cpp_file) << cpp_ir;
+        std::ofstream(rust_file) << rust_ir;
+        printer_.log("kept the received IRs in `" + cpp_file + "` and `" + rust_file + "`");
+    }
 
     // set up validation components
     std::stringstream verifier_buffer {};
     {
         llvm::LLVMContext context {};
-        auto cpp_module = open_input_file(context, cpp_file);
-        auto rust_module = open_input_file(context, rust_file);
+        phase_mark_ = std::chrono::steady_clock::now();
+        auto cpp_module = parse_input_ir(context, cpp_ir, "cpp_ir");
+        auto rust_module = parse_input_ir(context, rust_ir, "rust_ir");
+        record_phase("parsed");
 
         if (!cpp_module || !rust_module) {
             return "failed to parse IR files";
         }
+        emit_progress(llvm::json::Object { { "phase", "parsed" } });
 
         auto &data_layout = cpp_module->getDataLayout();
         llvm::Triple target_triple { cpp_module->getTargetTriple() };
         llvm::TargetLibraryInfoWrapperPass target_library_info { target_triple };
 
         llvm_util::initializer llvm_util_initializer { std::cout, data_layout };
-        smt::smt_initializer smt_initializer {};
 
-        llvm_util::Verifier verifier { target_library_info, smt_initializer, verifier_buffer };
+        llvm_util::Verifier verifier { target_library_info, *smt_initializer_, verifier_buffer };
+        if (verdict_store_->enabled()) {
+            verifier.verdict_cache = verdict_store_.get();
+        }
+        verifier.on_phase = [this](const char *phase) {
+            record_phase(phase);
+            emit_progress(llvm::json::Object { { "phase", phase } });
+        };
 
         Comparer comparer { *cpp_module, *rust_module, opt_cpp_pattern,
                          opt_rust_pattern, verifier, use_specified_function_name,
-                         cpp_function_name, rust_function_name };
+                         std::string(cpp_function_name), std::string(rust_function_name) };
 
         auto results = comparer.compare();
         if (!results.success && results.error_message == "multiple functions found") {
@@ -399,20 +838,244 @@ auto ValidatorServer::handle_validate_request(
                                 "please double check your IRs for syntax errors and potential missing keywords. "
                                 "(e.g., `pub` keyword for rust function)");
         }
+        if (verifier.num_cached > 0) {
+            printer_.log("reused " + std::to_string(verifier.num_cached) + " verdict(s) (" +
+                         verdict_store_->describe_counters() + ")");
+        }
     }
 
-    // cleanup the intermediate files
-    std::remove(cpp_file.c_str());
-    std::remove(rust_file.c_str());
+    auto verifier_output = verifier_buffer.str();
+    if (result_cache_.enabled() && VerdictStore::is_cacheable(verifier_output)) {
+        result_cache_.insert(cache_key, verifier_output);
+        printer_.log("result cache miss for " + cache_key + " (" + result_cache_.describe_counters() + ")");
+    }
 
-    return verifier_buffer.str();
+    return verifier_output;
 }
 
-auto ValidatorServer::handle_generate_request(
-        const std::string &cpp_code,
-        const std::string &rust_code) const -> std::string {
+extern char **environ;
+
+/// a compiler spawned by `spawn_compiler`, the generated IR is read from its
+/// standard output and the diagnostics from its standard error.
+struct CompilerProcess {
+    pid_t pid { -1 };
+    int output_fd { -1 };
+    int diagnostics_fd { -1 };
+    std::string output {};
+    std::string diagnostics {};
+    bool exceeds_limit { false };
+    bool timed_out { false };
+    int status { 0 };
+
+    /// whether the compiler has exited successfully, note that an output
+    /// exceeding the limit is reported separately.
+    auto succeeded() const -> bool {
+        return pid > 0 && !timed_out &&
+               (exceeds_limit || (WIFEXITED(status) && WEXITSTATUS(status) == 0));
+    }
+};
 
-    std::string separator { "__GENERATED_IR_SEPARATOR__" };
+/// the diagnostics beyond this size are dropped, they are only for the user.
+constexpr size_t COMPILER_DIAGNOSTICS_LIMIT = 16 * 1024;
+
+/// spawn `argv` directly (i.e., without a shell) in its own process group,
+/// with the standard output and error redirected to pipes.
+/// returns false with `errno` set if the compiler could not be started.
+auto spawn_compiler(const std::vector<std::string> &argv, CompilerProcess &process) -> bool {
+    int output_pipe[2] { -1, -1 };
+    int diagnostics_pipe[2] { -1, -1 };
+    auto close_pipes = [&]() {
+        for (int fd : { output_pipe[0], output_pipe[1], diagnostics_pipe[0], diagnostics_pipe[1] }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+    if (pipe(output_pipe) < 0 || pipe(diagnostics_pipe) < 0) {
+        int error = errno;
+        close_pipes();
+        errno = error;
+        return false;
+    }
+    // the `dup2` below clears the flag on the compiler's copies
+    for (int fd : { output_pipe[0], output_pipe[1], diagnostics_pipe[0], diagnostics_pipe[1] }) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    posix_spawn_file_actions_t actions {};
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, output_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, diagnostics_pipe[1], STDERR_FILENO);
+
+    // a separate process group, so the compiler and anything it spawns could
+    // be killed at once when the deadline has passed.
+    posix_spawnattr_t attributes {};
+    posix_spawnattr_init(&attributes);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setpgroup(&attributes, 0);
+
+    std::vector<char *> args {};
+    for (const auto &arg : argv) {
+        args.push_back(const_cast<char *>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    int error = posix_spawnp(&process.pid, args[0], &actions, &attributes, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+    close(output_pipe[1]);
+    close(diagnostics_pipe[1]);
+    if (error != 0) {
+        close(output_pipe[0]);
+        close(diagnostics_pipe[0]);
+        process.pid = -1;
+        errno = error;
+        return false;
+    }
+    process.output_fd = output_pipe[0];
+    process.diagnostics_fd = diagnostics_pipe[0];
+    return true;
+}
+
+/// read the outputs of the spawned compilers concurrently until they all
+/// exit, the compilers still running after `timeout` are killed, so are the
+/// ones whose output exceeds `limit` bytes (there is no point to go on).
+void wait_for_compilers(const std::vector<CompilerProcess *> &processes,
+                        size_t limit, std::chrono::milliseconds timeout) {
+    auto kill_compiler = [](CompilerProcess &process) {
+        if (process.pid > 0) {
+            kill(-process.pid, SIGKILL);
+        }
+        for (int *fd : { &process.output_fd, &process.diagnostics_fd }) {
+            if (*fd >= 0) {
+                close(*fd);
+                *fd = -1;
+            }
+        }
+    };
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        std::vector<pollfd> fds {};
+        std::vector<std::pair<CompilerProcess *, bool>> owners {};
+        for (auto *process : processes) {
+            if (process->output_fd >= 0) {
+                fds.push_back({ .fd = process->output_fd, .events = POLLIN, .revents = 0 });
+                owners.emplace_back(process, true);
+            }
+            if (process->diagnostics_fd >= 0) {
+                fds.push_back({ .fd = process->diagnostics_fd, .events = POLLIN, .revents = 0 });
+                owners.emplace_back(process, false);
+            }
+        }
+        if (fds.empty()) {
+            break;
+        }
+
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            for (auto *process : processes) {
+                if (process->output_fd >= 0 || process->diagnostics_fd >= 0) {
+                    process->timed_out = true;
+                    kill_compiler(*process);
+                }
+            }
+            break;
+        }
+        if (poll(fds.data(), fds.size(), static_cast<int>(remaining)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            for (auto *process : processes) {
+                kill_compiler(*process);
+            }
+            break;
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            auto [process, is_output] = owners[i];
+            int &fd = is_output ? process->output_fd : process->diagnostics_fd;
+            if (fds[i].revents == 0 || fd < 0) {
+                continue;
+            }
+
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n <= 0) {
+                close(fd);
+                fd = -1;
+            } else if (!is_output) {
+                auto room = COMPILER_DIAGNOSTICS_LIMIT - std::min(COMPILER_DIAGNOSTICS_LIMIT,
+                                                                  process->diagnostics.size());
+                process->diagnostics.append(buffer, std::min(room, static_cast<size_t>(n)));
+            } else {
+                process->output.append(buffer, n);
+                if (process->output.length() > limit) {
+                    process->exceeds_limit = true;
+                    kill_compiler(*process);
+                }
+            }
+        }
+    }
+
+    // a compiler may close its pipes and keep running, so the deadline applies
+    // to its exit as well
+    for (auto *process : processes) {
+        while (process->pid > 0) {
+            auto reaped = waitpid(process->pid, &process->status, WNOHANG);
+            if (reaped == process->pid || (reaped < 0 && errno != EINTR)) {
+                break;
+            }
+            if (reaped == 0 && std::chrono::steady_clock::now() >= deadline) {
+                // the one killed for its output is reported as such instead
+                process->timed_out = !process->exceeds_limit;
+                kill_compiler(*process);
+                while (waitpid(process->pid, &process->status, 0) < 0 && errno == EINTR) {}
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+auto ValidatorServer::compile_sources(
+        std::string_view cpp_code,
+        std::string_view rust_code,
+        std::string &cpp_ir,
+        std::string &rust_ir,
+        bool bitcode) const -> std::string {
+
+    // the flags (except the output path) are part of the compile cache keys,
+    // while the temporary file names are not, as they are random anyway. the
+    // crate is named explicitly, so the IR does not depend on the file name,
+    // i.e., the textual IRs are shared with `scripts/src2ir.py`, which uses
+    // the same flags (see `CompileCache`).
+    // todo: allows user to specify a specific optimization level
+    const std::vector<std::string> cpp_flags { "clang++", "-O0", bitcode ? "-c" : "-S", "-emit-llvm" };
+    const std::vector<std::string> rust_flags { "rustc", bitcode ? "--emit=llvm-bc" : "--emit=llvm-ir",
+                                                "--crate-type=lib", "--crate-name=input" };
+    auto join_flags = [](const std::vector<std::string> &flags) {
+        std::string joined {};
+        for (const auto &flag : flags) {
+            joined += (joined.empty() ? "" : " ") + flag;
+        }
+        return joined;
+    };
+    auto cpp_key = CompileCache::make_key(clang_identity_, join_flags(cpp_flags), "", cpp_code);
+    auto rust_key = CompileCache::make_key(rustc_identity_, join_flags(rust_flags), "", rust_code);
+    bool cpp_cached = !clang_identity_.empty() && compile_cache_.lookup(cpp_key, cpp_ir);
+    bool rust_cached = !rustc_identity_.empty() && compile_cache_.lookup(rust_key, rust_ir);
+    if (cpp_cached || rust_cached) {
+        printer_.log(std::string("compile cache hit for") + (cpp_cached ? " C++" : "") +
+                     (rust_cached ? " Rust" : "") + " (" + compile_cache_.describe_counters() + ")");
+    }
+    if (cpp_cached && rust_cached) {
+        return "";
+    }
 
     // generate unique hash for this request
     auto random_hash = generate_random_hash(cpp_code, rust_code);
@@ -420,19 +1083,18 @@ auto ValidatorServer::handle_generate_request(
     // write source files to temp location
     std::string cpp_src = TMP_STORAGE_PREFIX + random_hash + ".cpp";
     std::string rust_src = TMP_STORAGE_PREFIX + random_hash + ".rs";
-    std::string cpp_ir = TMP_STORAGE_PREFIX + random_hash + "_cpp.ll";
-    std::string rust_ir = TMP_STORAGE_PREFIX + random_hash + "_rs.ll";
 
     // create and explicitly close the files
     // note: this is important to keep the consistency between macOS and linux when
     //       handling temporary file cleanup.
-    {
+    if (!cpp_cached) {
         std::ofstream cpp_file(cpp_src);
         cpp_file << cpp_code;
         printer_.log("writing to cpp file: " + cpp_src);
         cpp_file.flush();
         cpp_file.close();
-
+    }
+    if (!rust_cached) {
         std::ofstream rust_file(rust_src);
         rust_file << rust_code;
         printer_.log("writing to rust file: " + rust_src);
@@ -440,120 +1102,153 @@ auto ValidatorServer::handle_generate_request(
         rust_file.close();
     }
 
-    // helper function to check if a command exists
-    auto command_exists = [](const std::string &cmd) -> bool {
-        return std::system(("which " + cmd + " > /dev/null 2>&1").c_str()) == 0;
+    // generate IR using the same commands as `scripts/src2ir.py`, except that
+    // the IR is written to the standard output and read through a pipe, so no
+    // intermediate ir file is created. both compilers run at the same time
+    // under a shared deadline, so the latency is the slower of the two.
+    CompilerProcess cpp_compiler {};
+    CompilerProcess rust_compiler {};
+    std::vector<CompilerProcess *> compilers {};
+    auto start_compiler = [&](std::vector<std::string> argv, const std::string &src,
+                              CompilerProcess &process) {
+        argv.insert(argv.end(), { src, "-o", "-" });
+        if (spawn_compiler(argv, process)) {
+            compilers.push_back(&process);
+        } else {
+            process.diagnostics = argv[0] + " could not be started: " + std::strerror(errno);
+        }
     };
-
-    // get the timeout command for the current platform
-    auto get_timeout_cmd = [&](int timeout_seconds) -> std::string {
-        #ifdef __APPLE__
-            if (command_exists("gtimeout")) {
-                return "gtimeout " + std::to_string(timeout_seconds) + "s ";
-            } else if (command_exists("timeout")) {
-                return "timeout " + std::to_string(timeout_seconds) + "s ";
-            } else {
-                printer_.print_info("no timeout command found for macOS, "
-                                   "please install gnu-timeout or timeout", true);
-                return "";
-            }
-        #else
-            // for all other platforms, use the built-in timeout command.
-            if (command_exists("timeout")) {
-                return "timeout " + std::to_string(timeout_seconds) + "s ";
-            } else {
-                printer_.print_info("no timeout command found for your platform, "
-                                   "please install timeout", true);
-                return "";
+    if (!cpp_cached) {
+        start_compiler(cpp_flags, cpp_src, cpp_compiler);
+    }
+    if (!rust_cached) {
+        start_compiler(rust_flags, rust_src, rust_compiler);
+    }
+    wait_for_compilers(compilers, IR_FILE_SIZE_LIMIT, std::chrono::seconds(10));
+
+    // cleanup the intermediate source files before returning
+    std::remove(cpp_src.c_str());
+    std::remove(rust_src.c_str());
+
+    // the diagnostics refer to the temporary source files, which means nothing
+    // to the user, so they are renamed.
+    auto compile_error = [&](const std::string &name, const CompilerProcess &process,
+                             const std::string &src, const std::string &display_name,
+                             const std::string &hints) -> std::string {
+        std::string compile_error {};
+        if (process.timed_out) {
+            compile_error = name + " compilation timed out (10s). Please check for: " + hints;
+        } else {
+            auto diagnostics = process.diagnostics;
+            for (auto pos = diagnostics.find(src); pos != std::string::npos;
+                 pos = diagnostics.find(src, pos + display_name.length())) {
+                diagnostics.replace(pos, src.length(), display_name);
             }
-        #endif
-    };
-
-    // generate IR using the same commands as `scripts/src2ir.py`
-    // todo: allows user to specify a specific optimization level
-    if (std::system((get_timeout_cmd(10) + "clang++ -O0 -S -emit-llvm " + cpp_src + " -o " + cpp_ir).c_str()) != 0) {
-        std::string cpp_compile_error = std::string{ "C++ compilation timed out (10s) or failed. " } +
-               "Please check for: 1) syntax errors 2) complex template metaprogramming 3) recursive types.";
-        printer_.print_error(cpp_compile_error, true);
-        return cpp_compile_error;
-    }
-    if (std::system((get_timeout_cmd(10) + "rustc --emit=llvm-ir --crate-type=lib " + rust_src + " -o " + rust_ir).c_str()) != 0) {
-        std::string rust_compile_error = std::string{ "Rust compilation timed out (10s) or failed. " } +
-               "Please check for: 1) syntax errors 2) complex macros 3) type recursion.";
-        printer_.print_error(rust_compile_error, true);
-        return rust_compile_error;
-    }
-    printer_.log("generated IR files: `" + cpp_ir + "` and `" + rust_ir + "`");
-
-    // read the generated IR files with security size check
-    std::ifstream cpp_ir_file(cpp_ir);
-    std::ifstream rust_ir_file(rust_ir);
-
-    // check if the generated IR files exceed the size limit
-    auto check_ir_file_size = [&](const std::filesystem::path &path, const std::string &name)
-        -> std::pair<bool, std::string> {
-        if (std::filesystem::file_size(path) > IR_FILE_SIZE_LIMIT) {
-            std::string file_exceeds_error = name + " generated IR file exceeds the size limit (" +
-                                                std::to_string(IR_FILE_SIZE_LIMIT) + " bytes), "
-                                                "please check your code for complex types or macros.";
-            printer_.print_error(file_exceeds_error, true);
-            return { true, file_exceeds_error };
+            compile_error = name + " compilation failed:\n" +
+                            (diagnostics.empty() ? "(no diagnostics)" : diagnostics);
         }
-        return { false, "" };
+        printer_.print_error(compile_error, true);
+        return compile_error;
     };
-
-    std::filesystem::path cpp_ir_path(cpp_ir);
-    std::filesystem::path rust_ir_path(rust_ir);
-
-    auto [cpp_ir_exceeds_limit, cpp_ir_exceeds_error] = check_ir_file_size(cpp_ir_path, "C++");
-    if (cpp_ir_exceeds_limit) {
-        return cpp_ir_exceeds_error;
+    if (!cpp_cached && !cpp_compiler.succeeded()) {
+        return compile_error("C++", cpp_compiler, cpp_src, "input.cpp",
+                             "1) complex template metaprogramming 2) recursive types.");
     }
-    auto [rust_ir_exceeds_limit, rust_ir_exceeds_error] = check_ir_file_size(rust_ir_path, "Rust");
-    if (rust_ir_exceeds_limit) {
-        return rust_ir_exceeds_error;
+    if (!rust_cached && !rust_compiler.succeeded()) {
+        return compile_error("Rust", rust_compiler, rust_src, "input.rs",
+                             "1) complex macros 2) type recursion.");
     }
-
-    // helper function to cleanup the intermediate files
-    auto cleanup_intermediate_files = [&]() {
-        std::remove(cpp_src.c_str());
-        std::remove(rust_src.c_str());
-        std::remove(cpp_ir.c_str());
-        std::remove(rust_ir.c_str());
+    if (!cpp_cached) {
+        cpp_ir = std::move(cpp_compiler.output);
+    }
+    if (!rust_cached) {
+        rust_ir = std::move(rust_compiler.output);
+    }
+    printer_.log(std::string("generated ") + (bitcode ? "bitcode" : "IRs") + ": " +
+                 std::to_string(cpp_ir.length()) + " bytes for C++ and " +
+                 std::to_string(rust_ir.length()) + " bytes for Rust");
+
+    // check if the generated IRs exceed the size limit
+    auto ir_exceeds_limit_error = [&](const std::string &name) -> std::string {
+        std::string exceeds_error = name + " generated IR file exceeds the size limit (" +
+                                    std::to_string(IR_FILE_SIZE_LIMIT) + " bytes), "
+                                    "please check your code for complex types or macros.";
+        printer_.print_error(exceeds_error, true);
+        return exceeds_error;
     };
+    if (cpp_compiler.exceeds_limit) {
+        return ir_exceeds_limit_error("C++");
+    }
+    if (rust_compiler.exceeds_limit) {
+        return ir_exceeds_limit_error("Rust");
+    }
+
+    // only the complete IRs (i.e., compiled successfully within the limit) are
+    // cached, so a failed or oversized compilation is always retried.
+    if (!cpp_cached && !clang_identity_.empty()) {
+        compile_cache_.insert(cpp_key, cpp_ir);
+    }
+    if (!rust_cached && !rustc_identity_.empty()) {
+        compile_cache_.insert(rust_key, rust_ir);
+    }
+    if (compile_cache_.enabled()) {
+        printer_.log("compile cache " + compile_cache_.describe_counters());
+    }
+    return "";
+}
 
-    std::stringstream cpp_ir_content, rust_ir_content;
-    cpp_ir_content << cpp_ir_file.rdbuf();
-    // there may be discrepancies between the number of characters from `std::stringstream`
-    // and the actual bytes read from the file, so we also need to check the length of the string.
-    // note: both file_size and string_length share the same limit of `50000`.
-    if (cpp_ir_content.str().length() > IR_FILE_SIZE_LIMIT) {
-        std::string cpp_ir_length_error = "C++ generated IR file exceeds the length limit (" +
-                                           std::to_string(IR_FILE_SIZE_LIMIT) + " bytes), "
-                                           "please check your code for complex types or macros.";
-        printer_.print_error(cpp_ir_length_error, true);
-        cleanup_intermediate_files();
-        return cpp_ir_length_error;
-    }
-    rust_ir_content << rust_ir_file.rdbuf();
-    if (rust_ir_content.str().length() > IR_FILE_SIZE_LIMIT) {
-        std::string rust_ir_length_error = "Rust generated IR file exceeds the length limit (" +
-                                           std::to_string(IR_FILE_SIZE_LIMIT) + " bytes), "
-                                           "please check your code for complex types or macros.";
-        printer_.print_error(rust_ir_length_error, true);
-        cleanup_intermediate_files();
-        return rust_ir_length_error;
-    }
-
-    // cleanup the generated intermediate files before returning
-    cleanup_intermediate_files();
+auto ValidatorServer::handle_generate_request(
+        std::string_view cpp_code,
+        std::string_view rust_code) const -> std::string {
+    std::string separator { "__GENERATED_IR_SEPARATOR__" };
+    std::string cpp_ir {};
+    std::string rust_ir {};
+    if (auto error = compile_sources(cpp_code, rust_code, cpp_ir, rust_ir); !error.empty()) {
+        return error;
+    }
 
     // return both IRs separated by the separator
-    return cpp_ir_content.str() + separator + rust_ir_content.str();
+    return cpp_ir + separator + rust_ir;
+}
+
+auto ValidatorServer::handle_check_request(
+        std::string_view cpp_code,
+        std::string_view rust_code,
+        std::string_view cpp_function_name,
+        std::string_view rust_function_name,
+        bool include_ir) const -> std::string {
+    // the IRs stay in the worker unless the client asked for them, in which
+    // case they are generated as text, otherwise as bitcode, which is much
+    // faster to load, and only partially (see `parse_input_ir`).
+    std::string cpp_ir {};
+    std::string rust_ir {};
+    if (auto error = compile_sources(cpp_code, rust_code, cpp_ir, rust_ir, !include_ir); !error.empty()) {
+        return error;
+    }
+
+    llvm::json::Object compiled { { "phase", "compiled" } };
+    if (include_ir) {
+        compiled["cpp_ir"] = cpp_ir;
+        compiled["rust_ir"] = rust_ir;
+    }
+    emit_progress(std::move(compiled));
+
+    return handle_validate_request(cpp_ir, rust_ir, cpp_function_name, rust_function_name);
 }
 
-int main() {
-    ValidatorServer server { 3002 };
+int main(int argc, char *argv[]) {
+    llvm::cl::ParseCommandLineOptions(argc, argv, "translation validator server\n");
+    smt::solver_set_portfolio(opt_smt_portfolio);
+    smt::solver_set_parallel_queries(opt_smt_parallel_queries);
+    smt::solver_set_incremental(opt_smt_incremental);
+    smt::solver_set_profile(opt_smt_profile);
+    util::config::skip_cex_minimization = opt_skip_cex_minimization;
+    smt::solver_set_query_cache(opt_smt_query_cache,
+                                static_cast<uint64_t>(opt_smt_query_cache_size) * 1024 * 1024);
+    ValidatorServer server { 3002, opt_pool_size, opt_recycle_after, opt_max_queued_jobs,
+                             static_cast<uint64_t>(opt_result_cache_size) * 1024 * 1024,
+                             static_cast<uint64_t>(opt_verdict_cache_size) * 1024 * 1024,
+                             static_cast<uint64_t>(opt_compile_cache_size) * 1024 * 1024 };
     server.start();
     return EXIT_SUCCESS;
 }
@@ -4,55 +4,205 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <chrono>
 #include <fstream>
+#include <memory>
+#include <set>
+#include <span>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+#include "smt/smt.h"
+#include "llvm/Support/JSON.h"
 
 #include "Printer.h"
 #include "Comparer.h"
+#include "CompileCache.h"
+#include "Metrics.h"
+#include "Protocol.h"
+#include "ResultCache.h"
+#include "SmtProfile.h"
+#include "VerdictStore.h"
+#include "WorkerPool.h"
 
-/// a simple validator server that handles the validate (/api/validate) and
-/// generate (/api/generate) requests sent from the relay server, the typical
-/// workflow is, i.e.,
-///   1. accepts connection (blocks)
-///   2. parse the command
-///   3. fork new process and call the corresponding handler
-///   4. parent process will return to accept new connection
-/// the important part is that, each validation/generate request runs in
-/// isolation due to alive2's internal bug.
+/// a simple validator server that handles the validate (/api/validate),
+/// generate (/api/generate) and check (/api/check) requests sent from the
+/// relay server, the typical workflow is, i.e.,
+///   1. pre-fork a pool of workers, each holding an initialized z3 context
+///   2. accept the (persistent) connections from the relay server, each
+///      carrying many requests framed by `protocol`
+///   3. hand every request to an idle worker, which parses the command and
+///      calls the corresponding handler, the requests wait in a bounded queue
+///      while all workers are busy, and are rejected as "overloaded" beyond
+///   4. send the responses back, tagged with the request ids, in the order
+///      they complete
+/// the important part is that, each worker is recycled after a configurable
+/// number of requests (one by default) to keep the requests isolated due to
+/// alive2's internal bug, see `WorkerPool` for more details.
 class ValidatorServer {
 public:
-    ValidatorServer(int port);
+    ValidatorServer(int port, size_t pool_size, size_t recycle_after, size_t max_queued_jobs,
+                    uint64_t result_cache_size, uint64_t verdict_cache_size,
+                    uint64_t compile_cache_size);
     ~ValidatorServer();
     void start();
 
 private:
     int server_fd_;
+    /// the event loop of `start`, and the SIGCHLD notifications it waits for.
+    int epoll_fd_ { -1 };
+    int signal_fd_ { -1 };
+    std::set<int> watched_;
     int port_;
     struct sockaddr_in address_;
     Printer printer_;
+    WorkerPool pool_;
+    /// the metrics served to the relay server's `/metrics`, recorded by the
+    /// workers into their own slots, see `Metrics`.
+    Metrics metrics_;
+    /// the persistent store of the verifier outputs, shared by all workers.
+    ResultCache result_cache_;
+    /// the persistent per-function verdicts, shared by all workers (and the
+    /// standalone version), consulted by the verifier for each function pair.
+    std::unique_ptr<VerdictStore> verdict_store_;
+    /// the persistent store of the IRs generated for the GENERATE requests,
+    /// keyed by the identities of the compilers, which are resolved once in
+    /// `start` (i.e., before the workers are forked).
+    CompileCache compile_cache_;
+    std::string clang_identity_ {};
+    std::string rustc_identity_ {};
+    /// the z3 context and solver tactic of the current worker process,
+    /// created once when the worker starts instead of once per request.
+    std::unique_ptr<smt::smt_initializer> smt_initializer_;
+
+    /// an in-flight request, i.e., where its response should be sent to.
+    struct Job {
+        int connection;
+        uint64_t request_id;
+        /// e.g., "VALIDATE", for the metrics.
+        std::string command;
+    };
+    /// an open connection from the relay server, i.e., the requests being
+    /// received and the responses yet to be sent, as its socket is
+    /// non-blocking so that a stalled peer never holds up the event loop.
+    struct Connection {
+        protocol::FrameReader reader;
+        protocol::FrameWriter writer;
+    };
+    std::unordered_map<int, Connection> connections_;
+    /// the in-flight requests by their job ids in the worker pool.
+    std::unordered_map<uint64_t, Job> jobs_;
+    uint64_t next_job_id_ { 0 };
+
+    /// the channel, id, and start time of the job being processed in the
+    /// current worker process, for `emit_progress`.
+    int event_channel_ { -1 };
+    uint64_t current_job_id_ { 0 };
+    std::chrono::steady_clock::time_point job_start_ {};
+    /// the slot of the current worker process in `metrics_`, the end of the
+    /// last phase (or smt query) recorded, and the solver counters already
+    /// added to the slot.
+    size_t worker_slot_ { 0 };
+    mutable std::chrono::steady_clock::time_point phase_mark_ {};
+    smt::SolverStats recorded_solver_stats_ {};
+
+    /// record the duration of `phase` (since the previous mark) if it is one
+    /// of the `Metrics` phases, and move the mark forward.
+    void record_phase(const char *phase) const;
+
+    /// start (or stop) waiting for `fd` to be readable in the event loop.
+    void watch(int fd, bool enable);
+
+    /// start (or stop) waiting for the watched `fd` to be writable as well.
+    void watch_output(int fd, bool enable);
+
+    void accept_connection();
+
+    /// close `connection`, the responses to its in-flight requests are dropped.
+    void close_connection(int connection);
+
+    /// receive what is available on `connection`, and handle the requests
+    /// completely received.
+    void read_requests(int connection);
+
+    /// submit a request from `connection` to the worker pool.
+    void handle_request(int connection, protocol::Frame request);
+
+    /// send (or queue) a frame to `connection`, see `protocol::FrameWriter`.
+    void send_frame(int connection, uint64_t request_id, std::string_view payload,
+                    protocol::FrameKind kind = protocol::FrameKind::Message);
+
+    /// send what is queued for the writable `connection`.
+    void flush_connection(int connection);
+
+    /// send the response of a finished job back to the relay server.
+    void send_response(const protocol::Frame &response);
+
+    /// send a progress event of a job on behalf of the pool, e.g., whether
+    /// it is queued.
+    void send_event(uint64_t job_id, llvm::json::Object event);
 
     /// handle the validate request sent from the relay server,
     /// will be called in a separate forked process after the VALIDATE command
     /// is properly parsed in `handle_validate_command`.
     auto handle_validate_request(
-        const std::string &cpp_ir,
-        const std::string &rust_ir,
-        const std::string &cpp_function_name,
-        const std::string &rust_function_name) const -> std::string;
+        std::string_view cpp_ir,
+        std::string_view rust_ir,
+        std::string_view cpp_function_name,
+        std::string_view rust_function_name) const -> std::string;
+
+    /// compile the sources into `cpp_ir` and `rust_ir` (or take them from the
+    /// compile cache), as bitcode if `bitcode` is set, or textual IR otherwise,
+    /// returns the error message to be sent to the client if the compilation
+    /// failed, empty otherwise.
+    auto compile_sources(
+        std::string_view cpp_code,
+        std::string_view rust_code,
+        std::string &cpp_ir,
+        std::string &rust_ir,
+        bool bitcode = false) const -> std::string;
 
     /// handle the generate request sent from the relay server,
     /// will be called in a separate forked process after the GENERATE command
     /// is properly parsed in `handle_generate_command`.
     auto handle_generate_request(
-        const std::string &cpp_code,
-        const std::string &rust_code) const -> std::string;
+        std::string_view cpp_code,
+        std::string_view rust_code) const -> std::string;
+
+    /// handle the check request sent from the relay server, i.e., generate
+    /// the IRs and validate them within the same worker, the IRs are sent back
+    /// (with the "compiled" progress event) only if `include_ir` is set.
+    /// will be called after the CHECK command is parsed in `handle_check_command`.
+    auto handle_check_request(
+        std::string_view cpp_code,
+        std::string_view rust_code,
+        std::string_view cpp_function_name,
+        std::string_view rust_function_name,
+        bool include_ir) const -> std::string;
+
+    /// handle the VALIDATE command sent from the relay server, i.e., its fields
+    /// (see `protocol::parse_fields`) starting with the command name.
+    auto handle_validate_command(std::span<const std::string_view> fields) const -> std::string;
+
+    /// handle the GENERATE command sent from the relay server, i.e., its fields
+    /// (see `protocol::parse_fields`) starting with the command name.
+    auto handle_generate_command(std::span<const std::string_view> fields) const -> std::string;
+
+    /// handle the CHECK command sent from the relay server, i.e., its fields
+    /// (see `protocol::parse_fields`) starting with the command name.
+    auto handle_check_command(std::span<const std::string_view> fields) const -> std::string;
 
-    /// handle the VALIDATE command sent from the relay server.
-    auto handle_validate_command(const std::string &command) const -> std::string;
+    /// send a progress event of the current job to the relay server, i.e.,
+    /// `event` with the elapsed time since the job has started.
+    void emit_progress(llvm::json::Object event) const;
 
-    /// handle the GENERATE command sent from the relay server.
-    auto handle_generate_command(const std::string &command) const -> std::string;
+    /// process a request from the relay server in a worker and return the
+    /// response, i.e., "error" if the request could not be handled.
+    auto process_relay_command(const std::string &payload) -> std::string;
 
-    /// receive the request from the relay server and process it.
-    void recv_and_process_relay_server_request(int client_socket);
+    /// the main loop of a pre-forked worker process, i.e., set up the
+    /// resource limits and the smt context, then serve the jobs sent through
+    /// `channel` until the pool closes it.
+    void run_worker(int channel, size_t slot);
 };
@@ -0,0 +1,94 @@
+#ifndef VERDICT_STORE_H
+#define VERDICT_STORE_H
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+#include "llvm_util/compare.h"
+#include "smt/smt.h"
+#include "util/config.h"
+#include "util/version.h"
+
+#include "Printer.h"
+#include "ResultCache.h"
+
+/// the storage to store the per-function verdicts, shared by the standalone
+/// version and the validator server.
+const auto VERDICT_STORAGE_PREFIX = []() {
+    const char* home = getenv("HOME");
+    if (!home) {
+        home = getpwuid(getuid())->pw_dir;
+    }
+    return std::string(home) + "/.translation_validator/verdicts/";
+}();
+
+/// the persistent per-function-pair verdicts used by `llvm_util::Verifier`,
+/// i.e., a pair whose fingerprint (the alive ir of both functions plus the llvm
+/// definitions they depend on) has been verified before, by any process, is
+/// not verified again, so only the edited functions are re-verified between
+/// runs. the fingerprints are stored (hashed) along with the alive2 settings,
+/// so changing e.g., the smt timeout invalidates all the previous verdicts.
+class VerdictStore : public llvm_util::VerdictCache {
+public:
+    VerdictStore(uint64_t size_limit, const Printer &printer)
+        : cache_(VERDICT_STORAGE_PREFIX, size_limit, printer) {}
+
+    auto enabled() const -> bool {
+        return cache_.enabled();
+    }
+
+    bool lookup(const std::string &fingerprint, std::string &verdict) override {
+        return cache_.lookup(make_key(fingerprint), verdict);
+    }
+
+    void insert(const std::string &fingerprint, const std::string &verdict) override {
+        if (is_cacheable(verdict)) {
+            cache_.insert(make_key(fingerprint), verdict);
+        }
+    }
+
+    auto describe_counters() const -> std::string {
+        return cache_.describe_counters();
+    }
+
+    /// the alive2 settings that affect the verifier output.
+    static auto config_fingerprint() -> std::string {
+        std::stringstream fingerprint {};
+        fingerprint << util::alive_version
+                    << ";smt-to=" << smt::get_query_timeout()
+                    << ";smt-random-seed=" << smt::get_random_seed()
+                    << ";src-unroll=" << util::config::src_unroll_cnt
+                    << ";tgt-unroll=" << util::config::tgt_unroll_cnt
+                    << ";disable-undef-input=" << util::config::disable_undef_input
+                    << ";disable-poison-input=" << util::config::disable_poison_input
+                    << ";tgt-is-asm=" << util::config::tgt_is_asm
+                    << ";fail-src-ub=" << util::config::fail_if_src_is_ub
+                    << ";disallow-ub-exploitation=" << util::config::disallow_ub_exploitation
+                    << ";max-offset-in-bits=" << util::config::max_offset_bits
+                    << ";max-sizet-in-bits=" << util::config::max_sizet_bits
+                    << ";skip-smt=" << util::config::skip_smt
+                    << ";skip-cex-minimization=" << util::config::skip_cex_minimization;
+        return fingerprint.str();
+    }
+
+    /// whether the verifier output only depends on the inputs, i.e., it is not
+    /// the result of hitting a resource limit that may not be hit on the next
+    /// run.
+    static auto is_cacheable(const std::string &output) -> bool {
+        return !output.empty() &&
+               output.find("ERROR: Timeout") == std::string::npos &&
+               output.find("ERROR: SMT Error") == std::string::npos &&
+               output.find("Out of memory") == std::string::npos;
+    }
+
+private:
+    static auto make_key(const std::string &fingerprint) -> std::string {
+        static const auto config = config_fingerprint();
+        return ResultCache::make_key({ "VERDICT", fingerprint, config });
+    }
+
+    ResultCache cache_;
+};
+
+#endif  // VERDICT_STORE_H
@@ -0,0 +1,419 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Printer.h"
+#include "Protocol.h"
+
+/// a supervised pool of pre-forked worker processes, the typical workflow is,
+///   1. `start` forks `pool_size` workers, each worker runs the provided
+///      `WorkerMain` with its own end of a unix socketpair (i.e., the channel).
+///   2. `submit` queues a job, i.e., a request payload tagged with a job id,
+///      which is sent through the channel (as a `protocol` frame) to the
+///      next idle worker, at most `max_pending` jobs wait for a worker, the
+///      ones beyond are rejected.
+///   3. the worker handles the request, optionally emitting progress events,
+///      and sends the response back through the channel with the same job id,
+///      the owner of the pool polls the `channels` and calls `collect` to
+///      receive the events and the responses (and `flush` to send the rest
+///      of a job once a channel is writable), the pool's end of a channel is
+///      non-blocking, so a slow worker never holds up the owner.
+///   4. after `recycle_after` jobs the channel is closed, the worker exits and
+///      a fresh one is forked in its place right away, the same happens if a
+///      worker crashes or gets killed by the rlimits, in which case its job is
+///      completed with the "error" response. the owner is expected to call
+///      `reap` on SIGCHLD, which collects the exit status of the workers
+///      replaced so far, and replaces the ones dying while idle as well.
+/// the recycling keeps the isolation needed by alive2 (see the note in
+/// `ValidatorServer::process_relay_command`), while the cost of warming up a
+/// worker is paid before the request arrives instead of after.
+class WorkerPool {
+public:
+    /// the entry point of a worker process, receives the worker's end of the
+    /// channel and its slot in the pool (i.e., in `[0, pool_size)`, reused by
+    /// its replacement), and is expected to never return.
+    using WorkerMain = std::function<void(int channel, size_t slot)>;
+    /// called when a channel is opened (i.e., a worker is spawned) or right
+    /// before it is closed, e.g., to (un)register it for polling.
+    using ChannelHook = std::function<void(int channel, bool opened)>;
+    /// called when a job is sent to a worker, with the time it has waited.
+    using StartHook = std::function<void(uint64_t job_id, double wait_ms)>;
+    /// called when the job sent to a channel starts (or stops) waiting for
+    /// the channel to be writable, e.g., to poll it for `flush`.
+    using OutputHook = std::function<void(int channel, bool pending)>;
+
+    WorkerPool(size_t pool_size, size_t recycle_after, size_t max_pending,
+               const Printer &printer)
+        : pool_size_(pool_size == 0 ? 1 : pool_size),
+          recycle_after_(recycle_after == 0 ? 1 : recycle_after),
+          max_pending_(max_pending),
+          printer_(printer) {}
+
+    ~WorkerPool() {
+        for (auto &worker : workers_) {
+            if (worker.channel >= 0) {
+                close(worker.channel);
+            }
+        }
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    /// fork the initial workers, must be called once before `submit`.
+    void start(WorkerMain worker_main, ChannelHook on_channel = nullptr,
+               StartHook on_start = nullptr, OutputHook on_output = nullptr) {
+        worker_main_ = std::move(worker_main);
+        on_channel_ = std::move(on_channel);
+        on_start_ = std::move(on_start);
+        on_output_ = std::move(on_output);
+        workers_.resize(pool_size_);
+        for (size_t i = 0; i < pool_size_; ++i) {
+            spawn(i);
+        }
+        printer_.print_info("worker pool started with " + std::to_string(pool_size_) +
+                            " workers, recycling every " + std::to_string(recycle_after_) +
+                            " job(s)", true);
+    }
+
+    /// queue the job, it is sent to a worker as soon as one becomes idle.
+    /// returns false if the job is rejected, i.e., all the workers are busy
+    /// and `max_pending` jobs are already waiting.
+    auto submit(uint64_t job_id, std::string payload) -> bool {
+        pending_.push_back(PendingJob {
+            .frame = protocol::Frame { .request_id = job_id, .payload = std::move(payload) },
+            .queued_at = std::chrono::steady_clock::now()
+        });
+        assign_pending_jobs();
+        if (pending_.size() > max_pending_) {
+            pending_.pop_back();
+            return false;
+        }
+        return true;
+    }
+
+    /// the number of jobs waiting for a worker.
+    auto queue_depth() const -> size_t {
+        return pending_.size();
+    }
+
+    /// the number of workers processing a job.
+    auto busy_workers() const -> size_t {
+        return std::count_if(workers_.begin(), workers_.end(), [](const auto &worker) {
+            return !worker.idle;
+        });
+    }
+
+    auto pool_size() const -> size_t {
+        return pool_size_;
+    }
+
+    /// cancel the job, returns its "cancelled" response right away if it has
+    /// not been started yet, otherwise its worker is killed and the response
+    /// is returned by `collect` later.
+    auto cancel(uint64_t job_id) -> std::optional<protocol::Frame> {
+        auto it = std::find_if(pending_.begin(), pending_.end(), [job_id](const auto &job) {
+            return job.frame.request_id == job_id;
+        });
+        if (it != pending_.end()) {
+            pending_.erase(it);
+            return protocol::Frame { .request_id = job_id, .payload = "cancelled" };
+        }
+
+        for (auto &worker : workers_) {
+            if (!worker.idle && worker.job_id == job_id && !worker.cancelled) {
+                printer_.log("cancelling job " + std::to_string(job_id) +
+                             " on worker " + std::to_string(worker.pid));
+                worker.cancelled = true;
+                kill(worker.pid, SIGKILL);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// receive the progress events and the response available from the
+    /// worker owning the readable `channel`, the kind of each returned frame
+    /// tells which one.
+    auto collect(int channel) -> std::vector<protocol::Frame> {
+        std::vector<protocol::Frame> frames {};
+        auto index = find_worker(channel);
+        if (!index) {
+            return frames;
+        }
+        auto &worker = workers_[*index];
+        if (worker.idle) {
+            // an idle worker never writes, i.e., it has exited
+            replace_worker(*index);
+            return frames;
+        }
+
+        bool open = worker.reader.receive(channel, frames);
+        bool done { false };
+        for (size_t i = 0; i < frames.size(); ++i) {
+            if (frames[i].request_id != worker.job_id) {
+                frames.resize(i);
+                open = false;
+                break;
+            } else if (frames[i].kind != protocol::FrameKind::Event) {
+                // the worker is idle after its response
+                frames.resize(i + 1);
+                done = true;
+                break;
+            }
+        }
+
+        if (!done && open) {
+            return frames;
+        } else if (!done) {
+            // eof, i.e., the worker crashed, was killed or cancelled
+            frames.push_back(protocol::Frame {
+                .request_id = worker.job_id,
+                .payload = worker.cancelled ? "cancelled" : "error"
+            });
+            replace_worker(*index);
+        } else if (worker.num_jobs >= recycle_after_ || worker.cancelled) {
+            // the worker has served enough jobs (or is being killed),
+            // closing the channel tells it to exit.
+            replace_worker(*index);
+        } else {
+            worker.idle = true;
+        }
+        assign_pending_jobs();
+        return frames;
+    }
+
+    /// send the rest of the job to the worker owning the writable `channel`.
+    void flush(int channel) {
+        auto index = find_worker(channel);
+        if (!index) {
+            return;
+        }
+        auto &worker = workers_[*index];
+        // on error, the worker has gone away, which `collect` tells once the
+        // eof of the channel is read
+        worker.writer.flush(channel);
+        if (!worker.writer.pending() && on_output_) {
+            on_output_(channel, false);
+        }
+    }
+
+    /// reap the exited workers without blocking, i.e., collect the exit
+    /// status of the replaced ones, and replace the idle ones right away, the
+    /// busy ones are replaced once their channels are closed (see `collect`),
+    /// i.e., after their jobs are completed.
+    void reap() {
+        int status { 0 };
+        pid_t pid { -1 };
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto exiting = std::find_if(exiting_.begin(), exiting_.end(), [pid](const auto &worker) {
+                return worker.pid == pid;
+            });
+            if (exiting != exiting_.end()) {
+                report_exit(*exiting, status);
+                exiting_.erase(exiting);
+                continue;
+            }
+            for (size_t i = 0; i < workers_.size(); ++i) {
+                auto &worker = workers_[i];
+                if (worker.pid != pid) {
+                    continue;
+                }
+                worker.reaped = true;
+                worker.status = status;
+                if (worker.idle) {
+                    replace_worker(i);
+                }
+                break;
+            }
+        }
+    }
+
+    auto recycle_after() const -> size_t {
+        return recycle_after_;
+    }
+
+    /// called from a worker, blocks until a job is received.
+    /// returns false if the channel is closed, i.e., the worker should exit.
+    static auto receive_job(int channel, protocol::Frame &job) -> bool {
+        return protocol::read_frame(channel, job);
+    }
+
+    /// called from a worker to report the progress of the received job.
+    static void emit_event(int channel, uint64_t job_id, const std::string &event) {
+        protocol::write_frame(channel, job_id, event, protocol::FrameKind::Event);
+    }
+
+    /// called from a worker once the received job is done.
+    static void finish_job(int channel, uint64_t job_id, const std::string &response) {
+        protocol::write_frame(channel, job_id, response);
+    }
+
+private:
+    struct Worker {
+        pid_t pid { -1 };
+        int channel { -1 };
+        bool idle { false };
+        size_t num_jobs { 0 };
+        uint64_t job_id { 0 };
+        bool cancelled { false };
+        /// whether the worker has been waited for by `reap`, with its status.
+        bool reaped { false };
+        int status { 0 };
+        /// the frames being received from the worker, and the rest of the
+        /// job being sent to it.
+        protocol::FrameReader reader {};
+        protocol::FrameWriter writer {};
+    };
+
+    /// a replaced worker yet to exit, waited for by `reap`.
+    struct ExitingWorker {
+        pid_t pid;
+        bool cancelled;
+    };
+
+    struct PendingJob {
+        protocol::Frame frame;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    /// fork a new worker for the slot `index`.
+    void spawn(size_t index) {
+        int channels[2] { -1, -1 };
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, channels) < 0) {
+            printer_.print_error("failed to create worker channel: " +
+                                 std::string(std::strerror(errno)), true);
+            exit(EXIT_FAILURE);
+        }
+
+        std::fflush(nullptr);
+        pid_t pid = fork();
+        if (pid < 0) {
+            printer_.print_error("failed to fork worker process: " +
+                                 std::string(std::strerror(errno)), true);
+            exit(EXIT_FAILURE);
+        } else if (pid == 0) {
+            // child -- only keep its own end of its own channel
+            for (auto &worker : workers_) {
+                if (worker.channel >= 0) {
+                    close(worker.channel);
+                    worker.channel = -1;
+                }
+            }
+            close(channels[0]);
+            worker_main_(channels[1], index);
+            exit(EXIT_SUCCESS);
+        }
+
+        close(channels[1]);
+        fcntl(channels[0], F_SETFL, fcntl(channels[0], F_GETFL) | O_NONBLOCK);
+        workers_[index] = Worker {
+            .pid = pid,
+            .channel = channels[0],
+            .idle = true,
+            .num_jobs = 0
+        };
+        if (on_channel_) {
+            on_channel_(channels[0], true);
+        }
+        printer_.log("spawned worker " + std::to_string(pid));
+    }
+
+    /// close the channel of the worker in slot `index` and fork a new one in
+    /// its place, the old one is left to `reap` unless it has been reaped.
+    void replace_worker(size_t index) {
+        auto &worker = workers_[index];
+        if (on_channel_) {
+            on_channel_(worker.channel, false);
+        }
+        close(worker.channel);
+        worker.channel = -1;
+
+        const ExitingWorker exiting { .pid = worker.pid, .cancelled = worker.cancelled };
+        if (worker.reaped) {
+            report_exit(exiting, worker.status);
+        } else {
+            exiting_.push_back(exiting);
+        }
+        spawn(index);
+    }
+
+    void report_exit(const ExitingWorker &worker, int status) {
+        if (worker.cancelled) {
+            // killed by `cancel`, not worth an error
+        } else if (WIFSIGNALED(status)) {
+            printer_.print_error("worker " + std::to_string(worker.pid) +
+                                 " killed by signal " + std::to_string(WTERMSIG(status)) +
+                                 " (" + strsignal(WTERMSIG(status)) + ")", true);
+        } else if (WIFEXITED(status) && WEXITSTATUS(status) != EXIT_SUCCESS) {
+            printer_.print_error("worker " + std::to_string(worker.pid) +
+                                 " exited with status " + std::to_string(WEXITSTATUS(status)),
+                                 true);
+        }
+    }
+
+    auto find_worker(int channel) const -> std::optional<size_t> {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (workers_[i].channel == channel) {
+                return i;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /// send the pending jobs to the idle workers.
+    void assign_pending_jobs() {
+        for (size_t i = 0; i < workers_.size() && !pending_.empty(); ++i) {
+            auto &worker = workers_[i];
+            if (!worker.idle) {
+                continue;
+            }
+
+            auto &job = pending_.front();
+            if (!worker.writer.send(worker.channel, job.frame.request_id, job.frame.payload)) {
+                // the worker has gone away in the meantime, try the new one
+                replace_worker(i);
+                i -= 1;
+                continue;
+            }
+            if (worker.writer.pending() && on_output_) {
+                on_output_(worker.channel, true);
+            }
+            worker.idle = false;
+            worker.num_jobs += 1;
+            worker.job_id = job.frame.request_id;
+            if (on_start_) {
+                on_start_(job.frame.request_id, std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - job.queued_at).count());
+            }
+            pending_.pop_front();
+        }
+    }
+
+    size_t pool_size_;
+    size_t recycle_after_;
+    size_t max_pending_;
+    const Printer &printer_;
+    WorkerMain worker_main_;
+    ChannelHook on_channel_;
+    StartHook on_start_;
+    OutputHook on_output_;
+    std::vector<Worker> workers_;
+    std::vector<ExitingWorker> exiting_;
+    std::deque<PendingJob> pending_;
+};
+
+#endif  // WORKER_POOL_H
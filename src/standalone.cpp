@@ -1,10 +1,18 @@
+#include <chrono>
+#include <csignal>
+#include <fcntl.h>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <sys/resource.h>
 
 #include "llvm_util/compare.h"
 #include "llvm_util/llvm2alive.h"
 #include "llvm_util/llvm_optimizer.h"
 #include "llvm_util/utils.h"
 #include "smt/smt.h"
+#include "smt/solver.h"
+#include "util/parallel.h"
 
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Bitcode/BitcodeReader.h"
@@ -15,6 +23,7 @@
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/TargetParser/Triple.h"
 #include "llvm/Transforms/Utils/Cloning.h"
@@ -29,11 +38,17 @@ using namespace std;
 
 constexpr auto CPP_MANGLING_PREFIX = "_Z";
 constexpr auto RUST_MANGLING_PREFIX = "_ZN";
-constexpr auto SRC_UB_PROMPT = "WARNING: Source function is always UB";
 
 #include "Comparer.h"
 #include "Printer.h"
 #include "Preprocessor.h"
+#include "SmtProfile.h"
+#include "VerdictStore.h"
+
+/// the size limit of the per-function verdict store used by `--incremental`.
+constexpr uint64_t VERDICT_STORE_SIZE = 256 * 1024 * 1024;
+/// the size limit of the smt query cache used by `--smt-query-cache`.
+constexpr uint64_t SMT_QUERY_CACHE_SIZE = 256 * 1024 * 1024;
 
 namespace {
 
@@ -53,10 +68,13 @@ llvm::cl::opt<std::string> opt_rust_pattern {
 
 }  // namespace
 
+/// open a textual (`.ll`) or bitcode (`.bc`) ir file, the latter is loaded
+/// lazily, i.e., only the bodies of the compared functions (and what they
+/// depend on) are materialized, see `ModuleSlice`.
 auto open_input_file(llvm::LLVMContext &context,
                      const std::string &path) -> std::unique_ptr<llvm::Module> {
     llvm::SMDiagnostic err {};
-    auto module = llvm::parseIRFile(path, err, context);
+    auto module = llvm::getLazyIRFileModule(path, err, context);
 
     if (!module) {
         err.print("open_input_file", llvm::errs());
@@ -66,6 +84,354 @@ auto open_input_file(llvm::LLVMContext &context,
     return module;
 }
 
+/// the outcome of validating a cpp/rust function pair.
+struct Validation {
+    ComparisonResult result {};
+    std::string verifier_output {};
+    unsigned num_correct { 0 };
+    unsigned num_unsound { 0 };
+    unsigned num_failed { 0 };
+    unsigned num_errors { 0 };
+    /// the number of verdicts reused from the previous runs.
+    unsigned num_cached { 0 };
+    /// whether the source (cpp) function is always UB and the modules have
+    /// been switched and verified again.
+    bool src_ub_reversed { false };
+};
+
+/// the verdicts of the previous runs, set with `--incremental`.
+std::unique_ptr<VerdictStore> verdict_store {};
+
+/// compare the functions in `cpp_module` and `rust_module`, all verifier
+/// output is buffered in the returned `Validation`.
+auto validate(llvm::Module &cpp_module, llvm::Module &rust_module,
+              smt::smt_initializer &smt_initializer,
+              bool use_specified_function_name,
+              const std::string &cpp_func_name,
+              const std::string &rust_func_name) -> Validation {
+    // set up the target library info by the data layout and target triple from
+    // `cpp_module`. note: `target_library_info` is needed for different
+    // platforms.
+    auto &data_layout = cpp_module.getDataLayout();
+    llvm::Triple target_triple { cpp_module.getTargetTriple() };
+    llvm::TargetLibraryInfoWrapperPass target_library_info { target_triple };
+
+    // initialize the llvm utilities for the data layout of the modules.
+    llvm_util::initializer llvm_util_initializer { std::cout, data_layout };
+
+    // set up the verifier to compare the cpp and rust functions in llvm ir
+    // level.
+    std::stringstream verifier_buffer {};
+    llvm_util::Verifier verifier { target_library_info, smt_initializer,
+                                  verifier_buffer };
+    verifier.verdict_cache = verdict_store.get();
+
+    Comparer comparer { cpp_module, rust_module, opt_cpp_pattern,
+                        opt_rust_pattern, verifier, use_specified_function_name,
+                        cpp_func_name, rust_func_name };
+    Validation validation { .result = comparer.compare(),
+                            .verifier_output = verifier_buffer.str() };
+
+    // check for potential source undefined behavior
+    if (validation.verifier_output.find(SRC_UB_PROMPT) != std::string::npos) {
+        std::stringstream reversed_buffer {};
+        llvm_util::Verifier reversed_verifier { target_library_info,
+                                                 smt_initializer,
+                                                 reversed_buffer };
+        reversed_verifier.verdict_cache = verdict_store.get();
+
+        // switch the order of modules
+        Comparer reversed_comparer { rust_module, cpp_module, opt_rust_pattern,
+                                     opt_cpp_pattern, reversed_verifier,
+                                     use_specified_function_name,
+                                     rust_func_name, cpp_func_name };
+        validation.result = reversed_comparer.compare();
+        validation.verifier_output = reversed_buffer.str();
+        validation.src_ub_reversed = true;
+        validation.num_correct = reversed_verifier.num_correct;
+        validation.num_unsound = reversed_verifier.num_unsound;
+        validation.num_failed = reversed_verifier.num_failed;
+        validation.num_errors = reversed_verifier.num_errors;
+        validation.num_cached = verifier.num_cached + reversed_verifier.num_cached;
+        return validation;
+    }
+
+    validation.num_correct = verifier.num_correct;
+    validation.num_unsound = verifier.num_unsound;
+    validation.num_failed = verifier.num_failed;
+    validation.num_errors = verifier.num_errors;
+    validation.num_cached = verifier.num_cached;
+    return validation;
+}
+
+/// pair up all the functions in `cpp_module` and `rust_module` by the
+/// `--pairing` options and verify every pair, the smt queries of the pairs
+/// (see `Comparer::take_pair_smt_profile`) are appended to `smt_profile`.
+auto validate_all_pairs(llvm::Module &cpp_module, llvm::Module &rust_module,
+                        smt::smt_initializer &smt_initializer,
+                        Preprocessor &preprocessor, const Printer &printer,
+                        llvm::json::Array &smt_profile) -> int {
+    auto &data_layout = cpp_module.getDataLayout();
+    llvm::Triple target_triple { cpp_module.getTargetTriple() };
+    llvm::TargetLibraryInfoWrapperPass target_library_info { target_triple };
+    llvm_util::initializer llvm_util_initializer { std::cout, data_layout };
+
+    std::stringstream verifier_buffer {};
+    llvm_util::Verifier verifier { target_library_info, smt_initializer,
+                                  verifier_buffer };
+    verifier.verdict_cache = verdict_store.get();
+    Comparer comparer { cpp_module, rust_module, opt_cpp_pattern,
+                        opt_rust_pattern, verifier };
+
+    auto mode = preprocessor.pairing() == "demangled"   ? PairingMode::Demangled
+                : preprocessor.pairing() == "signature" ? PairingMode::Signature
+                                                        : PairingMode::Mapping;
+    auto results = comparer.compare_all(mode, preprocessor.pairing_map(),
+                                        preprocessor.num_jobs());
+    for (auto &query : comparer.take_pair_smt_profile()) {
+        smt_profile.push_back(std::move(query));
+    }
+    printer.print_summary(verifier.num_correct, verifier.num_unsound,
+                          verifier.num_failed, results, verifier_buffer.str());
+    if (verifier.num_cached > 0) {
+        printer.print_info("reused " + std::to_string(verifier.num_cached) +
+                           " verdict(s) of unchanged function pairs");
+    }
+    return verifier.num_errors > 0;
+}
+
+/// the status of a validated pair reported in batch mode.
+auto validation_status(const Validation &validation) -> std::string {
+    if (validation.num_unsound > 0) {
+        return "unsound";
+    } else if (validation.num_failed > 0) {
+        return "failed_to_prove";
+    } else if (validation.num_errors > 0 || validation.num_correct == 0) {
+        return "error";
+    }
+    return "correct";
+}
+
+/// serialize a batch report line, i.e., a single-line json object.
+auto to_json_line(llvm::json::Object object) -> std::string {
+    std::string line {};
+    llvm::raw_string_ostream os { line };
+    os << llvm::json::Value(std::move(object));
+    os.flush();
+    return line + "\n";
+}
+
+/// the json line reported for a pair whose worker process did not finish,
+/// prepared before the validation starts since it is sent from the signal
+/// handler, see `batch_signal_handler`.
+std::string batch_timeout_line {};
+std::string batch_crash_line {};
+std::unique_ptr<parallel> batch_manager {};
+
+void batch_signal_handler(int signum) {
+    batch_manager->setTimeoutMessage(signum == SIGALRM ? batch_timeout_line.c_str()
+                                                       : batch_crash_line.c_str());
+    batch_manager->finishChild(/*is_timeout=*/true);
+    // this is a fully asynchronous exit, skip destructors and such
+    _Exit(0);
+}
+
+/// validate a single pair in a batch worker process and return its report.
+auto validate_batch_pair(const IrPair &pair, smt::smt_initializer &smt_initializer) -> std::string {
+    auto wall_start = std::chrono::steady_clock::now();
+    llvm::json::Object report {
+        { "name", pair.name },
+        { "cpp_ir", pair.cpp_path },
+        { "rust_ir", pair.rust_path }
+    };
+    auto finish = [&](llvm::json::Object &report) {
+        struct rusage usage {};
+        getrusage(RUSAGE_SELF, &usage);
+        auto cpu_ms = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+                      (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+        auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - wall_start).count();
+        report["wall_ms"] = static_cast<int64_t>(wall_ms);
+        report["cpu_ms"] = static_cast<int64_t>(cpu_ms);
+        if (auto queries = take_smt_profile(); !queries.empty()) {
+            report["smt_profile"] = std::move(queries);
+        }
+        return to_json_line(std::move(report));
+    };
+
+    if (!std::filesystem::exists(pair.cpp_path) || !std::filesystem::exists(pair.rust_path)) {
+        report["status"] = "missing";
+        report["error"] = "ir file not found";
+        return finish(report);
+    }
+
+    llvm::LLVMContext context {};
+    auto cpp_module = open_input_file(context, pair.cpp_path);
+    auto rust_module = open_input_file(context, pair.rust_path);
+    if (!cpp_module || !rust_module) {
+        report["status"] = "error";
+        report["error"] = "failed to open input files";
+        return finish(report);
+    }
+
+    bool use_specified_function_name = !pair.cpp_func_name.empty() && !pair.rust_func_name.empty();
+    auto validation = validate(*cpp_module, *rust_module, smt_initializer,
+                               use_specified_function_name,
+                               pair.cpp_func_name, pair.rust_func_name);
+    report["status"] = validation_status(validation);
+    report["cpp_function"] = validation.result.cpp_name;
+    report["rust_function"] = validation.result.rust_name;
+    report["error"] = validation.result.error_message;
+    report["src_ub_reversed"] = validation.src_ub_reversed;
+    report["num_correct"] = static_cast<int64_t>(validation.num_correct);
+    report["num_unsound"] = static_cast<int64_t>(validation.num_unsound);
+    report["num_failed"] = static_cast<int64_t>(validation.num_failed);
+    report["num_errors"] = static_cast<int64_t>(validation.num_errors);
+    report["num_cached"] = static_cast<int64_t>(validation.num_cached);
+    return finish(report);
+}
+
+/// write the smt queries (see `take_smt_profile`) along with their totals by
+/// query name to `path`.
+void write_smt_profile(const std::string &path, llvm::json::Array queries, const Printer &printer) {
+    std::ofstream file { path };
+    if (!file) {
+        printer.print_error("failed to write the smt profile to " + path);
+        return;
+    }
+    auto by_query = summarize_smt_profile(queries);
+    file << to_json_line(llvm::json::Object {
+        { "by_query", std::move(by_query) },
+        { "queries", std::move(queries) }
+    });
+}
+
+/// validate every pair collected by the preprocessor in isolated worker
+/// processes, at most `--jobs` at a time (or as many as granted by alive2's
+/// job server when `ALIVE_JOBSERVER_FIFO` is set), and print one json line per
+/// pair followed by a summary line, in the same order as the pairs.
+auto run_batch(Preprocessor &preprocessor, const Printer &printer) -> int {
+    auto pairs = preprocessor.collect_batch_pairs();
+    auto wall_start = std::chrono::steady_clock::now();
+
+    // the workers are forked from here, so the smt solver is only initialized
+    // once for the whole batch.
+    smt::smt_initializer smt_initializer {};
+
+    std::stringstream parent_ss {};
+    std::stringstream batch_output {};
+    if (getenv("ALIVE_JOBSERVER_FIFO")) {
+        batch_manager = std::make_unique<fifo>(preprocessor.num_jobs(), parent_ss, batch_output);
+    } else {
+        batch_manager = std::make_unique<unrestricted>(preprocessor.num_jobs(), parent_ss, batch_output);
+    }
+    if (!batch_manager->init()) {
+        printer.print_error("failed to initialize the batch worker processes");
+        return EXIT_FAILURE;
+    }
+
+    for (const auto &pair : pairs) {
+        auto [pid, osp, index] = batch_manager->limitedFork();
+        if (pid == -1) {
+            printer.print_error("failed to fork the batch worker process for " + pair.name);
+            return EXIT_FAILURE;
+        }
+
+        if (pid != 0) {
+            // parent leaves a placeholder that is patched up with the
+            // worker's output in `finishParent`
+            parent_ss << "include(" << index << ")\n";
+            continue;
+        }
+
+        // worker process, the verifier and comparer print to stdout which
+        // is reserved for the json lines
+        int dev_null = open("/dev/null", O_WRONLY);
+        if (dev_null >= 0) {
+            dup2(dev_null, STDOUT_FILENO);
+            close(dev_null);
+        }
+
+        llvm::json::Object unfinished_report {
+            { "name", pair.name },
+            { "cpp_ir", pair.cpp_path },
+            { "rust_ir", pair.rust_path },
+            { "status", "timeout" }
+        };
+        batch_timeout_line = to_json_line(llvm::json::Object(unfinished_report));
+        unfinished_report["status"] = "crashed";
+        batch_crash_line = to_json_line(std::move(unfinished_report));
+        for (int signum : { SIGALRM, SIGSEGV, SIGBUS, SIGABRT, SIGFPE, SIGXCPU }) {
+            signal(signum, batch_signal_handler);
+        }
+        if (preprocessor.batch_timeout() > 0) {
+            alarm(preprocessor.batch_timeout());
+        }
+        smt::solver_set_time_budget(preprocessor.smt_time_budget());
+
+        *osp << validate_batch_pair(pair, smt_initializer);
+
+        alarm(0);
+        batch_manager->finishChild(/*is_timeout=*/false);
+        exit(EXIT_SUCCESS);
+    }
+    batch_manager->finishParent();
+
+    // forward the reports and summarize them, the smt profiles of the pairs
+    // (if any) go to their own file instead
+    std::map<std::string, int64_t> status_counts {};
+    llvm::json::Array smt_profile {};
+    std::string line {};
+    while (std::getline(batch_output, line)) {
+        if (auto report = llvm::json::parse(line)) {
+            if (auto *object = report->getAsObject()) {
+                if (auto status = object->getString("status")) {
+                    status_counts[status->str()] += 1;
+                }
+                if (auto *queries = object->getArray("smt_profile")) {
+                    auto name = object->getString("name").value_or("").str();
+                    for (auto &query : *queries) {
+                        if (auto *fields = query.getAsObject()) {
+                            (*fields)["pair"] = name;
+                        }
+                        smt_profile.push_back(std::move(query));
+                    }
+                    object->erase("smt_profile");
+                    line = to_json_line(std::move(*object));
+                    line.pop_back();
+                }
+            }
+        } else {
+            llvm::consumeError(report.takeError());
+        }
+        std::cout << line << std::endl;
+    }
+
+    auto wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - wall_start).count();
+    llvm::json::Object counts {};
+    int64_t num_reported { 0 };
+    for (const auto &[status, count] : status_counts) {
+        counts[status] = count;
+        num_reported += count;
+    }
+    llvm::json::Object summary {
+        { "total", static_cast<int64_t>(pairs.size()) },
+        { "unreported", static_cast<int64_t>(pairs.size()) - num_reported },
+        { "statuses", std::move(counts) },
+        { "jobs", static_cast<int64_t>(preprocessor.num_jobs()) },
+        { "wall_ms", static_cast<int64_t>(wall_ms) }
+    };
+    std::cout << to_json_line(llvm::json::Object { { "summary", std::move(summary) } }) << std::flush;
+    if (!preprocessor.smt_profile().empty()) {
+        write_smt_profile(preprocessor.smt_profile(), std::move(smt_profile), printer);
+    }
+
+    bool all_correct = num_reported == static_cast<int64_t>(pairs.size()) &&
+                       status_counts["correct"] == num_reported;
+    return all_correct ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
     // basic initializations
     llvm::sys::PrintStackTraceOnErrorSignal(argv[0]);
@@ -76,6 +442,18 @@ int main(int argc, char *argv[]) {
 
     // preprocess the command line arguments
     Preprocessor preprocessor { argc, argv };
+    smt::solver_set_portfolio(preprocessor.smt_portfolio());
+    smt::solver_set_parallel_queries(preprocessor.smt_parallel_queries());
+    smt::solver_set_incremental(preprocessor.smt_incremental());
+    smt::solver_set_profile(!preprocessor.smt_profile().empty());
+    smt::solver_set_query_cache(preprocessor.smt_query_cache(), SMT_QUERY_CACHE_SIZE);
+    if (preprocessor.is_incremental()) {
+        verdict_store = std::make_unique<VerdictStore>(VERDICT_STORE_SIZE, printer);
+    }
+    if (preprocessor.is_batch()) {
+        return run_batch(preprocessor, printer);
+    }
+
     auto [cpp_func_name, rust_func_name] = preprocessor.get_function_names();
     bool use_specified_function_name = preprocessor.use_specified_function_name();
     std::vector<char *> preprocessed_argv { argv[0] };
@@ -91,54 +469,49 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
-    // set up the target library info by the data layout and target triple from
-    // `cpp_module`. note: `target_library_info` is needed for different
-    // platforms.
-    auto &data_layout = cpp_module->getDataLayout();
-    llvm::Triple target_triple { cpp_module->getTargetTriple() };
-    llvm::TargetLibraryInfoWrapperPass target_library_info { target_triple };
-
-    // initialize the llvm utilities and smt solver (i.e., z3).
-    llvm_util::initializer llvm_util_initializer { std::cout, data_layout };
+    // initialize the smt solver (i.e., z3).
     smt::smt_initializer smt_initializer {};
+    smt::solver_set_time_budget(preprocessor.smt_time_budget());
 
-    // set up the verifier to compare the cpp and rust functions in llvm ir
-    // level.
-    std::stringstream verifier_buffer {};
-    llvm_util::Verifier verifier { target_library_info, smt_initializer,
-                                  verifier_buffer };
+    if (!preprocessor.pairing().empty()) {
+        // the pairs are verified in forked processes, which send their smt
+        // queries back along with their outcomes
+        llvm::json::Array smt_profile {};
+        int status = validate_all_pairs(*cpp_module, *rust_module, smt_initializer,
+                                        preprocessor, printer, smt_profile);
+        if (!preprocessor.smt_profile().empty()) {
+            write_smt_profile(preprocessor.smt_profile(), std::move(smt_profile), printer);
+        }
+        return status;
+    }
 
-    Comparer comparer { *cpp_module, *rust_module, opt_cpp_pattern,
-                        opt_rust_pattern, verifier, use_specified_function_name,
-                        cpp_func_name, rust_func_name };
-    auto results = comparer.compare();
-    if (!results.success && results.error_message.find("multiple functions") != std::string::npos) {
+    auto validation = validate(*cpp_module, *rust_module, smt_initializer,
+                               use_specified_function_name,
+                               cpp_func_name, rust_func_name);
+    if (!validation.result.success &&
+        validation.result.error_message.find("multiple functions") != std::string::npos) {
         // indicates the multiple functions are found, but no function name has
         // been specified with the corresponding options.
         return EXIT_FAILURE;
     }
 
-    // check for potential source undefined behavior
-    std::string verifier_output { verifier_buffer.str() };
-    if (verifier_output.find(SRC_UB_PROMPT) != std::string::npos) {
+    if (validation.src_ub_reversed) {
         printer.print_src_ub_prompt();
-
-        llvm_util::Verifier reversed_verifier { target_library_info,
-                                                 smt_initializer,
-                                                 std::cout };
-
-        // switch the order of modules
-        Comparer reversed_comparer { *rust_module, *cpp_module, opt_rust_pattern,
-                                       opt_cpp_pattern, reversed_verifier };
-        auto reversed_results = reversed_comparer.compare();
-
-        printer.print_summary(reversed_verifier.num_correct,
-                              reversed_verifier.num_unsound,
-                              reversed_verifier.num_failed, reversed_results);
-        return reversed_verifier.num_errors > 0;
-    } else {
-        printer.print_summary(verifier.num_correct, verifier.num_unsound,
-                              verifier.num_failed, results, verifier_output);
-        return verifier.num_errors > 0;
     }
+    printer.print_summary(validation.num_correct, validation.num_unsound,
+                          validation.num_failed, validation.result,
+                          validation.verifier_output);
+    if (validation.num_cached > 0) {
+        printer.print_info("reused " + std::to_string(validation.num_cached) +
+                           " verdict(s) of unchanged function pairs");
+    }
+    if (preprocessor.smt_portfolio() > 1 || !preprocessor.smt_query_cache().empty()) {
+        // which configurations won (and how often the cache answered), to
+        // tune the defaults
+        smt::solver_print_stats(std::cout);
+    }
+    if (!preprocessor.smt_profile().empty()) {
+        write_smt_profile(preprocessor.smt_profile(), take_smt_profile(), printer);
+    }
+    return validation.num_errors > 0;
 }
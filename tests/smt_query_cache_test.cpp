@@ -0,0 +1,125 @@
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "smt/expr.h"
+#include "smt/smt.h"
+#include "smt/solver.h"
+
+/// the round trips of the smt query cache (see `smt::solver_set_query_cache`),
+/// i.e., a query is answered from the cache after renaming its variables,
+/// reordering its conjuncts and swapping the operands of its commutative
+/// operators, the cached model of a sat query satisfies the renamed query,
+/// and a query that differs in a constant is not answered from the cache.
+/// every check is done both by the process that stored the answers and by a
+/// fresh cache reading them back from the disk.
+
+namespace {
+
+int failures { 0 };
+
+void check(bool condition, const std::string &what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        failures += 1;
+    }
+}
+
+/// a query over the given names, `swapped` gives the same query with its
+/// conjuncts and commutative operands in another order (the operands of the
+/// same shape keep their order in the serialization, so they are not swapped).
+auto make_query(const std::string &prefix, bool swapped, uint64_t sum = 10) -> std::vector<smt::expr> {
+    auto a = smt::expr::mkVar((prefix + "a").c_str(), 8);
+    auto b = smt::expr::mkVar((prefix + "b").c_str(), 8);
+    auto mem = smt::expr::mkArray((prefix + "mem").c_str(), smt::expr::mkUInt(0, 8),
+                                  smt::expr::mkUInt(0, 8));
+    auto f = smt::expr::mkUF((prefix + "f").c_str(), { a }, b);
+    auto three = smt::expr::mkUInt(3, 8);
+    std::vector<smt::expr> conjuncts {
+        (swapped ? b * three + a : a + b * three) == smt::expr::mkUInt(sum, 8),
+        a.ult(smt::expr::mkUInt(3, 8)),
+        mem.load(a) == smt::expr::mkUInt(42, 8),
+        swapped ? smt::expr::mkUInt(7, 8) == f : f == smt::expr::mkUInt(7, 8)
+    };
+    if (swapped) {
+        std::swap(conjuncts[0], conjuncts[3]);
+        std::swap(conjuncts[1], conjuncts[2]);
+    }
+    return conjuncts;
+}
+
+auto conjunction(const std::vector<smt::expr> &conjuncts) -> smt::expr {
+    smt::expr result { true };
+    for (const auto &conjunct : conjuncts) {
+        result &= conjunct;
+    }
+    return result;
+}
+
+/// solve `conjuncts`, and check whether it has been answered from the cache.
+auto solve(const std::vector<smt::expr> &conjuncts, bool expect_hit, const std::string &what)
+    -> smt::Result {
+    auto hits = smt::solver_stats().num_cache_hits;
+    smt::Solver solver {};
+    for (const auto &conjunct : conjuncts) {
+        solver.add(conjunct);
+    }
+    auto result = solver.check(what.c_str());
+    check((smt::solver_stats().num_cache_hits > hits) == expect_hit,
+          what + (expect_hit ? " is answered from the cache" : " is not answered from the cache"));
+    return result;
+}
+
+void check_round_trips(bool stored_here) {
+    const std::string phase { stored_here ? " (same process)" : " (from disk)" };
+
+    auto renamed = make_query("y_", true);
+    auto sat = solve(renamed, true, "the renamed sat query" + phase);
+    check(sat.isSat(), "the renamed sat query is sat" + phase);
+    if (sat.isSat()) {
+        auto value = sat.getModel().eval(conjunction(renamed), true);
+        check(value.isTrue(), "the cached model satisfies the renamed query" + phase);
+    }
+
+    auto unsat = make_query("z_", true);
+    unsat.push_back(smt::expr::mkVar("z_a", 8) == smt::expr::mkUInt(5, 8));
+    check(solve(unsat, true, "the renamed unsat query" + phase).isUnsat(),
+          "the renamed unsat query is unsat" + phase);
+
+    // not stored by the previous phases either
+    auto other = make_query("w_", false, stored_here ? 11 : 12);
+    check(solve(other, false, "the query with another constant" + phase).isSat(),
+          "the query with another constant is sat" + phase);
+}
+
+}  // namespace
+
+int main() {
+    auto dir = std::filesystem::temp_directory_path() /
+               ("smt_query_cache_test_" + std::to_string(getpid()));
+    smt::smt_initializer smt_init {};
+    smt::solver_set_query_cache(dir.string(), 64 * 1024 * 1024);
+
+    auto original = make_query("x_", false);
+    auto sat = solve(original, false, "the original sat query");
+    check(sat.isSat(), "the original sat query is sat");
+    auto unsat = make_query("u_", false);
+    unsat.push_back(smt::expr::mkVar("u_a", 8) == smt::expr::mkUInt(5, 8));
+    check(solve(unsat, false, "the original unsat query").isUnsat(),
+          "the original unsat query is unsat");
+
+    check_round_trips(true);
+    // a fresh cache only knows what has been written to the disk
+    smt::solver_set_query_cache(dir.string(), 64 * 1024 * 1024);
+    check_round_trips(false);
+
+    smt::solver_set_query_cache("", 0);
+    std::filesystem::remove_all(dir);
+    if (failures > 0) {
+        return EXIT_FAILURE;
+    }
+    std::cout << "all checks passed\n";
+    return EXIT_SUCCESS;
+}
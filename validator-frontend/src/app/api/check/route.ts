@@ -0,0 +1,36 @@
+import { NextResponse } from 'next/server';
+
+// note: relay server runs on localhost:3001 by default
+const RELAY_URL = process.env.RELAY_URL || 'http://localhost:3001';
+
+export async function POST(request: Request) {
+  try {
+    const { cppCode, rustCode, cppFunctionName, rustFunctionName, includeIR } = await request.json();
+
+    const response = await fetch(`${RELAY_URL}/api/check`, {
+      method: 'POST',
+      headers: {
+        // relay server expects json!
+        'Content-Type': 'application/json',
+      },
+      body: JSON.stringify({ cppCode, rustCode, cppFunctionName, rustFunctionName, includeIR }),
+    });
+
+    const data = await response.json();
+
+    if (!response.ok || data.error) {
+        return NextResponse.json({ error: data.error }, { status: response.ok ? 500 : response.status });
+    }
+
+    return NextResponse.json(data);
+  } catch (error) {
+    return NextResponse.json(
+      {
+        success: false,
+        verifier_output: error instanceof Error ? error.message : 'An unknown error occurred',
+        num_errors: 1
+      },
+      { status: 500 }
+    );
+  }
+}
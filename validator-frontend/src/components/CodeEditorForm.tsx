@@ -23,6 +23,8 @@ export default function CodeEditorForm() {
   const [showIRModal, setShowIRModal] = useState(false);
   const [cppIR, setCppIR] = useState('');
   const [rustIR, setRustIR] = useState('');
+  // whether to ask for the IRs along with the validation result
+  const [showIR, setShowIR] = useState(false);
   const [isGeneratingIR, setIsGeneratingIR] = useState(false);
   const [toast, setToast] = useState<ToastMessage | null>(null);
 
@@ -47,6 +49,8 @@ export default function CodeEditorForm() {
 
     setIsGeneratingIR(true);
     setResult(null);
+    setCppIR('');
+    setRustIR('');
 
     try {
       // the IR generation loading state
@@ -56,51 +60,37 @@ export default function CodeEditorForm() {
       checkLimit('C++ code', cppCode, 'C++ code', CODE_LENGTH_LIMIT);
       checkLimit('Rust code', rustCode, 'Rust code', CODE_LENGTH_LIMIT);
 
-      const irResponse = await fetch('/api/generate-ir', {
-        method: 'POST',
-        headers: { 'Content-Type': 'application/json' },
-        body: JSON.stringify({ cppCode, rustCode }),
-      });
-
-      const irData = await irResponse.json();
-
-      // check for potential error for /api/generate-ir
-      if (!irResponse.ok || irData.error) {
-        throw new Error(irData.error);
-      }
-
-      // store the generated IR
-      setCppIR(irData.cppIR);
-      setRustIR(irData.rustIR);
-      setShowIRModal(true);
-
-      // start the validation
+      // generate and validate the IRs in a single request, the IRs are only
+      // sent back when they are to be shown
       setIsLoading(true);
-      showToast('LLVM IR generated, starting validation...', 'info');
-
-      // llvm ir length check
-      checkLimit('C++ IR', irData.cppIR, 'generated C++ IR', LLVM_IR_LENGTH_LIMIT);
-      checkLimit('Rust IR', irData.rustIR, 'generated Rust IR', LLVM_IR_LENGTH_LIMIT);
-
-      // validate the translation
-      const validationResponse = await fetch('/api/validate', {
+      setShowIRModal(true);
+      const checkResponse = await fetch('/api/check', {
         method: 'POST',
         headers: { 'Content-Type': 'application/json' },
         body: JSON.stringify({
-          cppIR: irData.cppIR,
-          rustIR: irData.rustIR,
+          cppCode,
+          rustCode,
           cppFunctionName: cppFunctionName.length > 0 ? cppFunctionName : 'EMPTY',
           rustFunctionName: rustFunctionName.length > 0 ? rustFunctionName : 'EMPTY',
+          includeIR: showIR,
         }),
       });
 
-      const validationData = await validationResponse.json();
+      const validationData = await checkResponse.json();
 
-      // check for potential error for /api/validate
-      if (!validationResponse.ok || validationData.error) {
+      // check for potential error for /api/check
+      if (!checkResponse.ok || validationData.error) {
         throw new Error(validationData.error);
       }
 
+      // llvm ir length check, an oversized IR is not shown (the validation
+      // result still is)
+      if (showIR) {
+        const fitsLimit = (ir?: string) => (ir && ir.length <= LLVM_IR_LENGTH_LIMIT ? ir : '');
+        setCppIR(fitsLimit(validationData.cppIR));
+        setRustIR(fitsLimit(validationData.rustIR));
+      }
+
       setResult(validationData);
       if (validationData.success) {
         showToast('Validation completed successfully!', 'success');
@@ -259,10 +249,21 @@ export default function CodeEditorForm() {
         onClose={() => setShowIRModal(false)}
         cppIR={cppIR}
         rustIR={rustIR}
+        showIR={showIR}
         validationResult={result}
         isValidating={isLoading}
       />
 
+      <label className="flex items-center gap-2 text-gray-600 cursor-pointer select-none">
+        <input
+          type="checkbox"
+          checked={showIR}
+          onChange={(e) => setShowIR(e.target.checked)}
+          className="h-4 w-4 rounded border-gray-300 text-blue-600 focus:ring-blue-500"
+        />
+        Show the generated LLVM IR
+      </label>
+
       <div className="flex gap-4">
         <button
           type="submit"
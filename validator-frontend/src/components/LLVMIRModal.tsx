@@ -11,6 +11,8 @@ interface LLVMIRModalProps {
   onClose: () => void;
   cppIR: string;
   rustIR: string;
+  // whether the IRs were requested, only the validation result is shown otherwise
+  showIR: boolean;
   validationResult: ValidationResult | null;
   isValidating: boolean;
 }
@@ -179,9 +181,10 @@ TooltipPortal.displayName = 'TooltipPortal';
 interface IRDisplayProps {
   cppIR: string;
   rustIR: string;
+  isGenerating: boolean;
 }
 
-const IRDisplay = memo(({ cppIR, rustIR }: IRDisplayProps) => (
+const IRDisplay = memo(({ cppIR, rustIR, isGenerating }: IRDisplayProps) => (
   <div className="grid grid-cols-2 gap-6 mb-6">
     <div>
       <h4 className="text-lg font-medium text-gray-900 mb-3">C++ LLVM IR</h4>
@@ -197,7 +200,7 @@ const IRDisplay = memo(({ cppIR, rustIR }: IRDisplayProps) => (
             />
           ) : (
             <div className="absolute inset-0 flex items-center justify-center bg-gray-50">
-              <span className="text-gray-500">Generating IR...</span>
+              <span className="text-gray-500">{isGenerating ? 'Generating IR...' : 'IR not available'}</span>
             </div>
           )}
         </div>
@@ -217,7 +220,7 @@ const IRDisplay = memo(({ cppIR, rustIR }: IRDisplayProps) => (
             />
           ) : (
             <div className="absolute inset-0 flex items-center justify-center bg-gray-50">
-              <span className="text-gray-500">Generating IR...</span>
+              <span className="text-gray-500">{isGenerating ? 'Generating IR...' : 'IR not available'}</span>
             </div>
           )}
         </div>
@@ -618,6 +621,7 @@ export default function LLVMIRModal({
   onClose,
   cppIR,
   rustIR,
+  showIR,
   validationResult,
   isValidating
 }: LLVMIRModalProps) {
@@ -659,7 +663,9 @@ export default function LLVMIRModal({
           {/* Header */}
           <div className="sticky top-0 z-20 bg-white border-b">
             <div className="flex justify-between items-center p-6">
-              <h3 className="text-2xl font-semibold text-gray-900 animate-fade-in">LLVM IR Generation</h3>
+              <h3 className="text-2xl font-semibold text-gray-900 animate-fade-in">
+                {showIR ? 'LLVM IR Generation' : 'Validation Result'}
+              </h3>
               <button 
                 onClick={onClose} 
                 className="text-gray-400 hover:text-gray-500 transition-colors duration-200"
@@ -677,7 +683,7 @@ export default function LLVMIRModal({
             ref={scrollContainerRef}
             className="p-6 pb-20 max-h-[calc(100vh-200px)] overflow-y-auto smooth-scroll"
           >
-            <IRDisplay cppIR={cppIR} rustIR={rustIR} />
+            {showIR && <IRDisplay cppIR={cppIR} rustIR={rustIR} isGenerating={isValidating} />}
 
             {isValidating ? (
               <div className="flex items-center justify-center py-4 animate-fade-in">